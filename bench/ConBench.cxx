@@ -0,0 +1,527 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <cstdlib>
+
+#ifdef CON_ZLIB
+#include <zlib.h>
+#endif
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks for parsing, writing and manipulating trees.
+//
+// Each corpus is generated into the output directory and measured in its own process, so that
+// the peak resident size belongs to that corpus alone. Results are printed one JSON object per
+// line:
+//
+//   {"corpus":"wide","benchmark":"buildFromFile","value":85.2,"unit":"MB/s"}
+//
+// Usage: ConBench [--size MB] [--repeat N] [--dir DIRECTORY] [corpus...]
+
+
+typedef std::chrono::steady_clock Clock;
+
+struct Settings
+{
+  size_t size = 4 << 20;
+  size_t repeat = 5;
+  std::string directory = ".temp/bench";
+};
+
+
+struct Corpus
+{
+  const char* name;
+  const char* description;
+  size_t (*generate)( const Settings&, const std::string&, std::string& );
+
+  // Many small root objects one after another, read with a document stream
+  bool documents;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Corpus generation. Each function fills the text of the root file and may write further files.
+// Returns the number of bytes parsed in total, including any included files
+
+size_t generateWide( const Settings& settings, const std::string&, std::string& text )
+{
+  // One object with many keys of each value type
+  text = "{\n";
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "  key" + std::to_string( i ) + " : ";
+    switch ( i % 4 )
+    {
+      case 0 : text += std::to_string( i * 7 ); break;
+      case 1 : text += std::to_string( i ) + ".25"; break;
+      case 2 : text += "\"value " + std::to_string( i ) + "\""; break;
+      case 3 : text += ( i % 8 == 3 ) ? "true" : "false"; break;
+    }
+    text += ",\n";
+  }
+  text += "  last : null\n}\n";
+  return text.size();
+}
+
+
+size_t generateDeep( const Settings& settings, const std::string&, std::string& text )
+{
+  // Many chains of nested objects and arrays
+  const size_t depth = 64;
+  text = "{\n  chains : [\n";
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "    ";
+    for ( size_t d = 0; d < depth; ++d ) text += ( d % 2 ) ? "[ " : "{ level : ";
+    text += std::to_string( i );
+    for ( size_t d = depth; d > 0; --d ) text += ( ( d - 1 ) % 2 ) ? " ]" : " }";
+    text += ",\n";
+  }
+  text += "    null\n  ]\n}\n";
+  return text.size();
+}
+
+
+size_t generateStrings( const Settings& settings, const std::string&, std::string& text )
+{
+  // Long strings, with and without escapes
+  std::string plain;
+  std::string escaped;
+  for ( size_t i = 0; i < 16; ++i )
+  {
+    plain += "Lorem ipsum dolor sit amet, consectetur adipiscing elit. ";
+    escaped += "Tab\\there, \\\"quoted\\\", back\\\\slash, caf\\u00e9 \\u263a and a newline\\n. ";
+  }
+
+  text = "{\n";
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "  s" + std::to_string( i ) + " : \"" + ( ( i % 2 ) ? escaped : plain ) + "\",\n";
+  }
+  text += "  last : \"\"\n}\n";
+  return text.size();
+}
+
+
+size_t generateUnicode( const Settings& settings, const std::string&, std::string& text )
+{
+  // Labels mixing ASCII with two, three and four byte characters
+  std::string label;
+  for ( size_t i = 0; i < 8; ++i )
+  {
+    label += "Caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac" "20 \xe6\x9d\xb1\xe4\xba\xac \xf0\x9f\x9a\x80 launch ";
+  }
+
+  text = "{\n";
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "  label" + std::to_string( i ) + " : \"" + label + "\",\n";
+  }
+  text += "  last : \"\"\n}\n";
+  return text.size();
+}
+
+
+size_t generateNumbers( const Settings& settings, const std::string&, std::string& text )
+{
+  // Arrays of integers, decimals and exponents
+  std::mt19937 random( 42 );
+  std::uniform_int_distribution<long> integers( -1000000000L, 1000000000L );
+  std::uniform_real_distribution<double> reals( -1.0e6, 1.0e6 );
+
+  text = "{\n";
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "  n" + std::to_string( i ) + " : [ ";
+    for ( size_t j = 0; j < 32; ++j )
+    {
+      std::ostringstream number;
+      number.precision( 17 );
+      switch ( j % 3 )
+      {
+        case 0 : number << integers( random ); break;
+        case 1 : number << reals( random ); break;
+        case 2 : number << std::scientific << reals( random ) * 1.0e-12; break;
+      }
+      text += number.str() + ( ( j < 31 ) ? ", " : " " );
+    }
+    text += "],\n";
+  }
+  text += "  last : 0\n}\n";
+  return text.size();
+}
+
+
+size_t generateIncludes( const Settings& settings, const std::string& directory, std::string& text )
+{
+  // A root that includes many files, which each include a shared leaf
+  std::string leaf_name = directory + "/include-leaf.con";
+  std::string leaf( "{ name : \"leaf\", values : [ 1, 2, 3, 4 ], enabled : true }\n" );
+  std::ofstream( leaf_name ) << leaf;
+
+  std::string branch( "{\n" );
+  for ( size_t i = 0; i < 64; ++i )
+  {
+    branch += "  item" + std::to_string( i ) + " : { id : " + std::to_string( i ) + ", weight : 0." + std::to_string( i ) + " },\n";
+  }
+  branch += "  leaf : <" + leaf_name + ">\n}\n";
+
+  // Includes are resolved relative to the working directory
+  text = "{\n";
+  size_t total = 0;
+  for ( size_t i = 0; total < settings.size; ++i )
+  {
+    std::string name = directory + "/include-" + std::to_string( i ) + ".con";
+    std::ofstream( name ) << branch;
+    total += branch.size() + leaf.size();
+
+    text += "  file" + std::to_string( i ) + " : <" + name + ">,\n";
+  }
+  text += "  last : null\n}\n";
+  return total + text.size();
+}
+
+
+size_t generateRecords( const Settings& settings, const std::string&, std::string& text )
+{
+  // A log of small documents of the same shape, one per line
+  text.clear();
+  for ( size_t i = 0; text.size() < settings.size; ++i )
+  {
+    text += "{ id : " + std::to_string( i ) + ", event : \"" + ( ( i % 3 ) ? "update" : "create" ) + "\", user : { name : \"user"
+          + std::to_string( i % 100 ) + "\", admin : " + ( ( i % 10 ) ? "false" : "true" ) + " }, tags : [ \"a\", \"b\" ], elapsed : "
+          + std::to_string( i % 1000 ) + ".5 }\n";
+  }
+  return text.size();
+}
+
+
+size_t generateFanout( const Settings& settings, const std::string&, std::string& text )
+{
+  // Arrays of objects with the same number of keys, for each of several fan-outs
+  const size_t fanouts[] = { 1, 2, 4, 8, 16, 64, 256 };
+  const size_t count = sizeof( fanouts ) / sizeof( fanouts[0] );
+
+  text = "{";
+  for ( size_t f = 0; f < count; ++f )
+  {
+    text += ( f == 0 ) ? "\n" : ",\n";
+    text += "  fanout" + std::to_string( fanouts[f] ) + " : [";
+    size_t start = text.size();
+    while ( text.size() - start < settings.size / count )
+    {
+      text += ( text.size() == start ) ? "\n    {" : ",\n    {";
+      for ( size_t i = 0; i < fanouts[f]; ++i )
+      {
+        text += ( i == 0 ) ? " key" : ", key";
+        text += std::to_string( i ) + " : " + std::to_string( i * 3 + 1 );
+      }
+      text += " }";
+    }
+    text += "\n  ]";
+  }
+  text += "\n}\n";
+  return text.size();
+}
+
+
+const Corpus corpora[] =
+{
+  { "wide", "one object with many keys", generateWide, false },
+  { "deep", "nested chains 64 levels deep", generateDeep, false },
+  { "strings", "long strings with escapes", generateStrings, false },
+  { "unicode", "long non-ASCII strings", generateUnicode, false },
+  { "numbers", "number heavy arrays", generateNumbers, false },
+  { "includes", "a tree of included files", generateIncludes, false },
+  { "records", "a log of small documents", generateRecords, true },
+  { "fanout", "many objects of 1 to 256 keys", generateFanout, false }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Measurement
+
+void report( const std::string& corpus, const std::string& benchmark, double value, const std::string& unit )
+{
+  std::cout << "{\"corpus\":\"" << corpus << "\",\"benchmark\":\"" << benchmark << "\",\"value\":" << value << ",\"unit\":\"" << unit << "\"}" << std::endl;
+}
+
+
+// Median wall time of the repetitions in seconds
+double measure( const Settings& settings, const std::function< void() >& work )
+{
+  std::vector< double > times;
+  for ( size_t i = 0; i < settings.repeat; ++i )
+  {
+    Clock::time_point start = Clock::now();
+    work();
+    times.push_back( std::chrono::duration< double >( Clock::now() - start ).count() );
+  }
+
+  std::sort( times.begin(), times.end() );
+  return times[ times.size() / 2 ];
+}
+
+
+double megabytes( size_t bytes )
+{
+  return static_cast< double >( bytes ) / ( 1 << 20 );
+}
+
+
+void runDocuments( const Settings& settings, const std::string& name, const std::string& filename, const std::string& text, double size )
+{
+  // Reusing the stream state and nodes between documents
+  size_t count = 0;
+  double seconds = measure( settings, [ &filename, &count ]()
+  {
+    std::ifstream input( filename );
+    CON::DocumentStream stream( input );
+    CON::Object document;
+    for ( count = 0; stream.next( document ); ++count ) {}
+  } );
+  report( name, "DocumentStream", size / seconds, "MB/s" );
+  report( name, "DocumentStream/documents", count / seconds, "1/s" );
+
+  // A separate parse for each line
+  std::vector< std::string > lines;
+  std::istringstream split( text );
+  for ( std::string line; std::getline( split, line ); ) lines.push_back( line );
+
+  seconds = measure( settings, [ &lines ]()
+  {
+    for ( std::vector< std::string >::iterator it = lines.begin(); it != lines.end(); ++it )
+    {
+      CON::Object document = CON::buildFromString( *it );
+    }
+  } );
+  report( name, "buildFromString/each", size / seconds, "MB/s" );
+  if ( count != lines.size() ) std::cerr << name << ": read " << count << " of " << lines.size() << " documents" << std::endl;
+}
+
+
+void runCorpus( const Settings& settings, const Corpus& corpus )
+{
+  std::string text;
+  size_t total = corpus.generate( settings, settings.directory, text );
+
+  std::string filename = settings.directory + "/" + corpus.name + ".con";
+  {
+    std::ofstream file( filename );
+    file << text;
+  }
+
+  std::string name( corpus.name );
+  double size = megabytes( total );
+  report( name, "size", size, "MB" );
+
+  if ( corpus.documents )
+  {
+    runDocuments( settings, name, filename, text, size );
+    return;
+  }
+
+  // Parsing
+  double seconds = measure( settings, [ &filename ]() { CON::Object object = CON::buildFromFile( filename ); } );
+  report( name, "buildFromFile", size / seconds, "MB/s" );
+
+  CON::ParseStats stats;
+  CON::ParseOptions measured;
+  measured.stats = &stats;
+  seconds = measure( settings, [ &filename, &measured ]() { CON::Object object = CON::buildFromFile( filename, measured ); } );
+  report( name, "buildFromFile/stats", size / seconds, "MB/s" );
+
+  CON::ParseOptions checked;
+  checked.validateUtf8 = true;
+  seconds = measure( settings, [ &filename, &checked ]() { CON::Object object = CON::buildFromFile( filename, checked ); } );
+  report( name, "buildFromFile/utf8", size / seconds, "MB/s" );
+
+  CON::ParseOptions decoding;
+  decoding.decodeEscapes = true;
+  seconds = measure( settings, [ &filename, &decoding ]() { CON::Object object = CON::buildFromFile( filename, decoding ); } );
+  report( name, "buildFromFile/escapes", size / seconds, "MB/s" );
+
+#ifdef CON_ZLIB
+  // Decompressed as it is read. Throughput is of the decompressed size
+  std::string compressed = filename + ".gz";
+  gzFile gzip = gzopen( compressed.c_str(), "wb" );
+  gzwrite( gzip, text.data(), static_cast< unsigned >( text.size() ) );
+  gzclose( gzip );
+
+  seconds = measure( settings, [ &compressed ]() { CON::Object object = CON::buildFromFile( compressed ); } );
+  report( name, "buildFromFile/gzip", size / seconds, "MB/s" );
+#endif
+
+  seconds = measure( settings, [ &text ]() { CON::Object object = CON::buildFromString( text ); } );
+  report( name, "buildFromString", size / seconds, "MB/s" );
+
+  seconds = measure( settings, [ &text ]() { std::istringstream input( text ); CON::Object object = CON::buildFromStream( input ); } );
+  report( name, "buildFromStream", size / seconds, "MB/s" );
+
+  // Reloading into the tree from the previous repetition
+  CON::Object reloaded;
+  seconds = measure( settings, [ &filename, &reloaded ]() { CON::parseInto( reloaded, filename ); } );
+  report( name, "parseInto", size / seconds, "MB/s" );
+
+  CON::Object tree = CON::buildFromFile( filename );
+
+  // Peak while parsing, before any copies are made
+  struct rusage usage;
+  getrusage( RUSAGE_SELF, &usage );
+  report( name, "peakRSS", static_cast< double >( usage.ru_maxrss ) / 1024.0, "MB" );
+
+  // Writing
+  size_t written = 0;
+  seconds = measure( settings, [ &tree, &written ]() { std::ostringstream output; CON::writeToStream( tree, output ); written = output.str().size(); } );
+  report( name, "writeToStream", megabytes( written ) / seconds, "MB/s" );
+
+  seconds = measure( settings, [ &tree, &written ]() { std::ostringstream output; CON::writeToStream( tree, output, CON::Format::Compact ); written = output.str().size(); } );
+  report( name, "writeToStream/compact", megabytes( written ) / seconds, "MB/s" );
+
+  // Whole tree operations
+  std::vector< CON::Object > copies;
+  seconds = measure( settings, [ &tree, &copies ]() { copies.push_back( tree ); } );
+  report( name, "copy", seconds * 1.0e3, "ms" );
+
+  bool equal = true;
+  seconds = measure( settings, [ &tree, &copies, &equal ]() { equal = equal && ( tree == copies.back() ); } );
+  report( name, "compare", seconds * 1.0e3, "ms" );
+  if ( ! equal ) std::cerr << name << ": copies do not compare equal" << std::endl;
+
+  seconds = measure( settings, [ &copies ]() { copies.pop_back(); } );
+  report( name, "destroy", seconds * 1.0e3, "ms" );
+
+  // Lookups of every key in a random order
+  if ( tree.getType() == CON::Type::Object && name == "wide" )
+  {
+    std::vector< std::string > keys;
+    for ( size_t i = 0; i + 1 < tree.getSize(); i += 4 )
+    {
+      keys.push_back( "key" + std::to_string( i ) );
+    }
+    std::shuffle( keys.begin(), keys.end(), std::mt19937( 7 ) );
+
+    double sum = 0.0;
+    seconds = measure( settings, [ &tree, &keys, &sum ]()
+    {
+      for ( std::vector< std::string >::const_iterator it = keys.begin(); it != keys.end(); ++it )
+      {
+        sum += tree.get( *it ).asDouble();
+      }
+    } );
+    report( name, "get+asDouble", seconds * 1.0e9 / keys.size(), "ns/op" );
+    if ( sum == 0.0 ) std::cerr << name << ": unexpected lookup result" << std::endl;
+  }
+
+  // Lookups and memory for each size of object
+  if ( tree.getType() == CON::Type::Object && name == "fanout" )
+  {
+    const CON::Object& groups = tree;
+    for ( size_t fanout = 1; groups.has( "fanout" + std::to_string( fanout ) ); fanout *= ( fanout < 16 ) ? 2 : 4 )
+    {
+      const std::string group = "fanout" + std::to_string( fanout );
+      const CON::Object& objects = groups[group];
+
+      std::vector< std::string > keys;
+      for ( size_t i = 0; i < fanout; ++i )
+      {
+        keys.push_back( "key" + std::to_string( i ) );
+      }
+      std::shuffle( keys.begin(), keys.end(), std::mt19937( 7 ) );
+
+      double sum = 0.0;
+      seconds = measure( settings, [ &objects, &keys, &sum ]()
+      {
+        for ( size_t i = 0; i < objects.getSize(); ++i )
+        {
+          const CON::Object& object = objects[i];
+          for ( std::vector< std::string >::const_iterator it = keys.begin(); it != keys.end(); ++it )
+          {
+            sum += object.get( *it ).asDouble();
+          }
+        }
+      } );
+      report( name, group + "/get+asDouble", seconds * 1.0e9 / ( objects.getSize() * fanout ), "ns/op" );
+      report( name, group + "/bytes", static_cast< double >( objects.memoryUsage().total() ) / objects.getSize(), "B/object" );
+      if ( sum == 0.0 ) std::cerr << name << ": unexpected lookup result" << std::endl;
+    }
+  }
+
+}
+
+
+int main( int argN, char** argV )
+{
+  Settings settings;
+  std::vector< std::string > selected;
+
+  for ( int i = 1; i < argN; ++i )
+  {
+    std::string argument( argV[i] );
+    if ( argument == "--size" && i + 1 < argN ) settings.size = std::strtoul( argV[++i], nullptr, 10 ) << 20;
+    else if ( argument == "--repeat" && i + 1 < argN ) settings.repeat = std::max( 1ul, std::strtoul( argV[++i], nullptr, 10 ) );
+    else if ( argument == "--dir" && i + 1 < argN ) settings.directory = argV[++i];
+    else if ( argument.size() > 0 && argument[0] != '-' ) selected.push_back( argument );
+    else
+    {
+      std::cerr << "Usage: ConBench [--size MB] [--repeat N] [--dir DIRECTORY] [corpus...]\n  Corpora :";
+      for ( const Corpus& corpus : corpora ) std::cerr << ' ' << corpus.name;
+      std::cerr << std::endl;
+      return 2;
+    }
+  }
+
+  mkdir( settings.directory.c_str(), 0755 );
+
+  int failures = 0;
+  for ( const Corpus& corpus : corpora )
+  {
+    if ( ! selected.empty() && std::find( selected.begin(), selected.end(), corpus.name ) == selected.end() ) continue;
+
+    std::cerr << "Measuring " << corpus.name << ": " << corpus.description << std::endl;
+
+    // A fresh process for each corpus keeps the peak sizes separate
+    pid_t child = fork();
+    if ( child == 0 )
+    {
+      try
+      {
+        runCorpus( settings, corpus );
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cerr << corpus.name << ": " << ex.what() << std::endl;
+        for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+        {
+          std::cerr << (*it) << std::endl;
+        }
+        std::_Exit( 1 );
+      }
+      std::cout.flush();
+      std::_Exit( 0 );
+    }
+
+    int status = 1;
+    waitpid( child, &status, 0 );
+    if ( ! WIFEXITED( status ) || WEXITSTATUS( status ) != 0 ) ++failures;
+  }
+
+  return ( failures == 0 ) ? 0 : 1;
+}
+
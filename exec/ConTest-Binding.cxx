@@ -0,0 +1,161 @@
+
+#include "CON.h"
+#include "CONBinding.h"
+
+#include <iostream>
+#include <sstream>
+
+
+struct SubFile
+{
+  std::string id;
+};
+
+struct Basic
+{
+  std::string identifier;
+  double another_id = 0.0;
+  bool some_stuff = false;
+  std::map< std::string, int > empty_object;
+  SubFile sub_file;
+  std::optional< std::string > missing;
+};
+
+struct Limits
+{
+  unsigned int connections = 0;
+  std::optional< double > timeout;
+};
+
+struct Server
+{
+  std::string host;
+  int port = 0;
+  std::vector< int > ids;
+  std::map< std::string, Limits > limits;
+  std::optional< Limits > fallback;
+  CON::Object extra;
+};
+
+
+template <>
+struct CON::Binding< SubFile >
+{
+  static auto members() { return std::make_tuple( CON::member( "ID", &SubFile::id ) ); }
+};
+
+template <>
+struct CON::Binding< Basic >
+{
+  static auto members()
+  {
+    return std::make_tuple( CON::member( "identifier", &Basic::identifier ),
+                            CON::member( "another_id", &Basic::another_id ),
+                            CON::member( "some_stuff", &Basic::some_stuff ),
+                            CON::member( "empty_object", &Basic::empty_object ),
+                            CON::member( "sub_file", &Basic::sub_file ),
+                            CON::member( "missing", &Basic::missing ) );
+  }
+};
+
+template <>
+struct CON::Binding< Limits >
+{
+  static auto members() { return std::make_tuple( CON::member( "connections", &Limits::connections ), CON::member( "timeout", &Limits::timeout ) ); }
+};
+
+template <>
+struct CON::Binding< Server >
+{
+  static auto members()
+  {
+    return std::make_tuple( CON::member( "host", &Server::host ),
+                            CON::member( "port", &Server::port ),
+                            CON::member( "ids", &Server::ids ),
+                            CON::member( "limits", &Server::limits ),
+                            CON::member( "fallback", &Server::fallback ),
+                            CON::member( "extra", &Server::extra ) );
+  }
+};
+
+
+bool operator==( const Limits& a, const Limits& b )
+{
+  return a.connections == b.connections && a.timeout == b.timeout;
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Binding documents directly to structs." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    Basic basic = CON::bindFromFile< Basic >( "./dat/test-basic.con" );
+    std::cout << basic.identifier << ", " << basic.another_id << ", " << basic.some_stuff << ", " << basic.sub_file.id << std::endl;
+    if ( basic.identifier != "Some value" || basic.another_id != 47.2 || ! basic.some_stuff || basic.sub_file.id != "in the sub file!" || basic.missing ) identical = false;
+
+    std::string text( "{ host : \"example.org\", port : 8080, ids : [ 1, 2, 3 ], unknown : { deep : [ <./missing.con> ] }, "
+                      "limits : { a : { connections : 10, timeout : 2.5 }, b : { connections : 4, timeout : null } }, "
+                      "fallback : { connections : 1 }, extra : { anything : [ true, \"goes\" ] } }" );
+    std::stringstream input( text );
+    Server server = CON::bindFromStream< Server >( input );
+
+    if ( server.host != "example.org" || server.port != 8080 || server.ids.size() != 3 || server.ids[2] != 3 ) identical = false;
+    if ( server.limits.size() != 2 || server.limits["a"].connections != 10 || *server.limits["a"].timeout != 2.5 || server.limits["b"].timeout ) identical = false;
+    if ( ! server.fallback || server.fallback->connections != 1 || server.extra["anything"][1].asString() != "goes" ) identical = false;
+
+    std::cout << "Writing back through the binding" << std::endl;
+    std::string output;
+    CON::bindToString( server, output );
+    std::cout << output;
+
+    std::stringstream reread( output );
+    Server copy = CON::bindFromStream< Server >( reread );
+    if ( copy.host != server.host || copy.port != server.port || copy.ids != server.ids || copy.limits != server.limits || ! ( *copy.fallback == *server.fallback ) || copy.extra != server.extra ) identical = false;
+
+    std::cout << "Checking type errors" << std::endl;
+    const char* invalid[] = { "{ port : \"80\" }", "{ ids : [ 1, 2.5 ] }", "{ limits : { a : { connections : -1 } } }", "{ host : [ ] }", "{ port : 1" };
+    for ( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); ++i )
+    {
+      std::stringstream bad( invalid[i] );
+      Server result;
+      CON::ErrorList errors;
+      if ( CON::tryBindFromStream( bad, result, errors ) || errors.size() != 1 )
+      {
+        identical = false;
+      }
+      for ( CON::ErrorList::iterator it = errors.begin(); it != errors.end(); ++it )
+      {
+        std::cout << (*it) << std::endl;
+      }
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
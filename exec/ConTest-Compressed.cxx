@@ -0,0 +1,159 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#ifdef CON_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CON_ZSTD
+#include <zstd.h>
+#endif
+
+
+const char* gzipFileName = "./.temp/compressed_root.con.gz";
+const char* includeFileName = "./.temp/compressed_sub.con.gz";
+const char* truncatedFileName = "./.temp/compressed_truncated.con.gz";
+const char* zstdFileName = "./.temp/compressed_root.con.zst";
+
+
+void writeFile( const char* name, const std::string& data )
+{
+  std::ofstream file( name, std::ios_base::out | std::ios_base::binary );
+  file << data;
+}
+
+
+#ifdef CON_ZLIB
+// Each part becomes a separate gzip member, as when .gz files are concatenated
+void writeGzip( const char* name, const std::vector< std::string >& parts )
+{
+  for ( size_t i = 0; i < parts.size(); ++i )
+  {
+    gzFile file = gzopen( name, ( i == 0 ) ? "wb" : "ab" );
+    gzwrite( file, parts[i].data(), static_cast< unsigned >( parts[i].size() ) );
+    gzclose( file );
+  }
+}
+#endif
+
+
+int main( int, char** )
+{
+
+  std::cout << "Reading compressed files." << std::endl;
+
+  bool identical = true;
+
+  // Larger than the decompression buffers
+  std::string text( "{\n  sub : <" );
+  text += includeFileName;
+  text += ">,\n  values : [ ";
+  for ( size_t i = 0; i < 50000; ++i )
+  {
+    text += std::to_string( i ) + ", ";
+  }
+  text += "-1 ]\n}\n";
+  std::string sub( "{ name : \"included\", enabled : true }\n" );
+
+  try
+  {
+#ifdef CON_ZLIB
+    writeGzip( includeFileName, { sub } );
+#else
+    // Files are recognised by their contents, not their names
+    writeFile( includeFileName, sub );
+#endif
+    CON::Object expected = CON::buildFromString( text );
+
+#ifdef CON_ZLIB
+    size_t half = text.size() / 2;
+    writeGzip( gzipFileName, { text.substr( 0, half ), text.substr( half ) } );
+
+    CON::InputFile input( gzipFileName );
+    if ( input.compression() != CON::InputFile::Gzip ) identical = false;
+
+    CON::Object object = CON::buildFromFile( gzipFileName );
+    std::cout << "values : " << object["values"].getSize() << ", sub/name : " << object["sub"]["name"].asString() << std::endl;
+    if ( ! ( object == expected ) ) identical = false;
+
+    CON::Reader reader( input );
+    CON::Object read;
+    if ( reader.next() != CON::Reader::BeginObject || ! CON::readValue( reader, read ) || ! ( read == expected ) ) identical = false;
+
+    std::cout << "Reporting truncated data" << std::endl;
+    std::ifstream whole( gzipFileName, std::ios_base::in | std::ios_base::binary );
+    std::string compressed( ( std::istreambuf_iterator< char >( whole ) ), std::istreambuf_iterator< char >() );
+    writeFile( truncatedFileName, compressed.substr( 0, compressed.size() / 3 ) );
+#else
+    std::cout << "Reporting gzip as unsupported" << std::endl;
+    writeFile( truncatedFileName, std::string( "\x1f\x8b\x08\x00", 4 ) );
+#endif
+
+    CON::ParseResult result = CON::tryBuildFromFile( truncatedFileName );
+    bool reported = false;
+    for ( CON::ErrorList::const_iterator it = result.errors.begin(); it != result.errors.end(); ++it )
+    {
+      std::cout << it->message() << std::endl;
+      if ( it->code == CON::ParseError::DecompressionFailed ) reported = true;
+    }
+    if ( ! reported ) identical = false;
+
+    std::cout << "Reading zstd data" << std::endl;
+#ifdef CON_ZSTD
+    std::string frame( ZSTD_compressBound( text.size() ), '\0' );
+    frame.resize( ZSTD_compress( &frame[0], frame.size(), text.data(), text.size(), 3 ) );
+    writeFile( zstdFileName, frame );
+
+    CON::Object zstd = CON::buildFromFile( zstdFileName );
+    if ( ! ( zstd == expected ) ) identical = false;
+#else
+    writeFile( zstdFileName, std::string( "\x28\xb5\x2f\xfd\x00", 5 ) );
+    try
+    {
+      CON::buildFromFile( zstdFileName );
+      identical = false;
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << ex.what() << std::endl;
+      for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+      {
+        std::cout << (*it) << std::endl;
+        if ( it->code != CON::ParseError::DecompressionFailed ) identical = false;
+      }
+    }
+#endif
+
+    std::cout << "Reading plain files directly" << std::endl;
+    CON::InputFile plain( "./dat/test-basic.con" );
+    if ( plain.compression() != CON::InputFile::None || ! CON::buildFromStream( plain ).has( "sub_file" ) ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,80 @@
+
+#include "CON.h"
+
+#include <iostream>
+
+
+void printPatch( CON::Patch& patch )
+{
+  const char* names[] = { "Add", "Remove", "Replace", "Insert", "Erase" };
+
+  for ( CON::Patch::iterator it = patch.begin(); it != patch.end(); ++it )
+  {
+    std::cout << names[it->kind] << " : ";
+    for ( CON::Path::iterator path_it = it->path.begin(); path_it != it->path.end(); ++path_it )
+    {
+      std::cout << "/" << (*path_it);
+    }
+    std::cout << std::endl;
+  }
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Building two versions of the basic test file." << std::endl;
+
+  try
+  {
+    CON::Object original = CON::buildFromFile( "./dat/test-basic.con" );
+    CON::Object modified( original );
+
+    modified.get( "sub_object" ).get( "yo" ).setValue( "a different string" );
+    modified.removeChild( "some_stuff" );
+    modified.addChild( "new_id", CON::Object( CON::Type::Null ) );
+
+    CON::Object array( CON::Type::Array );
+    array.push( 1 );
+    array.push( 2 );
+    array.push( 3 );
+    array.push( 4 );
+    original.addChild( "numbers", array );
+
+    array.erase( 1 );
+    array.insert( 2, CON::Object( CON::Type::Null ) );
+    array.push( 5 );
+    modified.addChild( "numbers", array );
+
+    CON::Patch patch = CON::diff( original, modified );
+    std::cout << "Found " << patch.size() << " operations" << std::endl;
+    printPatch( patch );
+
+    CON::apply( original, patch );
+    writeToStream( original, std::cout );
+
+    std::cout << std::endl;
+    if ( original == modified && CON::diff( original, modified ).size() == 0 )
+    {
+      std::cout << "Patched copy is identical!" << std::endl;
+    }
+    else
+    {
+      std::cout << "Patched copy is NOT identical!" << std::endl;
+      return 1;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
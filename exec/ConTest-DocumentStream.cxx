@@ -0,0 +1,122 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Reading a stream of concatenated documents." << std::endl;
+
+  bool identical = true;
+
+  const char* documents[] =
+  {
+    "{ event : \"start\", ids : [ 1, 2, 3 ], host : { name : \"a\", port : 80 } }",
+    "{ event : \"stop\", ids : [ 4 ], host : { name : \"b\", port : 81 } }",
+    "{}",
+    "{ event : \"restart\", ids : [ 5, 6 ], host : null, extra : { deep : [ { x : 1 } ] } }",
+    "{ event : \"start\", ids : [ 7, 8, 9 ], host : { name : \"c\", port : 82 } }"
+  };
+
+  std::string text( "# Event log\n" );
+  for ( size_t i = 0; i < sizeof( documents ) / sizeof( documents[0] ); ++i )
+  {
+    text += documents[i];
+    text += ( i % 2 ) ? " " : "\n";
+  }
+
+  try
+  {
+    std::stringstream input( text );
+    CON::DocumentStream stream( input );
+    CON::Object document;
+
+    size_t number = 0;
+    const CON::Object* port = nullptr;
+    while ( stream.next( document ) )
+    {
+      std::string expected_text( documents[number] );
+      CON::Object expected = CON::buildFromString( expected_text );
+
+      std::string written;
+      CON::writeToString( document, written, CON::Format::Compact );
+      std::cout << written;
+
+      if ( ! ( document == expected ) ) identical = false;
+
+      // Documents of the same shape are parsed into the same nodes
+      if ( number == 1 && &document["host"]["port"] != port ) identical = false;
+      port = document.find( "host" ) ? document["host"].find( "port" ) : nullptr;
+
+      ++number;
+    }
+
+    if ( number != 5 || stream.count() != 5 ) identical = false;
+    if ( stream.next( document ) ) identical = false;
+
+    std::cout << "Carrying on after a document with errors" << std::endl;
+    std::stringstream broken( "{ a : 1 }\n{ b : , c : 2 }\n\n{ d : [ 1,\n  2 }\n{ e : 3 }" );
+    CON::DocumentStream recovering( broken );
+    size_t good = 0;
+    size_t bad = 0;
+    std::vector< size_t > positions;
+    while ( true )
+    {
+      try
+      {
+        if ( ! recovering.next( document ) ) break;
+        ++good;
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cout << ex.what() << std::endl;
+        positions.push_back( ex.begin()->line() );
+        positions.push_back( ex.begin()->column() );
+        ++bad;
+      }
+    }
+    if ( good != 2 || bad != 2 || document.getOr( "e", 0 ) != 3 || document.has( "a" ) ) identical = false;
+
+    // Lines are counted through the whole input, though each document only keeps its own newlines
+    if ( positions != std::vector< size_t >{ 2, 7, 5, 5 } ) identical = false;
+
+    std::cout << "Reading JSON values" << std::endl;
+    CON::ParseOptions json;
+    json.json = true;
+    std::stringstream values( "{\"a\":[1,2]}\n[true,null]\n\"text\"\n42\n" );
+    CON::DocumentStream lines( values, json );
+    CON::Type types[] = { CON::Type::Object, CON::Type::Array, CON::Type::String, CON::Type::Numeric };
+    for ( size_t i = 0; i < 4; ++i )
+    {
+      if ( ! lines.next( document ) || document.getType() != types[i] ) identical = false;
+    }
+    if ( document.asInt() != 42 || lines.next( document ) ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
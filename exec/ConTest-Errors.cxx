@@ -0,0 +1,66 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Checking structured parse errors." << std::endl;
+
+  bool identical = true;
+
+  CON::ParseResult result = CON::tryBuildFromFile( "./dat/test-fail1.con" );
+  for ( CON::ErrorList::iterator it = result.errors.begin(); it != result.errors.end(); ++it )
+  {
+    std::cout << it->code << " at " << it->offset << " : " << (*it) << std::endl;
+  }
+
+  if ( result.errors.size() != 3 ) return 1;
+
+  const CON::ParseError& colon = result.errors[0];
+  if ( colon.code != CON::ParseError::ExpectedColon || colon.line() != 2 || colon.column() != 15 || colon.identifier != "identifier" || colon.file != "./dat/test-fail1.con" ) identical = false;
+
+  const CON::ParseError& expression = result.errors[2];
+  if ( expression.code != CON::ParseError::InvalidExpression || expression.line() != 4 || expression.column() != 16 || expression.detail != "tru" ) identical = false;
+
+  std::cout << "Checking the error limit" << std::endl;
+  std::string bad( "{ a : x, b : y, c : z, d : w }" );
+  CON::ParseOptions options;
+  options.errorLimit = 2;
+  std::stringstream input( bad );
+  CON::ParseResult limited = CON::tryBuildFromStream( input, options );
+  if ( limited.errors.size() != 2 || limited.errors[1].identifier != "b" || limited.errors[1].column() != 14 ) identical = false;
+
+  std::cout << "Checking exceptions" << std::endl;
+  try
+  {
+    CON::buildFromString( bad );
+    identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cout << ex.what() << std::endl;
+    if ( ex.number() != 4 || std::string( ex.what() ) != "Found 4 parse errors" ) identical = false;
+
+    std::string first = *ex.begin();
+    std::cout << first << std::endl;
+    if ( first != "Error on line 1, column 7: Invalid expression. Must be boolean, numeric or string: x." ) identical = false;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,103 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+// Documents and the compact JSON expected back from them
+const char* documents[][2] =
+{
+  { "{\"b\": 1, \"a\": \"two\"}", "{\"a\":\"two\",\"b\":1}" },
+  { "{ \"key with spaces\" : [ 1, 2.5, -3e-2, 1E+10, true, false, null ] }", "{\"key with spaces\":[1,2.5,-3e-2,1E+10,true,false,null]}" },
+  { "{\"escapes\": \"quote \\\" backslash \\\\ slash \\/ tab \\t newline \\n\"}", "{\"escapes\":\"quote \\\" backslash \\\\ slash / tab \\t newline \\n\"}" },
+  { "{\"unicode\": \"caf\\u00e9 \\u20ac \\ud83d\\ude00 \\u0001\"}", "{\"unicode\":\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \\u0001\"}" },
+  { "[ {}, [], [[]], {\"a\":{\"b\":{}}} ]", "[{},[],[[]],{\"a\":{\"b\":{}}}]" },
+  { "\"just a string\"", "\"just a string\"" },
+  { "  42  ", "42" },
+  { "{\"empty\":\"\",\"zero\":0,\"nested\":[{\"x\":[1,{\"y\":null}]}]}", "{\"empty\":\"\",\"nested\":[{\"x\":[1,{\"y\":null}]}],\"zero\":0}" }
+};
+
+
+int main( int, char** )
+{
+
+  std::cout << "Round tripping JSON documents." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    for ( size_t i = 0; i < sizeof( documents ) / sizeof( documents[0] ); ++i )
+    {
+      std::stringstream input( documents[i][0] );
+      CON::Object object = CON::buildFromJSON( input );
+
+      std::stringstream output;
+      CON::writeJSON( object, output );
+      std::cout << output.str();
+
+      if ( output.str() != std::string( documents[i][1] ) + "\n" )
+      {
+        std::cout << "  Expected : " << documents[i][1] << std::endl;
+        identical = false;
+      }
+
+      // Pretty output must parse back to the same tree
+      std::stringstream pretty;
+      CON::writeJSON( object, pretty, CON::Format::Pretty );
+      CON::Object reparsed = CON::buildFromJSON( pretty );
+      if ( reparsed != object ) identical = false;
+    }
+
+    std::cout << "Converting CON to JSON and back." << std::endl;
+    CON::Object original = CON::buildFromFile( "./dat/test-basic.con" );
+    std::stringstream json;
+    CON::writeJSON( original, json, CON::Format::Pretty );
+    std::cout << json.str();
+
+    CON::Object converted = CON::buildFromJSON( json );
+    if ( converted != original ) identical = false;
+
+    std::cout << "Checking invalid documents" << std::endl;
+    const char* invalid[] = { "{\"a\" 1}", "{\"a\": \"\\u12\"}", "[1, 2", "{\"a\": \"unterminated}" };
+    for ( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); ++i )
+    {
+      try
+      {
+        std::stringstream input( invalid[i] );
+        CON::buildFromJSON( input );
+        std::cout << "Accepted : " << invalid[i] << std::endl;
+        identical = false;
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cout << "Rejected : " << invalid[i] << std::endl;
+      }
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
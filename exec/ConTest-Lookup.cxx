@@ -0,0 +1,88 @@
+
+#include "CON.h"
+
+#include <iostream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Looking up values without exceptions." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    CON::ParseResult result = CON::tryBuildFromFile( "./dat/test-basic.con" );
+    if ( ! result.success() ) identical = false;
+
+    const CON::Object& object = result.object;
+
+    // Present and missing keys
+    if ( object.find( "another_id" ) == nullptr ) identical = false;
+    if ( object.find( "missing" ) != nullptr ) identical = false;
+    if ( object.find( 0 ) != nullptr ) identical = false;
+    if ( object.find( "identifier" )->find( "child" ) != nullptr ) identical = false;
+
+    double number = 0.0;
+    if ( ! object.find( "another_id" )->tryAsDouble( number ) || number != 47.2 ) identical = false;
+
+    // Not an integer and not a boolean
+    int integer = 12;
+    bool boolean = false;
+    if ( object.find( "another_id" )->tryAsInt( integer ) || integer != 12 ) identical = false;
+    if ( object.find( "another_id" )->tryAsBool( boolean ) ) identical = false;
+    if ( ! object.find( "some_stuff" )->tryAsBool( boolean ) || ! boolean ) identical = false;
+
+    std::cout << object.getOr( "identifier", "default" ) << std::endl;
+    std::cout << object.getOr( "missing", "default" ) << std::endl;
+    std::cout << object.getOr( "another_id", 1.5 ) << std::endl;
+    std::cout << object.getOr( "some_stuff", 3 ) << std::endl;
+
+    if ( object.getOr( "identifier", "default" ) != "Some value" ) identical = false;
+    if ( object.getOr( "missing", "default" ) != "default" ) identical = false;
+    if ( object.getOr( "another_id", 1.5 ) != 47.2 ) identical = false;
+    if ( object.getOr( "some_stuff", 3 ) != 3 ) identical = false;
+    if ( object.getOr( "some_stuff", false ) != true ) identical = false;
+
+    // Integers out of range are rejected
+    CON::Object large;
+    large.setValue( 10000000000l );
+    long long_value = 0;
+    if ( large.tryAsInt( integer ) || ! large.tryAsLong( long_value ) || long_value != 10000000000l ) identical = false;
+
+    std::cout << "Collecting errors without exceptions" << std::endl;
+    CON::ParseResult failed = CON::tryBuildFromFile( "./dat/test-fail1.con" );
+    for ( CON::ErrorList::iterator it = failed.errors.begin(); it != failed.errors.end(); ++it )
+    {
+      std::cout << (*it) << std::endl;
+    }
+    if ( failed.success() || failed.errors.size() != 3 ) identical = false;
+
+    CON::ParseResult missing = CON::tryBuildFromFile( "./dat/does-not-exist.con" );
+    if ( missing || missing.errors.size() != 1 ) identical = false;
+
+    std::stringstream truncated( "{ a : 1, b : [ 1, 2" );
+    CON::ParseResult partial = CON::tryBuildFromStream( truncated );
+    if ( partial.success() || partial.object.getOr( "a", 0 ) != 1 ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,72 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Accounting for the memory held by a tree." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    CON::Object object = CON::buildFromFile( "./dat/test-basic.con" );
+    CON::MemoryUsage usage = object.memoryUsage( 3 );
+    std::cout << usage;
+
+    // Every byte belongs to exactly one node type
+    size_t by_type = 0;
+    size_t nodes = 0;
+    for ( size_t i = 0; i < 6; ++i )
+    {
+      by_type += usage.bytes[i];
+      nodes += usage.count[i];
+    }
+    if ( by_type != usage.total() || nodes != 10 || usage.count[ static_cast<size_t>( CON::Type::Object ) ] != 4 ) identical = false;
+    if ( usage.objects != nodes * sizeof( CON::Object ) ) identical = false;
+
+    if ( usage.heaviest.size() != 3 || usage.heaviest[0].path != "sub_object" || usage.heaviest[1].path != "sub_file" ) identical = false;
+    if ( usage.heaviest[0].bytes < usage.heaviest[1].bytes || usage.heaviest[0].bytes >= usage.total() ) identical = false;
+
+    std::cout << "Long values and array items add to the total" << std::endl;
+    CON::Object grown( object );
+    grown["sub_file"].addChild( "long", CON::Object() );
+    grown["sub_file"]["long"].setValue( std::string( 1000, 'x' ) );
+    grown.addChild( "list", CON::Object( CON::Type::Array ) );
+    for ( int i = 0; i < 10; ++i ) grown["list"].push( i );
+
+    CON::MemoryUsage larger = grown.memoryUsage( 1 );
+    std::cout << larger;
+    if ( larger.strings <= 1000 || larger.arrays == 0 || larger.count[ static_cast<size_t>( CON::Type::Array ) ] != 1 ) identical = false;
+    if ( larger.heaviest.size() != 1 || larger.heaviest[0].path != "sub_file" ) identical = false;
+    if ( CON::Object().memoryUsage().total() != sizeof( CON::Object ) ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,120 @@
+
+#include "CON.h"
+
+#include <iostream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Stacking override layers." << std::endl;
+
+  bool identical = true;
+
+  std::string base_text( "{ name : \"service\", database : { host : \"db.internal\", port : 5432, pool : { size : 10, timeout : 30 } },"
+                         " features : [ \"a\", \"b\" ], logging : { level : \"info\" } }" );
+  std::string environment_text( "{ database : { host : \"db.staging\", pool : { size : 20 } }, features : [ \"c\" ], debug : true }" );
+  std::string host_text( "{ database : { pool : { timeout : 5 } }, logging : \"off\" }" );
+
+  // What deep copying the base and merging each override over the top gives
+  std::string merged_text( "{ name : \"service\", database : { host : \"db.staging\", port : 5432, pool : { size : 20, timeout : 5 } },"
+                           " features : [ \"c\" ], logging : \"off\", debug : true }" );
+
+  try
+  {
+    CON::Object base = CON::buildFromString( base_text );
+    CON::Object environment = CON::buildFromString( environment_text );
+    CON::Object host = CON::buildFromString( host_text );
+    CON::Object expected = CON::buildFromString( merged_text );
+
+    CON::Overlay overlay{ &base, &environment };
+    overlay.push( host );
+    if ( overlay.layers() != 3 ) identical = false;
+
+    // Values come from the highest layer that has them
+    if ( overlay.get( { "database", "pool", "size" } ).asInt() != 20 ) identical = false;
+    if ( overlay.get( { "database", "pool", "timeout" } ).asInt() != 5 ) identical = false;
+    if ( overlay.get( { "database", "port" } ).asInt() != 5432 ) identical = false;
+    if ( overlay.get( { "name" } ).asString() != "service" ) identical = false;
+
+    // Arrays and values replace the layers below rather than merging with them
+    if ( overlay.getSize( { "features" } ) != 1 || overlay.get( { "features", "0" } ).asString() != "c" ) identical = false;
+    if ( overlay.has( { "features", "1" } ) || overlay.has( { "logging", "level" } ) ) identical = false;
+    if ( overlay.has( { "missing" } ) || ! overlay.has( { "debug" } ) ) identical = false;
+
+    // Unmerged values are the layers' own nodes
+    if ( &overlay.get( { "database", "port" } ) != &base["database"]["port"] ) identical = false;
+
+    if ( overlay.getSize( {} ) != 5 || overlay.getSize( { "database" } ) != 3 || overlay.getSize( { "database", "pool" } ) != 2 ) identical = false;
+
+    // Merged objects are made once
+    const CON::Object& pool = overlay.get( { "database", "pool" } );
+    if ( &pool != &overlay.get( { "database", "pool" } ) || ! ( pool == expected["database"]["pool"] ) ) identical = false;
+
+    // Values from a single layer are shared with it rather than copied
+    const CON::Object& database = overlay.get( { "database" } );
+    const CON::Object& constant_base = base;
+    if ( &database.get( "port" ) != &constant_base["database"]["port"] || &database.get( "pool" ) != &pool ) identical = false;
+
+    std::cout << "Flattening" << std::endl;
+    CON::Object flat = overlay.flatten();
+    std::string written;
+    CON::writeToString( flat, written, CON::Format::Compact );
+    std::cout << written;
+    if ( ! ( flat == expected ) ) identical = false;
+
+    std::cout << "Keeping merged objects through a push" << std::endl;
+    std::string late_text( "{ database : { pool : { size : 1 } } }" );
+    CON::Object late = CON::buildFromString( late_text );
+    overlay.push( late );
+    if ( pool.get( "size" ).asInt() != 20 || overlay.get( { "database", "pool", "size" } ).asInt() != 1 ) identical = false;
+    if ( &overlay.get( { "database", "pool" } ) == &pool ) identical = false;
+
+    std::cout << "A value between objects ends the merge" << std::endl;
+    std::string hiding_text( "{ database : \"none\" }" );
+    std::string above_text( "{ database : { user : \"admin\" } }" );
+    CON::Object hiding = CON::buildFromString( hiding_text );
+    CON::Object above = CON::buildFromString( above_text );
+    CON::Overlay layered{ &base, &hiding, &above };
+    if ( layered.getSize( { "database" } ) != 1 || layered.has( { "database", "port" } ) ) identical = false;
+    if ( ! ( layered.flatten()["database"] == above["database"] ) ) identical = false;
+
+    std::cout << "Reporting missing paths" << std::endl;
+    try
+    {
+      overlay.get( { "database", "user" } );
+      identical = false;
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << ex.what() << std::endl;
+    }
+
+    CON::Overlay empty;
+    if ( empty.has( {} ) || ! empty.flatten().isNull() ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
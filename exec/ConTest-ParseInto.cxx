@@ -0,0 +1,132 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <new>
+
+
+// Count the heap allocations made while reloading
+static size_t allocations = 0;
+
+void* operator new( size_t size )
+{
+  ++allocations;
+  void* pointer = std::malloc( size > 0 ? size : 1 );
+  if ( pointer == nullptr ) throw std::bad_alloc();
+  return pointer;
+}
+
+void operator delete( void* pointer ) noexcept
+{
+  std::free( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept
+{
+  std::free( pointer );
+}
+
+
+std::string makeConfig( size_t servers, const std::string& version )
+{
+  std::string text( "{\n  version : \"" + version + "\",\n  servers :\n  {\n" );
+  for ( size_t i = 0; i < servers; ++i )
+  {
+    text += "    server" + std::to_string( i ) + " : { host : \"host" + std::to_string( i ) + ".internal.example.com\", port : "
+          + std::to_string( 8000 + i ) + ", enabled : true, weights : [ 0.5, 0.25, 0.25 ] }" + ( ( i + 1 < servers ) ? ",\n" : "\n" );
+  }
+  text += "  },\n  owners : [ \"configuration management team\", \"platform operations team\" ]\n}\n";
+  return text;
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Reloading a tree in place." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    std::string text = makeConfig( 200, "first release of the configuration" );
+
+    CON::Object config;
+    std::stringstream first( text );
+    CON::parseInto( config, first );
+
+    CON::Object fresh = CON::buildFromString( text );
+    if ( ! ( config == fresh ) ) identical = false;
+
+    const CON::Object* host = &config["servers"]["server7"]["host"];
+
+    // The same document again
+    std::stringstream again( text );
+    allocations = 0;
+    CON::parseInto( config, again );
+    size_t reloaded = allocations;
+
+    std::stringstream built( text );
+    allocations = 0;
+    CON::Object rebuilt = CON::buildFromStream( built );
+    size_t building = allocations;
+
+    std::cout << "Allocations building : " << building << ", reloading : " << reloaded << std::endl;
+    if ( reloaded * 10 > building ) identical = false;
+    if ( &config["servers"]["server7"]["host"] != host || ! ( config == fresh ) ) identical = false;
+
+    std::cout << "Reloading a different shape" << std::endl;
+    std::string changed = makeConfig( 150, "second" );
+    changed.replace( changed.find( "owners : [" ), 10, "owners : { team : [" );
+    changed.replace( changed.rfind( "]" ), 1, "] }" );
+    changed.replace( changed.find( "port : 8003" ), 11, "port : [ 1, 2 ]" );
+
+    std::stringstream second( changed );
+    CON::parseInto( config, second );
+    CON::Object expected = CON::buildFromString( changed );
+
+    std::string written;
+    CON::writeToString( config["owners"], written, CON::Format::Compact );
+    std::cout << written << std::endl;
+    if ( ! ( config == expected ) || config["servers"].getSize() != 150 ) identical = false;
+
+    std::cout << "Clearing a failed include" << std::endl;
+    std::stringstream include( "{ version : <./missing.con> }" );
+    try
+    {
+      CON::parseInto( config, include );
+      identical = false;
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << ex.what() << std::endl;
+    }
+    if ( ! config["version"].isNull() || config.has( "servers" ) ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,145 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Building only the projected paths." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    std::string text( "{ a : { b : \"kept\", c : [ 1, 2 ] }, skipped : { deep : [ <./never.con>, \"} ] {\" ] }, "
+                      "list : [ { d : 1, e : 2 }, 3, { d : <./dat/test-subfile.con> }, 4 ], last : <./never.con> }" );
+
+    // Count the includes that are actually loaded
+    int loaded = 0;
+    CON::ParseOptions options;
+    options.include = [ &loaded ]( const std::string& file, const CON::Path& ) -> CON::Object
+    {
+      ++loaded;
+      return CON::buildFromFile( file );
+    };
+
+    std::stringstream input( text );
+    CON::Object projected = CON::buildFromStream( input, CON::Projection{ "a/b", "list/2/d" }, options );
+
+    std::string output;
+    CON::writeToString( projected, output );
+    std::cout << output;
+
+    CON::Object expected( CON::Type::Object );
+    expected.addChild( "a", CON::Object( CON::Type::Object ) );
+    expected["a"].addChild( "b", CON::Object() );
+    expected["a"]["b"].setValue( "kept" );
+    expected.addChild( "list", CON::Object( CON::Type::Array ) );
+    CON::Object placeholder;
+    expected["list"].push( placeholder );
+    expected["list"].push( placeholder );
+    CON::Object item( CON::Type::Object );
+    item.addChild( "d", CON::buildFromFile( "./dat/test-subfile.con" ) );
+    expected["list"].push( item );
+
+    if ( ! ( projected == expected ) || loaded != 1 ) identical = false;
+
+    std::cout << "Includes from a handler may be any value, and are told where they are mounted" << std::endl;
+    std::vector< std::string > mounts;
+    CON::ParseOptions values;
+    values.include = [ &mounts ]( const std::string& file, const CON::Path& path ) -> CON::Object
+    {
+      std::string mount;
+      for ( CON::Path::const_iterator it = path.begin(); it != path.end(); ++it ) mount += "/" + *it;
+      mounts.push_back( mount );
+
+      CON::Object value;
+      if ( file == "list" )
+      {
+        value.setType( CON::Type::Array );
+        value.push( std::string( "x" ) );
+        CON::Object inner( CON::Type::Object );
+        inner.addChild( "k", CON::Object() );
+        inner["k"].setValue( 5 );
+        value.push( inner );
+      }
+      else if ( file == "number" )
+      {
+        value.setValue( 7 );
+      }
+      return value;
+    };
+
+    std::stringstream mounted( "{ a : [ 1, { b : <list> } ], c : <number>, d : <nothing> }" );
+    CON::Object included = CON::buildFromStream( mounted, CON::Projection{ "a", "c", "d" }, values );
+    std::string written;
+    CON::writeToString( included, written );
+    std::cout << written;
+    if ( included["a"][1]["b"].getSize() != 2 || included["a"][1]["b"][1]["k"].asInt() != 5 || included["c"].asInt() != 7 || ! included["d"].isNull() ) identical = false;
+    if ( mounts != std::vector< std::string >{ "/a/1/b", "/c", "/d" } ) identical = false;
+
+    std::cout << "Projecting whole subtrees" << std::endl;
+    CON::Object full = CON::buildFromFile( "./dat/test-basic.con" );
+    std::ifstream file( "./dat/test-basic.con" );
+    CON::Object subtree = CON::buildFromStream( file, CON::Projection{ "/sub_object", "sub_file/ID", "another_id" } );
+    if ( subtree.getSize() != 3 || subtree["sub_object"] != full["sub_object"] || subtree["sub_file"] != full["sub_file"] || subtree["another_id"].asFloat() != full["another_id"].asFloat() ) identical = false;
+
+    std::ifstream again( "./dat/test-basic.con" );
+    CON::Object everything = CON::buildFromStream( again, CON::Projection{ "" } );
+    if ( everything != full ) identical = false;
+
+    std::cout << "Checking errors in skipped values" << std::endl;
+    const char* invalid[] = { "{ a : 1, b : { c : \"unterminated } }", "{ a : 1, b : [ 1, 2 }" };
+    for ( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); ++i )
+    {
+      try
+      {
+        std::stringstream bad( invalid[i] );
+        CON::buildFromStream( bad, CON::Projection{ "a" } );
+        identical = false;
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cout << "Rejected : " << *ex.begin() << std::endl;
+      }
+    }
+
+    std::cout << "Checking indices too large for an array" << std::endl;
+    try
+    {
+      CON::Projection{ "a/99999999999999999999999" };
+      identical = false;
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << "Rejected : " << ex.what() << std::endl;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
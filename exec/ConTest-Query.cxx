@@ -0,0 +1,120 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Searching a streamed document with query expressions." << std::endl;
+
+  bool identical = true;
+
+  std::string text( "{ servers : { backup : { port : 8080, host : \"b\" }, main : { port : 80, limits : { timeout : 5 } } }, "
+                    "items : [ 0, 1, 2, 3, 4, 5, 6, 7 ], timeout : 1 }" );
+
+  const char* expressions[] = { "servers/*/port", "items/2:5", "items/6", "**/timeout", "items/:2", "" };
+  const char* expected[] =
+  {
+    "servers/backup/port : 8080\nservers/main/port : 80\n",
+    "items/2 : 2\nitems/3 : 3\nitems/4 : 4\n",
+    "items/6 : 6\n",
+    "servers/main/limits/timeout : 5\ntimeout : 1\n",
+    "items/0 : 0\nitems/1 : 1\n",
+    " : object\n"
+  };
+
+  try
+  {
+    CON::Object whole = CON::buildFromString( text );
+
+    for ( size_t i = 0; i < sizeof( expressions ) / sizeof( expressions[0] ); ++i )
+    {
+      CON::Query query( { expressions[i] } );
+      std::ostringstream streamed;
+      std::ostringstream walked;
+
+      auto print = []( std::ostream& output )
+      {
+        return [ &output ]( size_t, const std::string& path, const CON::Object& value )
+        {
+          output << path << " : " << ( value.getType() == CON::Type::Object ? std::string( "object" ) : value.asString() ) << '\n';
+        };
+      };
+
+      std::stringstream input( text );
+      CON::queryStream( input, query, print( streamed ) );
+      query.run( whole, print( walked ) );
+
+      std::cout << "'" << expressions[i] << "'\n" << streamed.str();
+      if ( streamed.str() != expected[i] || walked.str() != expected[i] ) identical = false;
+    }
+
+    std::cout << "Searching for several expressions at once" << std::endl;
+    CON::Query several( { "servers/main", "servers/main/port", "items/7" } );
+    std::vector< size_t > counts( several.size(), 0 );
+    std::stringstream input( text );
+    CON::queryStream( input, several, [ &counts ]( size_t expression, const std::string&, const CON::Object& ) { ++counts[expression]; } );
+    if ( counts[0] != 1 || counts[1] != 1 || counts[2] != 1 ) identical = false;
+
+    std::cout << "Skipping includes that cannot match" << std::endl;
+    std::stringstream included( "{ unused : <./missing.con>, items : [ <./missing.con>, 1 ] }" );
+    size_t found = 0;
+    CON::queryStream( included, CON::Query( { "items/1" } ), [ &found ]( size_t, const std::string&, const CON::Object& value ) { found += value.asInt(); } );
+    if ( found != 1 ) identical = false;
+
+    std::cout << "Checking malformed slices and indices" << std::endl;
+    const char* malformed[] = { "items/a:3", "items/99999999999999999999999", "items/0:18446744073709551616" };
+    for ( size_t i = 0; i < sizeof( malformed ) / sizeof( malformed[0] ); ++i )
+    {
+      try
+      {
+        CON::Query bad( { malformed[i] } );
+        identical = false;
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cout << ex.what() << std::endl;
+      }
+    }
+
+    std::cout << "Counting lines through skipped values" << std::endl;
+    std::stringstream skipped( "{ unused : {\n  a : 1,\n  b : [\n    2 ] },\n  items : [ 1, } }" );
+    try
+    {
+      CON::queryStream( skipped, CON::Query( { "items/0" } ), []( size_t, const std::string&, const CON::Object& ) {} );
+      identical = false;
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << *ex.begin() << std::endl;
+      if ( ex.begin()->line() != 5 || ex.begin()->column() != 16 ) identical = false;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
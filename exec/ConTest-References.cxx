@@ -0,0 +1,135 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+// The same tree with every reference written out in full
+std::string expanded( const std::string& pool, const std::string& retry )
+{
+  return "{ pools : { default : " + pool + " }, orders : " + pool + ", users : " + pool
+       + ", retries : [ " + retry + ", " + retry + ", { delays : " + retry + " } ] }";
+}
+
+
+bool hasError( const CON::ParseResult& result, CON::ParseError::Code code )
+{
+  for ( CON::ErrorList::const_iterator it = result.errors.begin(); it != result.errors.end(); ++it )
+  {
+    std::cout << it->message() << std::endl;
+    if ( it->code == code ) return true;
+  }
+  return false;
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Sharing subtrees through anchors and references." << std::endl;
+
+  bool identical = true;
+
+  const std::string pool( "{ size : 10, timeout : 30, hosts : [ \"a.example.com\", \"b.example.com\" ] }" );
+  const std::string retry( "[ 1, 2, 4, 8 ]" );
+
+  std::string text = "{ pools : { default : &pool " + pool + " }, orders : *pool, users : *pool,"
+                     " retries : [ &retry " + retry + ", *retry, { delays : *retry } ] }";
+  std::string full = expanded( pool, retry );
+
+  try
+  {
+    CON::Object config = CON::buildFromString( text );
+    CON::Object expected = CON::buildFromString( full );
+    if ( ! ( config == expected ) ) identical = false;
+
+    // Reading through a const reference keeps the sharing
+    const CON::Object& shared = config;
+    if ( &shared["orders"] != &shared["pools"]["default"] || &shared["users"] != &shared["orders"] ) identical = false;
+    if ( &shared["retries"][1] != &shared["retries"][0] || &shared["retries"][2]["delays"] != &shared["retries"][0] ) identical = false;
+
+    CON::MemoryUsage sharing = config.memoryUsage();
+    CON::MemoryUsage copies = expected.memoryUsage();
+    std::cout << "Bytes shared : " << sharing.total() << ", copied : " << copies.total() << std::endl;
+    if ( sharing.total() >= copies.total() ) identical = false;
+
+    std::cout << "Writing references" << std::endl;
+    std::string written;
+    CON::writeToString( config, written, CON::Format::Compact, CON::References::Preserve );
+    std::cout << written;
+    if ( written.find( "*pool" ) == std::string::npos || written.find( "*retry" ) == std::string::npos ) identical = false;
+
+    CON::Object reread = CON::buildFromString( written );
+    const CON::Object& reshared = reread;
+    if ( ! ( reread == expected ) || &reshared["orders"] != &reshared["users"] ) identical = false;
+
+    CON::writeToString( config, written, CON::Format::Pretty, CON::References::Preserve );
+    std::cout << written;
+    if ( ! ( CON::buildFromString( written ) == expected ) ) identical = false;
+
+    // Expanded by default
+    std::string plain;
+    std::string reference;
+    CON::writeToString( config, plain );
+    CON::writeToString( expected, reference );
+    if ( plain != reference ) identical = false;
+
+    std::cout << "Copying on write" << std::endl;
+    CON::Object copy = config;
+    config["orders"]["size"].setValue( 20 );
+    if ( shared["orders"]["size"].asInt() != 20 || shared["users"]["size"].asInt() != 10 || shared["pools"]["default"]["size"].asInt() != 10 ) identical = false;
+    if ( &shared["users"] != &shared["pools"]["default"] ) identical = false;
+
+    config["retries"][2]["delays"].push( 16 );
+    if ( shared["retries"][2]["delays"].getSize() != 5 || shared["retries"][0].getSize() != 4 ) identical = false;
+
+    // The copy was taken before the changes, and shares in the same way
+    const CON::Object& copied = copy;
+    if ( ! ( copy == expected ) || &copied["orders"] != &copied["users"] || &copied["orders"] == &shared["users"] ) identical = false;
+
+    std::cout << "Anchors with the same name" << std::endl;
+    std::string renamed( "{ a : &x { n : 1 }, b : *x, c : &x { n : 2 }, d : *x }" );
+    CON::Object twice = CON::buildFromString( renamed );
+    CON::writeToString( twice, written, CON::Format::Compact, CON::References::Preserve );
+    std::cout << written;
+    if ( twice["d"]["n"].asInt() != 2 || ! ( CON::buildFromString( written ) == twice ) ) identical = false;
+
+    std::cout << "Reloading in place" << std::endl;
+    std::stringstream reload( text );
+    CON::parseInto( config, reload );
+    if ( ! ( config == expected ) || &shared["orders"] != &shared["users"] ) identical = false;
+
+    std::cout << "Reporting bad anchors" << std::endl;
+    std::stringstream unknown( "{ a : *missing, b : 1 }" );
+    std::stringstream scalar( "{ a : &five 5, b : [ &item true ] }" );
+    std::stringstream itself( "{ a : &loop { inner : *loop } }" );
+    if ( ! hasError( CON::tryBuildFromStream( unknown ), CON::ParseError::UnknownAnchor ) ) identical = false;
+    if ( ! hasError( CON::tryBuildFromStream( scalar ), CON::ParseError::InvalidAnchor ) ) identical = false;
+    if ( ! hasError( CON::tryBuildFromStream( itself ), CON::ParseError::UnknownAnchor ) ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
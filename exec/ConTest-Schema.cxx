@@ -0,0 +1,93 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+// Documents that break the schema and the error expected for each
+const char* documents[][2] =
+{
+  { "{ identifier : 1, another_id : 2, sub_file : { ID : \"a\" } }", "Schema expects string for identifier identifier." },
+  { "{ identifier : \"a\", another_id : 200, sub_file : { ID : \"a\" } }", "Schema expects a value at most 100 for identifier another_id." },
+  { "{ identifier : \"a\", another_id : 2 }", "Schema requires key sub_file in the root object." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : {} }", "Schema requires key ID in identifier sub_file." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, sub_object : { other : 1 } }", "Schema does not allow identifier other." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, list : [] }", "Schema expects at least 1 items in identifier list." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, list : [ 1, null, 2.5 ] }", "Schema expects null or integer for identifier 2." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, list : [ 0 ] }", "Schema expects a value at least 1 for identifier 0." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, list : [ 1e300, 4.5e18, 2.5 ] }", "Schema expects null or integer for identifier 2." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, list : [ 1e300, 1e999 ] }", "Schema expects null or integer for identifier 1." },
+  { "{ identifier : \"a\", another_id : 2, sub_file : { ID : \"a\" }, empty_object : { a : 1 } }", "Schema expects at most 0 items in identifier empty_object." }
+};
+
+
+int main( int, char** )
+{
+
+  std::cout << "Validating documents while parsing." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    CON::Schema schema( CON::buildFromFile( "./dat/test-schema.con" ) );
+    CON::ParseOptions options;
+    options.schema = &schema;
+
+    // The include is checked against the sub_file rule as it is loaded
+    CON::Object object = CON::buildFromFile( "./dat/test-basic.con", options );
+    std::cout << "Valid document : " << object.getSize() << " keys" << std::endl;
+
+    for ( size_t i = 0; i < sizeof( documents ) / sizeof( documents[0] ); ++i )
+    {
+      std::stringstream input( documents[i][0] );
+      CON::ParseResult result = CON::tryBuildFromStream( input, options );
+
+      std::string message = result.errors.empty() ? std::string( "No errors" ) : result.errors.front().message();
+      std::cout << message << std::endl;
+
+      if ( result.errors.size() != 1 || message.find( documents[i][1] ) == std::string::npos ) identical = false;
+    }
+
+    std::cout << "Checking invalid schemas" << std::endl;
+    const char* invalid[] = { "{ type : \"float\" }", "{ minItems : -1 }", "{ properties : [] }" };
+    for ( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); ++i )
+    {
+      try
+      {
+        std::string text( invalid[i] );
+        CON::Schema bad( CON::buildFromString( text ) );
+        identical = false;
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cout << "Rejected : " << ex.what() << std::endl;
+      }
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
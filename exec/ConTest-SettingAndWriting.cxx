@@ -64,6 +64,21 @@ int main( int, char** )
       std::cout << "They are NOT identical!" << std::endl;
     }
 
+    std::cout << "Writing compact string" << std::endl;
+    std::string compact;
+    CON::writeToString( root, compact, CON::Format::Compact );
+    std::cout << compact;
+
+    CON::Object compact_version = CON::buildFromString( compact );
+    if ( root == compact_version )
+    {
+      std::cout << "They are identical!" << std::endl;
+    }
+    else
+    {
+      std::cout << "They are NOT identical!" << std::endl;
+    }
+
   }
   catch ( CON::Exception& ex )
   {
@@ -0,0 +1,105 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+const int numberReaders = 8;
+const int numberVersions = 2000;
+
+
+CON::Object makeVersion( int version )
+{
+  CON::Object root( CON::Type::Object );
+  root.addChild( "version", CON::Object() );
+  root.addChild( "check", CON::Object() );
+  root.addChild( "items", CON::Object( CON::Type::Array ) );
+
+  root["version"].setValue( version );
+  root["check"].setValue( version * 2 );
+  for ( int i = 0; i < 16; ++i )
+  {
+    root["items"].push( version + i );
+  }
+  return root;
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Publishing " << numberVersions << " versions to " << numberReaders << " readers." << std::endl;
+
+  try
+  {
+    CON::Snapshot snapshot( makeVersion( 0 ) );
+    std::atomic<bool> finished( false );
+    std::atomic<int> failures( 0 );
+    std::atomic<long> reads( 0 );
+
+    std::vector< std::thread > readers;
+    for ( int r = 0; r < numberReaders; ++r )
+    {
+      readers.push_back( std::thread( [ &snapshot, &finished, &failures, &reads ]()
+      {
+        int last = 0;
+        long count = 0;
+        while ( ! finished.load() )
+        {
+          CON::Snapshot::Handle handle = snapshot.load();
+          const CON::Object& tree = *handle;
+
+          // Every published tree must be complete and versions must never go backwards
+          int version = tree["version"].asInt();
+          if ( version < last || tree["check"].asInt() != version * 2 || tree["items"].getSize() != 16 || tree["items"][15].asInt() != version + 15 )
+          {
+            ++failures;
+          }
+          last = version;
+
+          // Hold on to some handles across a publish
+          CON::Snapshot::Handle copy( handle );
+          if ( copy->get( "version" ).asInt() != version ) ++failures;
+          ++count;
+        }
+        reads += count;
+      } ) );
+    }
+
+    std::thread writer( [ &snapshot, &finished ]()
+    {
+      for ( int v = 1; v <= numberVersions; ++v )
+      {
+        snapshot.publish( makeVersion( v ) );
+      }
+      finished = true;
+    } );
+
+    writer.join();
+    for ( std::vector< std::thread >::iterator it = readers.begin(); it != readers.end(); ++it )
+    {
+      it->join();
+    }
+
+    std::cout << "Completed " << reads.load() << " reads" << std::endl;
+    if ( failures.load() == 0 && snapshot.load()->get( "version" ).asInt() == numberVersions )
+    {
+      std::cout << "All snapshots were consistent!" << std::endl;
+    }
+    else
+    {
+      std::cout << "Found " << failures.load() << " inconsistent snapshots!" << std::endl;
+      return 1;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,64 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Collecting parse statistics." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    CON::ParseStats stats;
+    CON::ParseOptions options;
+    options.stats = &stats;
+
+    CON::Object measured = CON::buildFromFile( "./dat/test-basic.con", options );
+    CON::Object plain = CON::buildFromFile( "./dat/test-basic.con" );
+    std::cout << stats;
+
+    if ( measured != plain ) identical = false;
+    if ( stats.bytes != 324 || stats.maxDepth != 2 ) identical = false;
+    if ( stats.tokens[ CON::ParseStats::Colon ] != 9 || stats.tokens[ CON::ParseStats::Filepath ] != 1 ) identical = false;
+    if ( stats.nodes[ static_cast<size_t>( CON::Type::Object ) ] != 4 || stats.nodes[ static_cast<size_t>( CON::Type::String ) ] != 4 ) identical = false;
+    if ( stats.includes.size() != 1 || stats.includes[0].file != "./dat/test-subfile.con" || stats.includes[0].bytes != 58 ) identical = false;
+    if ( stats.allocations == 0 || stats.totalSeconds <= 0.0 ) identical = false;
+
+    double phases = stats.seconds[ CON::ParseStats::Read ] + stats.seconds[ CON::ParseStats::Tokenize ] + stats.seconds[ CON::ParseStats::Build ];
+    if ( phases > stats.totalSeconds * 1.01 ) identical = false;
+
+    std::cout << "Statistics are reset for each parse" << std::endl;
+    std::stringstream input( "{ list : [ 1, [ 2, [ 3 ] ] ] }" );
+    CON::buildFromStream( input, options );
+    if ( stats.bytes != 30 || stats.maxDepth != 4 || ! stats.includes.empty() || stats.nodes[ static_cast<size_t>( CON::Type::Array ) ] != 3 ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,80 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Recording a trace of a load." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    CON::Trace trace;
+    CON::ParseOptions options;
+    options.trace = &trace;
+
+    CON::Object object = CON::buildFromFile( "./dat/test-basic.con", options );
+    std::ostringstream written;
+    CON::writeToStream( object, written, CON::Format::Pretty, trace );
+
+    std::vector< CON::Trace::Event > events = trace.events();
+    const CON::Trace::Event* include = nullptr;
+    size_t lexed = 0;
+    size_t built = 0;
+    size_t writes = 0;
+
+    for ( std::vector< CON::Trace::Event >::const_iterator it = events.begin(); it != events.end(); ++it )
+    {
+      if ( it->name != "read" ) std::cout << it->category << " : " << it->name << " " << it->detail << " at depth " << it->depth << std::endl;
+
+      if ( it->name == "include" ) include = &*it;
+      if ( it->name == "lex" ) ++lexed;
+      if ( it->name == "build" ) ++built;
+      if ( it->name == "write" ) ++writes;
+    }
+
+    if ( lexed != 2 || built != 2 || writes != 1 || ! include || include->detail != "./dat/test-subfile.con" ) return 1;
+
+    // The included file is lexed and built within the include span
+    for ( std::vector< CON::Trace::Event >::const_iterator it = events.begin(); it != events.end(); ++it )
+    {
+      if ( it->detail != include->detail || it->name == "include" ) continue;
+      if ( it->begin < include->begin || it->begin + it->duration > include->begin + include->duration || it->depth != 1 ) identical = false;
+    }
+
+    std::cout << "Reading back the trace event JSON" << std::endl;
+    std::stringstream json;
+    trace.write( json );
+    CON::Object parsed = CON::buildFromJSON( json );
+    if ( parsed["traceEvents"].getSize() != events.size() || parsed["traceEvents"][0]["ph"].asString() != "X" ) identical = false;
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,88 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <sstream>
+
+
+int main( int, char** )
+{
+
+  std::cout << "Decoding escapes and checking UTF-8 in strings." << std::endl;
+
+  bool identical = true;
+
+  try
+  {
+    std::string escapes( "{ text : \"tab\\there\\nnext \\u00e9\\u263a \\ud83d\\ude00 \\\"q\\\" \\\\ \\value\", path : <./dat/test-subfile.con> }" );
+    CON::ParseOptions decoding;
+    decoding.decodeEscapes = true;
+    std::stringstream escaped( escapes );
+    CON::Object object = CON::buildFromStream( escaped, decoding );
+    std::cout << object["text"].asString() << std::endl;
+    if ( object["text"].asString() != "tab\there\nnext \xc3\xa9\xe2\x98\xba \xf0\x9f\x98\x80 \"q\" \\ value" ) identical = false;
+
+    std::cout << "Without decoding, an escaped character stands for itself" << std::endl;
+    std::string plain( "{ text : \"tab\\there\", path : \"C:\\users\\x\" }" );
+    CON::Object literal = CON::buildFromString( plain );
+    std::cout << literal["text"].asString() << " " << literal["path"].asString() << std::endl;
+    if ( literal["text"].asString() != "tabthere" || literal["path"].asString() != "C:usersx" ) identical = false;
+
+    std::cout << "Writing and reading back" << std::endl;
+    std::string written;
+    CON::writeToString( object, written );
+    if ( CON::buildFromString( written ) != object ) identical = false;
+
+    CON::ParseOptions options;
+    options.validateUtf8 = true;
+
+    std::cout << "Valid multibyte text, across the input blocks" << std::endl;
+    std::string long_text( "{ text : \"" );
+    for ( size_t i = 0; i < 4000; ++i ) long_text += "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80 ascii ";
+    long_text += "\" }";
+    std::stringstream valid( long_text );
+    CON::ParseResult result = CON::tryBuildFromStream( valid, options );
+    if ( ! result.success() || result.object["text"].asString().size() != long_text.size() - 13 ) identical = false;
+
+    std::cout << "Invalid sequences" << std::endl;
+    const char* invalid[] = { "\xc0\x80", "\xed\xa0\x80", "\xe2\x82", "\xf5\x80\x80\x80", "\x80", "\xf4\x90\x80\x80" };
+    for ( size_t i = 0; i < sizeof( invalid ) / sizeof( invalid[0] ); ++i )
+    {
+      std::stringstream bad( std::string( "{ a : \"ok\", b : \"x" ) + invalid[i] + "\" }" );
+      CON::ParseResult failed = CON::tryBuildFromStream( bad, options );
+      for ( CON::ErrorList::iterator it = failed.errors.begin(); it != failed.errors.end(); ++it )
+      {
+        std::cout << it->offset << " : " << (*it) << std::endl;
+      }
+      if ( failed.errors.size() != 1 || failed.errors[0].code != CON::ParseError::InvalidUtf8 || failed.errors[0].offset != 18 ) identical = false;
+
+      // Unchecked, the bytes are kept as they are
+      std::stringstream unchecked( std::string( "{ b : \"" ) + invalid[i] + "\" }" );
+      if ( CON::buildFromStream( unchecked )["b"].asString() != invalid[i] ) identical = false;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  std::cout << std::endl;
+  if ( identical )
+  {
+    std::cout << "They are identical!" << std::endl;
+  }
+  else
+  {
+    std::cout << "They are NOT identical!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,104 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+const char* rootFileName = "./.temp/watcher_root.con";
+const char* subFileName = "./.temp/watcher_sub.con";
+
+
+void writeFile( const char* name, const char* contents )
+{
+  // Write then rename, the way most editors save
+  std::string temp_name = std::string( name ) + ".tmp";
+  std::ofstream file( temp_name, std::ios_base::out );
+  file << contents;
+  file.close();
+  std::rename( temp_name.c_str(), name );
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Watching a file with an include." << std::endl;
+
+  try
+  {
+    writeFile( subFileName, "{ port : 80, host : \"localhost\" }\n" );
+    writeFile( rootFileName, "{ name : \"root\", servers : [ <./.temp/watcher_sub.con>, { port : 81 } ], main : <./.temp/watcher_sub.con> }\n" );
+
+    CON::Watcher watcher( rootFileName );
+    watcher.addCallback( []( const std::vector<CON::Path>& paths )
+    {
+      for ( std::vector<CON::Path>::const_iterator it = paths.begin(); it != paths.end(); ++it )
+      {
+        std::cout << "Changed : ";
+        for ( CON::Path::const_iterator path_it = it->begin(); path_it != it->end(); ++path_it )
+        {
+          std::cout << "/" << (*path_it);
+        }
+        std::cout << std::endl;
+      }
+    } );
+
+    // Callbacks may register others while they run
+    bool registered = false;
+    watcher.addCallback( [ &watcher, &registered ]( const std::vector<CON::Path>& )
+    {
+      if ( ! registered ) watcher.addCallback( []( const std::vector<CON::Path>& ) {} );
+      registered = true;
+    } );
+
+    CON::Snapshot::Handle before = watcher.snapshot();
+    std::cout << "Initial port : " << before->get( "main" ).get( "port" ).asInt() << std::endl;
+
+    // A file included twice is shared rather than copied into each place
+    const CON::Object& tree = *before;
+    bool included = ( &tree.get( "main" ).get( "host" ) == &tree.get( "servers" ).get( 0 ).get( "host" ) );
+    std::cout << "Includes shared : " << included << std::endl;
+
+    std::cout << "Modifying the include." << std::endl;
+    writeFile( subFileName, "{ port : 8080, host : \"localhost\" }\n" );
+
+    bool published = false;
+    for ( int i = 0; i < 10 && ! published; ++i )
+    {
+      published = watcher.poll( 200 );
+    }
+
+    CON::Snapshot::Handle after = watcher.snapshot();
+    CON::Object expected = CON::buildFromFile( rootFileName );
+    CON::writeToStream( expected, std::cout );
+
+    std::cout << std::endl;
+    // Unchanged values are shared with the previous snapshot rather than copied
+    bool shared = ( &after->get( "name" ) == &before->get( "name" ) );
+    std::cout << "Unchanged values shared : " << shared << std::endl;
+
+    if ( published && registered && included && shared && before->get( "main" ).get( "port" ).asInt() == 80 && *after == expected )
+    {
+      std::cout << "Reloaded snapshot is identical!" << std::endl;
+    }
+    else
+    {
+      std::cout << "Reloaded snapshot is NOT identical!" << std::endl;
+      return 1;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+
+    for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
+    {
+      std::cerr << (*it) << std::endl;
+    }
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,148 @@
+
+#include "CON.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+
+void writeExample( CON::Writer& writer )
+{
+  writer.beginObject();
+    writer.key( "empty_array" );
+    writer.beginArray();
+    writer.end();
+    writer.key( "empty_object" );
+    writer.beginObject();
+    writer.end();
+    writer.key( "name" );
+    writer.value( "A \"quoted\" \\ string" );
+    writer.key( "nested" );
+    writer.beginArray();
+      writer.value( 1 );
+      writer.beginObject();
+        writer.key( "flag" );
+        writer.value( true );
+        writer.key( "nothing" );
+        writer.null();
+      writer.end();
+      writer.beginArray();
+        writer.value( 2.5 );
+      writer.end();
+      writer.value( "last" );
+    writer.end();
+    writer.key( "sub_file" );
+    writer.value( CON::buildFromFile( "./dat/test-subfile.con" ) );
+  writer.end();
+}
+
+
+int main( int, char** )
+{
+
+  std::cout << "Building the same object with and without the streaming writer." << std::endl;
+
+  try
+  {
+    CON::Object root( CON::Type::Object );
+    root.addChild( "empty_array", CON::Object( CON::Type::Array ) );
+    root.addChild( "empty_object", CON::Object( CON::Type::Object ) );
+    root.addChild( "name", CON::Object() );
+    root["name"].setValue( "A \"quoted\" \\ string" );
+
+    CON::Object inner( CON::Type::Object );
+    inner.addChild( "flag", CON::Object() );
+    inner["flag"].setValue( true );
+    inner.addChild( "nothing", CON::Object( CON::Type::Null ) );
+    CON::Object inner_array( CON::Type::Array );
+    inner_array.push( 2.5 );
+
+    CON::Object nested( CON::Type::Array );
+    nested.push( 1 );
+    nested.push( inner );
+    nested.push( inner_array );
+    nested.push( std::string( "last" ) );
+    root.addChild( "nested", nested );
+    root.addChild( "sub_file", CON::buildFromFile( "./dat/test-subfile.con" ) );
+
+    bool identical = true;
+    CON::Format formats[] = { CON::Format::Pretty, CON::Format::Compact };
+    for ( CON::Format format : formats )
+    {
+      std::string expected;
+      CON::writeToString( root, expected, format );
+
+      std::string streamed;
+      CON::Writer writer( streamed, format );
+      writeExample( writer );
+
+      std::cout << streamed;
+      if ( ! writer.complete() || streamed != expected ) identical = false;
+    }
+
+    std::cout << "Checking parallel writing" << std::endl;
+    CON::Object large( CON::Type::Array );
+    for ( int i = 0; i < 10000; ++i )
+    {
+      large.push( inner );
+      large.push( i );
+    }
+    root.addChild( "large", large );
+    for ( CON::Format format : formats )
+    {
+      std::stringstream sequential;
+      std::stringstream parallel;
+      CON::writeToStream( root, sequential, format );
+      CON::writeToStream( root, parallel, format, 4 );
+      if ( sequential.str() != parallel.str() ) identical = false;
+    }
+
+    std::cout << "Reporting failed parallel writes" << std::endl;
+    std::ofstream unopened;
+    unopened.exceptions( std::ios_base::badbit );
+    bool reported = false;
+    try
+    {
+      CON::writeToStream( root, unopened, CON::Format::Compact, 4 );
+    }
+    catch ( std::ios_base::failure& )
+    {
+      reported = true;
+    }
+    if ( ! reported ) identical = false;
+
+    std::cout << "Checking nesting validation" << std::endl;
+    bool rejected = false;
+    try
+    {
+      std::string output;
+      CON::Writer writer( output );
+      writer.beginObject();
+      writer.value( 1 );
+    }
+    catch ( CON::Exception& ex )
+    {
+      std::cout << "Rejected : " << ex.what() << std::endl;
+      rejected = true;
+    }
+
+    std::cout << std::endl;
+    if ( identical && rejected )
+    {
+      std::cout << "They are identical!" << std::endl;
+    }
+    else
+    {
+      std::cout << "They are NOT identical!" << std::endl;
+      return 1;
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << "Error : " << ex.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
@@ -1,100 +1,510 @@
-
 #include "CON.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <functional>
 
 
 typedef std::vector< std::string > StringVector;
-typedef std::vector< StringVector > PathVector;
+
+
+// Result of processing one input
+struct Job
+{
+  std::string file;
+  std::string output;
+  std::string errors;
+  bool success;
+};
 
 
 void failWithHelp();
 
+void readQueryFile( const std::string&, StringVector& );
+
+void findConfigFiles( const std::string&, StringVector& );
+
+bool isConfigFile( const std::string& );
+
+void runJobs( std::vector< Job >&, unsigned, const std::function< void( Job& ) >& );
+
+void queryJob( Job&, std::istream&, std::ostream&, const StringVector&, const CON::Query&, bool, bool );
+
+void validateJob( Job&, CON::Trace* );
+
+void statsJob( Job&, std::istream& );
+
+void decompressionJob( Job&, const CON::InputFile& );
+
 
 int main( int argN, char** argV )
 {
-  PathVector paths;
+  StringVector queries;
+  StringVector files;
+  StringVector validate;
+  std::string trace_file;
+  unsigned threads = std::thread::hardware_concurrency();
+  bool prefix = true;
+  bool stats = false;
 
   if ( argN < 2 )
   {
     failWithHelp();
-    return 1;
+    return 2;
   }
-  else
+
+  for ( int arg_count = 1; arg_count < argN; ++arg_count )
   {
-    for ( int arg_count = 1; arg_count < argN; ++arg_count )
+    std::string argument( argV[arg_count] );
+    bool has_value = arg_count + 1 < argN;
+
+    if ( argument == "-h" || argument == "--help" )
+    {
+      failWithHelp();
+      return 0;
+    }
+    else if ( ( argument == "-f" || argument == "--file" ) && has_value )
+    {
+      files.push_back( argV[++arg_count] );
+    }
+    else if ( ( argument == "-q" || argument == "--queries" ) && has_value )
+    {
+      try
+      {
+        readQueryFile( argV[++arg_count], queries );
+      }
+      catch ( CON::Exception& ex )
+      {
+        std::cerr << ex.what() << std::endl;
+        return 2;
+      }
+    }
+    else if ( ( argument == "-j" || argument == "--jobs" ) && has_value )
+    {
+      threads = std::strtoul( argV[++arg_count], nullptr, 10 );
+    }
+    else if ( argument == "--trace" && has_value )
+    {
+      trace_file = argV[++arg_count];
+    }
+    else if ( argument == "--stats" )
     {
-      StringVector path;
-      std::string current_string;
-      char *pointer = argV[arg_count];
+      stats = true;
+    }
+    else if ( argument == "--no-prefix" )
+    {
+      prefix = false;
+    }
+    else if ( argument == "--validate" )
+    {
+      // Everything that follows is a file or directory to check
+      while ( ++arg_count < argN )
+      {
+        validate.push_back( argV[arg_count] );
+      }
+    }
+    else if ( argument.size() > 1 && argument[0] == '-' )
+    {
+      std::cerr << "Unknown option: " << argument << std::endl;
+      failWithHelp();
+      return 2;
+    }
+    else
+    {
+      queries.push_back( argument );
+    }
+  }
 
-      if ( *pointer == '/' ) ++pointer;
+  if ( threads == 0 ) threads = 1;
 
-      while ( *pointer != '\0' )
+
+  // Validation mode. Parse every file completely and summarise
+  if ( ! validate.empty() )
+  {
+    std::vector< Job > jobs;
+    for ( StringVector::const_iterator it = validate.begin(); it != validate.end(); ++it )
+    {
+      StringVector found;
+      findConfigFiles( *it, found );
+      for ( StringVector::const_iterator file = found.begin(); file != found.end(); ++file )
       {
-        if ( *pointer == '/' )
-        {
-          path.push_back( current_string );
-          current_string.clear();
-        }
-        else
+        jobs.push_back( Job{ *file, std::string(), std::string(), false } );
+      }
+    }
+
+    CON::Trace trace;
+    CON::Trace* tracing = trace_file.empty() ? nullptr : &trace;
+    runJobs( jobs, threads, [ tracing ]( Job& job ) { validateJob( job, tracing ); } );
+
+    if ( tracing )
+    {
+      std::ofstream output( trace_file );
+      trace.write( output );
+    }
+
+    size_t invalid = 0;
+    for ( std::vector< Job >::const_iterator it = jobs.begin(); it != jobs.end(); ++it )
+    {
+      std::cerr << it->errors;
+      if ( ! it->success ) ++invalid;
+    }
+
+    std::cout << jobs.size() << " files checked, " << invalid << " invalid" << std::endl;
+    return ( invalid == 0 ) ? 0 : 1;
+  }
+
+
+  // Statistics mode. Parse each input completely and report what it costs
+  if ( stats )
+  {
+    std::vector< Job > jobs;
+    if ( files.empty() )
+    {
+      jobs.push_back( Job{ "-", std::string(), std::string(), false } );
+      statsJob( jobs.back(), std::cin );
+    }
+    else
+    {
+      for ( StringVector::const_iterator it = files.begin(); it != files.end(); ++it )
+      {
+        jobs.push_back( Job{ *it, std::string(), std::string(), false } );
+      }
+
+      runJobs( jobs, threads, []( Job& job )
+      {
+        CON::InputFile input( job.file );
+        if ( ! input.is_open() )
         {
-          current_string.push_back( *pointer );
+          job.errors = job.file + ": Failed to open file\n";
+          return;
         }
+        statsJob( job, input );
+        decompressionJob( job, input );
+      } );
+    }
+
+    bool success = true;
+    for ( std::vector< Job >::const_iterator it = jobs.begin(); it != jobs.end(); ++it )
+    {
+      std::cout << it->output;
+      std::cerr << it->errors;
+      if ( ! it->success ) success = false;
+    }
+    return success ? 0 : 1;
+  }
+
+
+  if ( queries.empty() )
+  {
+    failWithHelp();
+    return 2;
+  }
+
+  // Every expression is searched for in a single pass over each file
+  CON::Query query;
+  try
+  {
+    for ( StringVector::const_iterator it = queries.begin(); it != queries.end(); ++it )
+    {
+      query.add( *it );
+    }
+  }
+  catch ( CON::Exception& ex )
+  {
+    std::cerr << ex.what() << std::endl;
+    return 2;
+  }
+
+  // Wildcards may match many values, so show where each one came from
+  bool patterns = queries.size() > 1;
+  for ( size_t i = 0; i < query.size(); ++i )
+  {
+    const CON::Query::Expression& expression = query.expression( i );
+    for ( CON::Query::Expression::const_iterator it = expression.begin(); it != expression.end(); ++it )
+    {
+      if ( it->kind != CON::Query::Step::Key ) patterns = true;
+    }
+  }
+
+  bool path_prefix = prefix && patterns;
+  bool file_prefix = prefix && files.size() > 1;
+  std::vector< Job > jobs;
 
-        ++pointer;
+  if ( files.size() < 2 )
+  {
+    // A single input is written out as soon as its results are ready
+    jobs.push_back( Job{ files.empty() ? "-" : files[0], std::string(), std::string(), false } );
+    std::unique_ptr< CON::InputFile > file;
+    if ( ! files.empty() )
+    {
+      file.reset( new CON::InputFile( files[0] ) );
+      if ( ! file->is_open() )
+      {
+        std::cerr << files[0] << ": Failed to open file" << std::endl;
+        return 1;
       }
+    }
+    queryJob( jobs.back(), file ? *file : std::cin, std::cout, queries, query, false, path_prefix );
+    if ( file ) decompressionJob( jobs.back(), *file );
+  }
+  else
+  {
+    for ( StringVector::const_iterator it = files.begin(); it != files.end(); ++it )
+    {
+      jobs.push_back( Job{ *it, std::string(), std::string(), false } );
+    }
 
-      if ( current_string.size() > 0 )
+    runJobs( jobs, threads, [ &queries, &query, file_prefix, path_prefix ]( Job& job )
+    {
+      CON::InputFile input( job.file );
+      if ( ! input.is_open() )
       {
-        path.push_back( current_string );
+        job.errors = job.file + ": Failed to open file\n";
+        return;
       }
+      std::ostringstream output;
+      queryJob( job, input, output, queries, query, file_prefix, path_prefix );
+      decompressionJob( job, input );
+      job.output = output.str();
+    } );
+  }
 
-      paths.push_back( path );
+  // Results are printed in the order the files were given
+  bool success = true;
+  for ( std::vector< Job >::const_iterator it = jobs.begin(); it != jobs.end(); ++it )
+  {
+    std::cout << it->output;
+    std::cerr << it->errors;
+    if ( ! it->success ) success = false;
+  }
+
+  return success ? 0 : 1;
+}
+
+
+void failWithHelp()
+{
+  std::cerr << "Usage: con [options] configuration_paths...\n"
+               "       con [options] --validate files_or_directories...\n"
+               "  Reads standard input unless files are given.\n"
+               "\n"
+               "  -f, --file FILE      Query a file. May be repeated\n"
+               "  -q, --queries FILE   Read further paths from a file, one per line\n"
+               "  -j, --jobs N         Number of files to process at once\n"
+               "      --no-prefix      Never prefix results with the file and path\n"
+               "      --validate       Parse every .con file below the given directories\n"
+               "      --stats          Report parse statistics and memory use for each input\n"
+               "      --trace FILE     With --validate, write a Chrome trace of the loads to FILE\n"
+               "\n"
+               "  Paths are keys and array indices separated by '/'. A step may also be '*' for any\n"
+               "  key or item, a slice such as '0:10' or '**' for any number of levels.\n"
+               "\n"
+               "  Exit status is 0 on success, 1 if any file or path failed and 2 for usage errors." << std::endl;
+}
+
+
+void readQueryFile( const std::string& filename, StringVector& queries )
+{
+  std::ifstream input( filename );
+  if ( ! input.is_open() )
+  {
+    throw CON::Exception( std::string( "Failed to open query file \"" ) + filename + "\"" );
+  }
+
+  // One path per line. Blank lines and comments are ignored
+  std::string line;
+  while ( std::getline( input, line ) )
+  {
+    size_t begin = line.find_first_not_of( " \t\r" );
+    if ( begin == std::string::npos || line[begin] == '#' ) continue;
+    size_t end = line.find_last_not_of( " \t\r" );
+    queries.push_back( line.substr( begin, end - begin + 1 ) );
+  }
+}
+
+
+void findConfigFiles( const std::string& location, StringVector& files )
+{
+  std::error_code error;
+  if ( ! std::filesystem::is_directory( location, error ) )
+  {
+    files.push_back( location );
+    return;
+  }
+
+  StringVector found;
+  for ( std::filesystem::recursive_directory_iterator it( location, error ), end; it != end; it.increment( error ) )
+  {
+    if ( it->is_regular_file( error ) && isConfigFile( it->path().filename().string() ) )
+    {
+      found.push_back( it->path().string() );
     }
   }
 
+  // Directory order is arbitrary
+  std::sort( found.begin(), found.end() );
+  files.insert( files.end(), found.begin(), found.end() );
+}
 
-  try
+
+// Plain, gzip and zstd compressed configurations
+bool isConfigFile( const std::string& name )
+{
+  const char* suffixes[] = { ".con", ".con.gz", ".con.zst" };
+  for ( const char* suffix : suffixes )
+  {
+    std::string ending( suffix );
+    if ( name.size() > ending.size() && name.compare( name.size() - ending.size(), ending.size(), ending ) == 0 ) return true;
+  }
+  return false;
+}
+
+
+void runJobs( std::vector< Job >& jobs, unsigned threads, const std::function< void( Job& ) >& work )
+{
+  std::atomic< size_t > next( 0 );
+  auto worker = [ &jobs, &next, &work ]()
+  {
+    size_t index;
+    while ( ( index = next++ ) < jobs.size() )
+    {
+      work( jobs[index] );
+    }
+  };
+
+  std::vector< std::thread > pool;
+  for ( unsigned i = 1; i < threads && i < jobs.size(); ++i )
   {
-    CON::Object the_object = CON::buildFromStream( std::cin );
+    pool.push_back( std::thread( worker ) );
+  }
+  worker();
+
+  for ( std::vector< std::thread >::iterator it = pool.begin(); it != pool.end(); ++it )
+  {
+    it->join();
+  }
+}
+
 
-    for ( PathVector::const_iterator path_it = paths.begin(); path_it != paths.end(); ++path_it )
+void queryJob( Job& job, std::istream& input, std::ostream& output, const StringVector& queries, const CON::Query& query, bool file_prefix, bool path_prefix )
+{
+  std::ostringstream errors;
+  std::vector< size_t > matches( query.size(), 0 );
+  std::string text;
+
+  // Matches arrive in document order but are printed in the order the paths were given. A single
+  // path is written out as it is matched, several are held back until the input is read
+  bool buffered = query.size() > 1;
+  std::vector< std::string > results( buffered ? query.size() : 0 );
+
+  try
+  {
+    CON::queryStream( input, query, [ & ]( size_t expression, const std::string& path, const CON::Object& value )
     {
-      CON::Object* location = &the_object;
+      ++matches[expression];
 
-      for ( StringVector::const_iterator it = path_it->begin(); it != path_it->end(); ++it )
+      if ( value.getType() == CON::Type::Object || value.getType() == CON::Type::Array )
       {
-        location = &location->get( *it );
+        text.clear();
+        CON::Writer writer( text, CON::Format::Compact );
+        writer.value( value );
+        if ( ! text.empty() && text.back() == '\n' ) text.pop_back();
+      }
+      else
+      {
+        text = value.asString();
       }
 
-      std::cout << location->asString() << std::endl;
-    }
+      std::string line;
+      if ( file_prefix ) line += job.file + ':';
+      if ( path_prefix ) line += path + ": ";
+      else if ( file_prefix ) line += ' ';
+      line += text;
+      line += '\n';
+
+      if ( buffered ) results[expression] += line;
+      else output << line;
+    } );
   }
-  catch( CON::Exception& ex )
+  catch ( CON::Exception& ex )
   {
-    std::cerr << "An error occured: " << ex.what() << std::endl;
+    errors << job.file << ": An error occured: " << ex.what() << '\n';
     for ( CON::Exception::iterator it = ex.begin(); it != ex.end(); ++it )
     {
-      std::cerr << (*it) << std::endl;
+      errors << (*it) << '\n';
     }
-    return 1;
   }
-  catch( std::exception& ex )
+
+  for ( std::vector< std::string >::const_iterator it = results.begin(); it != results.end(); ++it )
   {
-    std::cerr << "Unknwon error occured. Exiting." << std::endl;
-    return 1;
+    output << *it;
   }
 
+  for ( size_t i = 0; i < queries.size(); ++i )
+  {
+    if ( matches[i] == 0 )
+    {
+      errors << job.file << ": " << queries[i] << ": No matching values\n";
+    }
+  }
 
-  return 0;
+  job.errors = errors.str();
+  job.success = job.errors.empty();
 }
 
-void failWithHelp()
+
+void validateJob( Job& job, CON::Trace* trace )
+{
+  CON::ParseOptions options;
+  options.trace = trace;
+  CON::ParseResult result = CON::tryBuildFromFile( job.file, options );
+  job.success = result.success();
+
+  std::ostringstream errors;
+  for ( CON::ErrorList::const_iterator it = result.errors.begin(); it != result.errors.end(); ++it )
+  {
+    errors << it->message() << '\n';
+  }
+  job.errors = errors.str();
+}
+
+
+void statsJob( Job& job, std::istream& input )
 {
-  std::cerr << "Usage: con [options] configuration_paths...\n" 
-               "  Note: No options are currently supported :p" << std::endl;
+  CON::ParseStats stats;
+  CON::ParseOptions options;
+  options.stats = &stats;
+
+  CON::ParseResult result = CON::tryBuildFromStream( input, options );
+  job.success = result.success();
+
+  std::ostringstream output;
+  output << "== " << job.file << '\n' << stats << result.object.memoryUsage( 10 ) << '\n';
+  job.output = output.str();
+
+  std::ostringstream errors;
+  for ( CON::ErrorList::const_iterator it = result.errors.begin(); it != result.errors.end(); ++it )
+  {
+    errors << job.file << ": " << it->message() << '\n';
+  }
+  job.errors = errors.str();
+}
+
+
+// Errors from the truncated data follow the reason it was cut short
+void decompressionJob( Job& job, const CON::InputFile& input )
+{
+  if ( input.error().empty() ) return;
+
+  job.errors = job.file + ": Failed to decompress input: " + input.error() + "\n" + job.errors;
+  job.success = false;
 }
 
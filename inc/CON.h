@@ -7,8 +7,18 @@
 #include <sstream>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
+#include <iterator>
 #include <list>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
 
 #define CON_VERSION_STRING "0.1"
@@ -22,31 +32,185 @@ namespace CON
   // Primary object class
   class Object;
   class Exception;
-  struct ParseError;
+  struct Operation;
+  struct DiffState;
+  struct ParseOptions;
+  struct ParseStats;
+  class Trace;
+  struct MemoryUsage;
+  struct ParseResult;
+  class Schema;
+  class Projection;
+  class Query;
+  class Overlay;
+  class Watcher;
+  class OutputBuffer;
+  struct WrittenAnchors;
 
 
 ////////////////////////////////////////////////////////////////////////////////
   // Data types for the values
   enum class Type { Null, String, Numeric, Boolean, Array, Object };
 
+  // Output layouts. Pretty indents nested values one per line, compact writes no whitespace
+  enum class Format { Pretty, Compact };
+
+  // Subtrees shared through anchors are either written out in full wherever they are referenced,
+  // or written once with their &name and referred to as *name after that
+  enum class References { Expand, Preserve };
+
+  // A single problem found while parsing. Only the code and byte offset are recorded, the line,
+  // column and text are worked out when they are asked for
+  struct ParseError
+  {
+    enum Code
+    {
+      Custom,
+      FileNotOpened,
+      RootNotFound,
+      InvalidRoot,
+      UnexpectedEnd,
+      InvalidIdentifier,
+      ExpectedColon,
+      ExpectedValue,
+      InvalidExpression,
+      InvalidValue,
+      ExpectedComma,
+      UnclosedObject,
+      UnexpectedArrayEnd,
+      InvalidArrayItem,
+      ExpectedArrayComma,
+      UnclosedArray,
+      UnterminatedString,
+      UnterminatedFilepath,
+      InvalidUnicode,
+      InvalidSurrogate,
+      IncludeFailed,
+      WrongType,
+      SchemaType,
+      SchemaRange,
+      SchemaMissingKey,
+      SchemaUnexpectedKey,
+      SchemaSize,
+      InvalidUtf8,
+      DecompressionFailed,
+      InvalidAnchor,
+      UnknownAnchor
+    };
+
+    // Offset given to errors that do not refer to a position in the input
+    static const size_t npos = static_cast<size_t>( -1 );
+
+    Code code;
+
+    // Byte offset into the input
+    size_t offset;
+
+    // Input file, if known
+    std::string file;
+
+    // Identifier of the value that was being parsed
+    std::string identifier;
+
+    // Anything else the message needs, e.g. a filename or a handler's message
+    std::string detail;
+
+    // Offsets of the newlines in the input, shared by all the errors from it. Inputs read in parts
+    // only keep the newlines from the last newline before the current part
+    std::shared_ptr< const std::vector<size_t> > newlines;
+
+    // Newlines in the input before the first of those kept
+    size_t linesBefore = 0;
+
+    // Line and column, counted from 1. Zero if unknown
+    size_t line() const;
+    size_t column() const;
+
+    // Format the complete message
+    std::string message() const;
+    operator std::string() const { return message(); }
+  };
+
+  std::ostream& operator<<( std::ostream&, const ParseError& );
+
   // List of errors
-  typedef std::vector<std::string> ErrorList;
+  typedef std::vector<ParseError> ErrorList;
+
+  // Location of a node within a tree. Array indices are given as decimal strings
+  typedef std::vector<std::string> Path;
+
+  // Ordered list of operations that transforms one tree into another
+  typedef std::vector<Operation> Patch;
+
+  // Called for each <file> include with the filename and the path it is mounted at in the tree being built
+  typedef std::function< Object( const std::string&, const Path& ) > IncludeHandler;
 
 
 ////////////////////////////////////////////////////////////////////////////////
   // Creation functions
   // Specify filename
   Object buildFromFile( std::string );
+  Object buildFromFile( std::string, const ParseOptions& );
 
   // Specify complete string
   Object buildFromString( std::string& );
+  Object buildFromString( std::string&, const ParseOptions& );
 
   // Specify input stream
   Object buildFromStream( std::istream& );
+  Object buildFromStream( std::istream&, const ParseOptions& );
+
+  // Parse into an existing tree, replacing its contents. Nodes, map entries and string storage are
+  // reused wherever the document has the same shape, so reloading a file that has changed little
+  // allocates little. Throws like buildFromFile, leaving whatever had been parsed in the object
+  void parseInto( Object&, std::string );
+  void parseInto( Object&, std::string, const ParseOptions& );
+  void parseInto( Object&, std::istream& );
+  void parseInto( Object&, std::istream&, const ParseOptions& );
+
+  // Non-throwing variants. Errors, including a file that cannot be opened, are returned in the result
+  ParseResult tryBuildFromFile( std::string );
+  ParseResult tryBuildFromFile( std::string, const ParseOptions& );
+  ParseResult tryBuildFromStream( std::istream& );
+  ParseResult tryBuildFromStream( std::istream&, const ParseOptions& );
+
+  // Build only the values at the projected paths, and the objects and arrays leading to them.
+  // Everything else is skipped without being stored, and includes outside the paths are never loaded
+  Object buildFromStream( std::istream&, const Projection& );
+  Object buildFromStream( std::istream&, const Projection&, const ParseOptions& );
+
+  // Call back with every value matching the query as it is read. Throws CON::Exception on parse
+  // errors, after any matches before the error have been reported
+  void queryStream( std::istream&, const Query&, const std::function< void( size_t, const std::string&, const Object& ) >& );
+  void queryStream( std::istream&, const Query&, const std::function< void( size_t, const std::string&, const Object& ) >&, const ParseOptions& );
 
   // Writing functions
   // Output to stream
   void writeToStream( Object&, std::ostream& );
+  void writeToStream( Object&, std::ostream&, Format );
+
+  // Serialize top level members and large array slices on this many threads. Output is identical,
+  // and is written as it is rendered. An exception on any of the threads is rethrown here
+  void writeToStream( Object&, std::ostream&, Format, unsigned );
+
+  // Output to stream, recording a span in the trace
+  void writeToStream( Object&, std::ostream&, Format, Trace& );
+
+  // Output to string, replacing its contents
+  void writeToString( Object&, std::string& );
+  void writeToString( Object&, std::string&, Format );
+
+  // Output keeping the anchors and references of shared subtrees
+  void writeToStream( Object&, std::ostream&, Format, References );
+  void writeToString( Object&, std::string&, Format, References );
+
+  // JSON
+  // Parse a JSON document. Equivalent to buildFromStream with ParseOptions::json set
+  Object buildFromJSON( std::istream& );
+
+  // Output as JSON. Compact unless a format is given
+  void writeJSON( Object&, std::ostream& );
+  void writeJSON( Object&, std::ostream&, Format );
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -63,8 +227,8 @@ namespace CON
       // If needed, have the filename
       std::string _filename;
 
-      // Cache the what string
-      std::string _what;
+      // Cache the what string. Built on the first call to what()
+      mutable std::string _what;
 
       // Parser error flag
       bool _parseError;
@@ -75,6 +239,7 @@ namespace CON
     public:
       // Parse error built from filname, line num, error
       Exception( ErrorList& );
+      explicit Exception( ErrorList&& );
 
       // Other crap went wrong
       explicit Exception( std::string );
@@ -96,17 +261,282 @@ namespace CON
 
 
 ////////////////////////////////////////////////////////////////////////////////
-  // Basic hierarchical object
+  // Input stream over a file that may be compressed. Gzip and zstd data are recognised from their
+  // first bytes and decompressed as they are read, through fixed size buffers. Other files are
+  // read directly. Gzip needs a build with CON_ZLIB defined, zstd one with CON_ZSTD
+  class InputFile : public std::istream
+  {
+    public:
+      enum Compression { None, Gzip, Zstd };
+
+    private:
+      class Decoder;
+
+      std::filebuf _file;
+      std::unique_ptr<Decoder> _decoder;
+      Compression _compression;
+
+    public:
+      explicit InputFile( const std::string& );
+      ~InputFile();
+
+      InputFile( const InputFile& ) = delete;
+      InputFile& operator=( const InputFile& ) = delete;
+
+      bool is_open() const { return _file.is_open(); }
+
+      Compression compression() const { return _compression; }
+
+      // Why decompression stopped early, e.g. corrupt or truncated data. Empty if it has not
+      const std::string& error() const;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Contiguous output buffer for the writers. Flushes to a stream in large blocks, or appends to a string
+  class OutputBuffer
+  {
+    private:
+      // Destination stream, null when writing directly into a string
+      std::ostream* _output;
+
+      // Reused storage when writing to a stream
+      std::string _storage;
+
+      // The buffer being appended to
+      std::string& _buffer;
+
+      // Size at which check() flushes
+      size_t _limit;
+
+      // Shared subtrees written so far when references are preserved, otherwise null
+      WrittenAnchors* _anchors;
+
+    public:
+      explicit OutputBuffer( std::ostream& );
+      explicit OutputBuffer( std::string& );
+
+      OutputBuffer( const OutputBuffer& ) = delete;
+      OutputBuffer& operator=( const OutputBuffer& ) = delete;
+
+      // Flushes anything remaining
+      ~OutputBuffer();
+
+      // Append to the buffer
+      void put( char c ) { _buffer.push_back( c ); }
+      void write( const char* data, size_t length ) { _buffer.append( data, length ); }
+      void write( const std::string& data ) { _buffer.append( data ); }
+
+      // Two spaces per level
+      void indent( size_t depth ) { _buffer.append( 2 * depth, ' ' ); }
+
+      // Flush if enough has been buffered
+      void check() { if ( _buffer.size() >= _limit ) flush(); }
+
+      // Write everything buffered to the stream
+      void flush();
+
+      // Track the shared subtrees written, so later references to them are written as *name
+      void preserveReferences( WrittenAnchors* anchors ) { _anchors = anchors; }
+      WrittenAnchors* anchors() const { return _anchors; }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Children of an object, always in key order. Most objects only have a few keys, which are kept
+  // in a single sorted array and searched linearly. Past CON_SMALL_OBJECT_SIZE keys they are moved
+  // into a tree, which is kept from then on
+  class Children
+  {
+    public:
+      struct Entry
+      {
+        std::string first;
+
+        // Can be replaced through an iterator, as the value in a map can
+        mutable Object* second;
+      };
+
+      class const_iterator;
+      typedef const_iterator iterator;
+
+    private:
+      // Orders the tree by key, and finds entries by the key alone
+      struct Less
+      {
+        typedef void is_transparent;
+
+        bool operator()( const Entry& a, const Entry& b ) const { return a.first < b.first; }
+        bool operator()( const Entry& a, const std::string& b ) const { return a.first < b; }
+        bool operator()( const std::string& a, const Entry& b ) const { return a < b.first; }
+      };
+
+      typedef std::set<Entry, Less> Tree;
+
+      // Entries while the object is small
+      std::vector<Entry> _flat;
+
+      // Entries once it has grown, otherwise null
+      std::unique_ptr<Tree> _tree;
+
+      // Move every entry into a tree
+      void _grow();
+
+      // Direct access to the array of a small object, for refilling it in place
+      friend class Rebuild;
+      std::vector<Entry>& _flatEntries() { return _flat; }
+
+    public:
+      class const_iterator
+      {
+        friend class Children;
+
+        private:
+          const Entry* _entry;
+          Tree::const_iterator _node;
+          bool _inTree;
+
+          explicit const_iterator( const Entry* entry ) : _entry( entry ), _node(), _inTree( false ) {}
+          explicit const_iterator( Tree::const_iterator node ) : _entry( nullptr ), _node( node ), _inTree( true ) {}
+
+        public:
+          typedef std::bidirectional_iterator_tag iterator_category;
+          typedef Entry value_type;
+          typedef std::ptrdiff_t difference_type;
+          typedef const Entry* pointer;
+          typedef const Entry& reference;
+
+          const_iterator() : _entry( nullptr ), _node(), _inTree( false ) {}
+
+          reference operator*() const { return _inTree ? *_node : *_entry; }
+          pointer operator->() const { return &**this; }
+
+          const_iterator& operator++() { if ( _inTree ) ++_node; else ++_entry; return *this; }
+          const_iterator& operator--() { if ( _inTree ) --_node; else --_entry; return *this; }
+          const_iterator operator++( int ) { const_iterator old( *this ); ++*this; return old; }
+          const_iterator operator--( int ) { const_iterator old( *this ); --*this; return old; }
+
+          bool operator==( const const_iterator& other ) const { return _inTree ? _node == other._node : _entry == other._entry; }
+          bool operator!=( const const_iterator& other ) const { return ! operator==( other ); }
+      };
+
+      Children() : _flat(), _tree() {}
+
+      Children( Children&& ) = default;
+      Children& operator=( Children&& ) = default;
+
+      Children( const Children& ) = delete;
+      Children& operator=( const Children& ) = delete;
+
+      size_t size() const { return _tree ? _tree->size() : _flat.size(); }
+      bool empty() const { return size() == 0; }
+
+      const_iterator begin() const { return _tree ? const_iterator( _tree->cbegin() ) : const_iterator( _flat.data() ); }
+      const_iterator end() const { return _tree ? const_iterator( _tree->cend() ) : const_iterator( _flat.data() + _flat.size() ); }
+
+      // Returns end() if the key is missing
+      const_iterator find( const std::string& ) const;
+
+      // The pointer stored for a key, inserting a null one if the key is missing
+      Object*& operator[]( const std::string& );
+
+      // Add a key that sorts after all the others. Checked by an assertion, as a key out of order
+      // would break every lookup
+      Object*& append( std::string, Object* );
+
+      // Move an entry out of another set of children, reusing the tree node if both are trees
+      Object*& take( Children&, const_iterator );
+
+      void erase( const_iterator );
+
+      // Remove every entry. Small objects keep their array for refilling
+      void clear();
+
+      void swap( Children& other ) { _flat.swap( other._flat ); _tree.swap( other._tree ); }
+
+      // Entries are kept in one array rather than a tree
+      bool small() const { return ! _tree; }
+
+      // Make room for this many entries, starting a tree straight away if they will not fit in the
+      // array. Only while empty
+      void reserve( size_t );
+
+      // Bytes and number of allocations holding the entries, not counting the key strings
+      size_t heapBytes() const;
+      size_t allocations() const;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Basic hierarchical object. A subtree declared with an &name anchor is shared by every *name
+  // reference to it. Reading through a const object keeps the sharing, while the non-const child
+  // accessors copy a shared child first, so changes are only ever seen through one parent
   class Object
   {
     // Easier for writing to be a friend
-    friend void printObject( Object&, std::ostream&, size_t );
+    friend void printObject( const Object&, OutputBuffer&, size_t );
+    friend void printCompact( const Object&, OutputBuffer& );
+    friend void printValue( const Object&, OutputBuffer& );
+    friend void writeParallel( const Object&, std::ostream&, Format, unsigned );
+    friend void printJSON( const Object&, OutputBuffer&, size_t, bool );
+
+    // Structural differences walk the children directly
+    friend size_t hashObject( const Object&, DiffState& );
+    friend bool equalTrees( const Object&, const Object& );
+    friend void diffObjects( const Object&, const Object&, DiffState& );
+
+    // Parse statistics count the nodes of the finished tree
+    friend void countNodes( const Object&, ParseStats&, size_t );
+
+    // Schemas are compiled from the children of the schema document
+    friend class Schema;
+
+    // Queries search matched subtrees directly
+    friend class Query;
+
+    // Parsing into an existing tree takes nodes from its previous contents
+    friend class Rebuild;
+
+    // Preserving references needs to know which subtrees are shared
+    friend struct WrittenAnchors;
+
+    // Overlays merge the keys of the layers directly
+    friend class Overlay;
+
+    // Watchers publish the root tree by sharing its children
+    friend class Watcher;
+
+    // Readers stream the trees returned by include handlers as tokens
+    friend class TreeLexer;
 
     // Mapping of identifier to object pointer
-    typedef std::map<std::string, Object*> ObjectMap;
+    typedef Children ObjectMap;
     typedef std::vector<Object*> Array;
 
+    // Copies of the shared nodes met while copying a tree, so they stay shared in the copy
+    typedef std::map<const Object*, Object*> Copies;
+
     private:
+      // Account for this node and everything below it, returning the bytes of the subtree. Shared
+      // subtrees are only counted the first time they are reached
+      size_t _memoryUsage( MemoryUsage&, std::string&, size_t, std::set<const Object*>& ) const;
+
+      // Deep copy of the children of another node
+      void _copyChildren( const Object&, Copies& );
+
+      // Deep copy of one node, or another share of its copy if it was already copied
+      static Object* _copy( const Object*, Copies& );
+
+      // Take another share of each of the children of another node instead of copying them
+      void _shareChildren( const Object& );
+
+      // Drop one holder of a node, deleting it with the last
+      static void _release( Object* );
+
+      // Replace a shared child with a private copy before it can be changed. Only the node itself is
+      // copied, its children gain another holder and are copied in turn when they are changed
+      static Object* _unshare( Object*& );
+
       // Map of all the children
       ObjectMap _children;
 
@@ -119,6 +549,10 @@ namespace CON
       // Type of value stored
       Type _type;
 
+      // Holders of the node besides the first. Non-zero for subtrees shared through anchors, copied
+      // on write or published by a Watcher. Trees on different threads may share nodes, so it is atomic
+      mutable std::atomic<uint32_t> _shares;
+
     public:
       // Initialise empty object
       Object();
@@ -152,6 +586,9 @@ namespace CON
       // Depending on the type, returns the array size, children size, 1 for value types or zero for null
       size_t getSize() const;
 
+      // Heap and object memory held by this tree, optionally with the heaviest subtrees
+      MemoryUsage memoryUsage( size_t top = 0 ) const;
+
 
 ////////////////////////////////////////////////////////////////////////////////
       // If Type == Numeric or String or Boolean
@@ -194,6 +631,13 @@ namespace CON
       // Boolean
       bool asBool() const;
 
+      // Non-throwing interpretations. Return false and leave the argument untouched if the value
+      // is not of the correct type or does not fit
+      bool tryAsInt( int& ) const;
+      bool tryAsLong( long& ) const;
+      bool tryAsDouble( double& ) const;
+      bool tryAsBool( bool& ) const;
+
 
 ////////////////////////////////////////////////////////////////////////////////
       // If Type == Object
@@ -204,18 +648,36 @@ namespace CON
       // Add a child to the map
       void addChild( std::string, Object );
 
+      // Remove a child from the map
+      void removeChild( std::string );
+
       // Return a child
       Object& get( std::string );
       Object& operator[]( std::string id ) { return this->get( id ); }
       const Object& get( std::string ) const;
       const Object& operator[]( std::string id ) const { return this->get( id ); }
 
+      // Return a pointer to a child, or nullptr if it does not exist or this is not an object
+      Object* find( const std::string& );
+      const Object* find( const std::string& ) const;
+
+      // Return the child's value, or the default if it is missing or of the wrong type
+      int getOr( const std::string&, int ) const;
+      long getOr( const std::string&, long ) const;
+      double getOr( const std::string&, double ) const;
+      bool getOr( const std::string&, bool ) const;
+      std::string getOr( const std::string&, const std::string& ) const;
+      std::string getOr( const std::string&, const char* ) const;
+
 
 ////////////////////////////////////////////////////////////////////////////////
       // If Type == Array
 
       // Push an object to array.
       void push( Object& );
+
+      // Push an object to array, taking its contents instead of copying them
+      void push( Object&& );
       void push( std::string );
       void push( char );
       void push( int );
@@ -226,12 +688,22 @@ namespace CON
       // Fill from a vector
       void fill( std::vector< Object >& );
 
+      // Insert an object before the given index. Index may equal the size to append
+      void insert( size_t, const Object& );
+
+      // Remove the object at the given index
+      void erase( size_t );
+
       // Return a index value from the array
       Object& get( size_t );
       Object& operator[]( size_t id ) { return this->get( id ); }
       const Object& get( size_t ) const;
       const Object& operator[]( size_t id ) const { return this->get( id ); }
 
+      // Return a pointer to an array item, or nullptr if it is out of bounds or this is not an array
+      Object* find( size_t );
+      const Object* find( size_t ) const;
+
 
 ////////////////////////////////////////////////////////////////////////////////
       // Comparison operators
@@ -241,6 +713,825 @@ namespace CON
       bool operator!=( Object& o ) const { return ! operator==( o ); }
   };
 
+
+////////////////////////////////////////////////////////////////////////////////
+  // Streaming writer. Emits the same text as writeToStream without building a tree.
+  // Keys are written in the order given, so sorted keys give byte-identical output
+  class Writer
+  {
+    private:
+      // An open object or array
+      struct Level
+      {
+        Type type;
+        size_t count;
+        bool hasKey;
+      };
+
+      OutputBuffer _buffer;
+      Format _format;
+      std::vector< Level > _stack;
+      bool _complete;
+
+      // Validate the position and write the separators before a value
+      void _beginValue( bool );
+
+      // Record a completed value
+      void _endValue();
+
+      // Open a container
+      void _begin( Type, char );
+
+    public:
+      explicit Writer( std::ostream& );
+      Writer( std::ostream&, Format );
+      explicit Writer( std::string& );
+      Writer( std::string&, Format );
+
+      Writer( const Writer& ) = delete;
+      Writer& operator=( const Writer& ) = delete;
+
+      // Open containers
+      void beginObject();
+      void beginArray();
+
+      // Name the next value within an object
+      void key( const std::string& );
+
+      // Values
+      void value( const std::string& );
+      void value( const char* );
+      void value( int );
+      void value( long );
+      void value( unsigned long );
+      void value( float );
+      void value( double );
+      void value( bool );
+      void null();
+
+      // Write a complete tree as the next value
+      void value( const Object& );
+
+      // Close the innermost container
+      void end();
+
+      // True once the root value has been written
+      bool complete() const { return _complete; }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Pull parser. Steps through a document one event at a time without building a tree.
+  // Includes are followed transparently, the included root object appearing as the value. A tree
+  // returned by an include handler is streamed as it is, and may be any value
+  // Anchors and references are not followed, as nothing is kept to refer back to. Documents using
+  // them must be built as a tree
+  class Reader
+  {
+    public:
+      enum Event { BeginObject, EndObject, BeginArray, EndArray, Key, Value, End, Error };
+
+    private:
+      struct State;
+      std::unique_ptr<State> _state;
+
+    public:
+      explicit Reader( std::istream& );
+      Reader( std::istream&, const ParseOptions& );
+
+      Reader( Reader&& );
+      Reader& operator=( Reader&& );
+
+      ~Reader();
+
+      // Advance to the next event. Returns Error from the first error onwards
+      Event next();
+
+      // The current event
+      Event event() const;
+
+      // The key for Key events, the value text for Value events
+      const std::string& text() const;
+
+      // The value type for Value events
+      Type type() const;
+
+      // Byte offset of the current event within its input
+      size_t offset() const;
+
+      // After Key, skip the key's value. After BeginObject or BeginArray, skip to the end of the
+      // container, as if its end event had been returned. Skipped includes are never loaded
+      void skip();
+
+      // Within an array, skip the next item without reading it. Returns false, with the event set
+      // to EndArray, once there are no more items
+      bool skipItem();
+
+      // Record an error at the current event. The reader returns Error from then on
+      void error( ParseError::Code, const std::string& detail = std::string() );
+
+      bool failed() const;
+
+      const ErrorList& errors() const;
+  };
+
+  // Build the value starting at the reader's current event
+  bool readValue( Reader&, Object& );
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Successive root objects from one input, e.g. a log of concatenated documents. The lexer,
+  // its buffer and the token storage are kept from one document to the next, and each document
+  // is parsed into the caller's object, reusing the nodes already there where the keys match.
+  // Anything between the documents outside of a root object is skipped. With ParseOptions::json
+  // every root value is a document
+  class DocumentStream
+  {
+    private:
+      struct State;
+      std::unique_ptr<State> _state;
+
+    public:
+      explicit DocumentStream( std::istream& );
+      DocumentStream( std::istream&, const ParseOptions& );
+
+      DocumentStream( DocumentStream&& );
+      DocumentStream& operator=( DocumentStream&& );
+
+      ~DocumentStream();
+
+      // Parse the next document into the object, replacing its contents. Returns false, leaving
+      // the object untouched, once the input holds no more documents. Throws CON::Exception if the
+      // document has errors, after which the stream carries on from the end of that document
+      bool next( Object& );
+
+      // Documents read so far, including any with errors
+      size_t count() const;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Expected shape of a document, itself written in CON. Compiled once and checked while parsing:
+  //
+  //   {
+  //     type : "object",
+  //     required : [ "port" ],
+  //     additional : false,
+  //     properties :
+  //     {
+  //       port : { type : "integer", minimum : 1, maximum : 65535 },
+  //       hosts : { type : "array", minItems : 1, items : { type : [ "string", "null" ] } }
+  //     }
+  //   }
+  //
+  // Types are "null", "string", "number", "integer", "boolean", "array", "object" and "any".
+  // Minimum and maximum bound numbers, minItems and maxItems bound the size of arrays and objects.
+  class Schema
+  {
+    public:
+      // One compiled rule
+      struct Node
+      {
+        // Bit for each allowed Type
+        unsigned types = ~0u;
+
+        // Numbers must be whole
+        bool integer = false;
+
+        bool hasMinimum = false;
+        bool hasMaximum = false;
+        double minimum = 0.0;
+        double maximum = 0.0;
+
+        size_t minItems = 0;
+        size_t maxItems = static_cast<size_t>( -1 );
+
+        // Keys of an object
+        std::vector<std::string> required;
+        std::map<std::string, Node> properties;
+
+        // Allow keys not listed in the properties
+        bool additional = true;
+
+        // Rule for every item of an array. Empty allows anything
+        std::shared_ptr<const Node> items;
+
+        bool allows( Type type ) const { return types & ( 1u << static_cast<unsigned>( type ) ); }
+      };
+
+    private:
+      std::shared_ptr<const Node> _root;
+
+      // Compile one rule and, recursively, the rules within it
+      static void _compile( const Object&, Node& );
+
+    public:
+      // Compile a schema document. Throws if the schema itself is invalid
+      explicit Schema( const Object& );
+
+      const Node& root() const { return *_root; }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Paths to keep when building a tree. Keys and array indices are separated by '/', for example
+  // "servers/0/host". An empty path keeps the whole document. Array items before a projected
+  // index are kept as null so that indices are unchanged
+  class Projection
+  {
+    public:
+      struct Node
+      {
+        // Keep everything below this point
+        bool whole = false;
+
+        std::map<std::string, Node> children;
+      };
+
+    private:
+      Node _root;
+
+    public:
+      Projection() {}
+      Projection( std::initializer_list<std::string> );
+      explicit Projection( const std::vector<std::string>& );
+
+      // Add another path. Throws CON::Exception if an index is too large
+      void add( const std::string& );
+
+      const Node& root() const { return _root; }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Structural search over a streamed document. Steps are separated by '/' and may be
+  //
+  //   a key            servers/main/port
+  //   an array index   items/3
+  //   a slice          items/0:10     End exclusive, either bound may be left out
+  //   a wildcard       servers/*/port Any key or array item
+  //   a descent        **/timeout     Any number of levels, including none
+  //
+  // The document is read with a Reader and anything that cannot match is skipped, so only the
+  // matched values are ever held in memory. Several expressions may be searched in one pass.
+  class Query
+  {
+    public:
+      struct Step
+      {
+        enum Kind { Key, Any, Slice, Descend };
+
+        Kind kind;
+        std::string key;
+        size_t begin;
+        size_t end;
+      };
+
+      typedef std::vector<Step> Expression;
+
+      // Called for each match in document order with the expression's index, the concrete path
+      // of the value and the value itself
+      typedef std::function< void( size_t, const std::string&, const Object& ) > Callback;
+
+    private:
+      // Position within each expression that the current value has reached
+      typedef std::vector< std::pair<size_t, size_t> > States;
+
+      std::vector<Expression> _expressions;
+
+      // Add a state, and the states reachable from it without consuming a level
+      void _addState( size_t, size_t, States& ) const;
+
+      // States for a child with the given key, or the given index when the key is null
+      void _advance( const States&, const std::string*, size_t, States& ) const;
+
+      // True if an array item at this index or later could match
+      bool _continues( const States&, size_t ) const;
+
+      bool _run( Reader&, const States&, std::string&, const Callback& ) const;
+      void _run( const Object&, const States&, std::string&, const Callback& ) const;
+
+    public:
+      Query() {}
+      Query( std::initializer_list<std::string> );
+      explicit Query( const std::vector<std::string>& );
+
+      // Add another expression. Throws CON::Exception if a slice is malformed or an index is too large
+      void add( const std::string& );
+
+      size_t size() const { return _expressions.size(); }
+
+      const Expression& expression( size_t i ) const { return _expressions[i]; }
+
+      // Search the document from the reader's current event. Returns false on parse errors
+      bool run( Reader&, const Callback& ) const;
+
+      // Search an existing tree
+      void run( const Object&, const Callback& ) const;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Memory held by an Object tree. Sizes are those asked of the allocator, without its own headers
+  // and rounding, so they are a lower bound on the resident size
+  struct MemoryUsage
+  {
+    // The Object heads, including the root
+    size_t objects = 0;
+
+    // Storage of the children of objects, holding the keys and pointers
+    size_t mapNodes = 0;
+
+    // Buffers of the array item vectors
+    size_t arrays = 0;
+
+    // Key and value strings too long for the small string buffer
+    size_t strings = 0;
+
+    // Nodes and the bytes of the nodes themselves, not their children, indexed by static_cast<size_t>( Type )
+    size_t count[ 6 ] = {};
+    size_t bytes[ 6 ] = {};
+
+    // A subtree and the total bytes held by it
+    struct Path
+    {
+      std::string path;
+      size_t bytes;
+    };
+
+    // The heaviest subtrees below the root, heaviest first, when asked for
+    std::vector< Path > heaviest;
+
+    size_t total() const { return objects + mapNodes + arrays + strings; }
+  };
+
+  std::ostream& operator<<( std::ostream&, const MemoryUsage& );
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Timeline of spans written as Chrome trace event JSON, for chrome://tracing or Perfetto.
+  // Loading records reading, lexing and building for every file, with each include as a span
+  // around the work it causes. Spans may be recorded from several threads at once
+  class Trace
+  {
+    public:
+      struct Event
+      {
+        std::string name;
+        std::string category;
+
+        // The file the span belongs to, if any
+        std::string detail;
+
+        // Microseconds from the creation of the trace
+        double begin;
+        double duration;
+
+        // Spans of the same category already open on the thread, e.g. the include depth
+        size_t depth;
+
+        std::thread::id thread;
+      };
+
+      // Records a span for its lifetime. Does nothing without a trace
+      class Span
+      {
+        private:
+          Trace* _trace;
+          size_t _index;
+
+        public:
+          Span( Trace*, const char*, const char*, const std::string& = std::string() );
+          ~Span();
+
+          Span( const Span& ) = delete;
+          Span& operator=( const Span& ) = delete;
+      };
+
+    private:
+      std::chrono::steady_clock::time_point _origin;
+      std::vector< Event > _events;
+
+      // Spans still open on each thread
+      std::map< std::thread::id, std::vector< size_t > > _open;
+
+      mutable std::mutex _mutex;
+
+    public:
+      Trace();
+
+      Trace( const Trace& ) = delete;
+      Trace& operator=( const Trace& ) = delete;
+
+      // Open a span, returning its index
+      size_t begin( const std::string& name, const std::string& category, const std::string& detail = std::string() );
+
+      // Close the span with this index
+      void end( size_t );
+
+      // Copy of the recorded spans, in the order they were opened
+      std::vector< Event > events() const;
+
+      void clear();
+
+      // Write the trace event JSON
+      void write( std::ostream& ) const;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Measurements of a parse, filled in when ParseOptions::stats is set. Everything is reset at the
+  // start of each creation function and covers the document together with all of its includes
+  struct ParseStats
+  {
+    // Lexical token kinds, in the order they are counted
+    enum Token { Text, Quote, Colon, Comma, OpenObject, CloseObject, OpenArray, CloseArray, Comment, Filepath, TokenKinds };
+
+    // Exclusive wall time phases. Reading covers waiting on the input streams, tokenizing the rest
+    // of the lexing and building turning the tokens into a tree, loading includes included
+    enum Phase { Read, Tokenize, Build, Phases };
+
+    // One loaded include, its time covering everything nested within it
+    struct Include
+    {
+      std::string file;
+      double seconds;
+      size_t bytes;
+    };
+
+    size_t bytes = 0;
+
+    size_t tokens[ TokenKinds ] = {};
+
+    // Indexed by static_cast<size_t>( Type )
+    size_t nodes[ 6 ] = {};
+
+    size_t maxDepth = 0;
+
+    std::vector< Include > includes;
+
+    // Heap blocks held by the token list and the finished tree, and their size. Estimated from the
+    // containers and strings built rather than by replacing the global allocator
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+
+    double seconds[ Phases ] = {};
+
+    // From the start of the parse to the finished tree
+    double totalSeconds = 0.0;
+
+    // Reset the results. A parse in progress keeps timing
+    void clear();
+
+    static const char* tokenName( size_t );
+    static const char* phaseName( size_t );
+
+  private:
+    friend class StatsScope;
+    friend Phase switchPhase( ParseStats&, Phase );
+
+    // The phase being timed, and how many parses sharing these statistics are running
+    struct Timing
+    {
+      std::chrono::steady_clock::time_point mark;
+      Phase phase = Build;
+      size_t nesting = 0;
+    };
+
+    Timing _timing;
+  };
+
+  std::ostream& operator<<( std::ostream&, const ParseStats& );
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Options for the creation functions
+  struct ParseOptions
+  {
+    // Resolves <file> includes. If empty, includes are loaded with buildFromFile
+    IncludeHandler include;
+
+    // Parse JSON. Keys may be quoted, strings use JSON escapes, the root may be any value and there are no includes
+    bool json = false;
+
+    // Stop parsing once this many errors have been found. Zero collects them all
+    size_t errorLimit = 0;
+
+    // Report strings that are not valid UTF-8
+    bool validateUtf8 = false;
+
+    // Decode \n, \t, \r and \uXXXX in quoted strings as JSON does. Otherwise an escaped character
+    // stands for itself, so "tab\there" reads as tabthere. JSON strings are always decoded
+    bool decodeEscapes = false;
+
+    // Check the document against this schema as it is parsed
+    const Schema* schema = nullptr;
+
+    // Fill in measurements of the parse. Nothing is measured when this is null
+    ParseStats* stats = nullptr;
+
+    // Record a timeline of the parse. Nothing is recorded when this is null
+    Trace* trace = nullptr;
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Result of the non-throwing creation functions
+  struct ParseResult
+  {
+    // Whatever could be built. Only complete when there are no errors
+    Object object;
+
+    ErrorList errors;
+
+    bool success() const { return errors.empty(); }
+    explicit operator bool() const { return errors.empty(); }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Structural differences
+
+  // A single path-addressed change. For Insert and Erase the final path element is the array index
+  struct Operation
+  {
+    enum Kind { Add, Remove, Replace, Insert, Erase };
+
+    Kind kind;
+    Path path;
+    Object value;
+  };
+
+  // Returns the operations required to turn the first tree into the second. Subtrees the two trees
+  // share, such as successive snapshots from a Watcher, are skipped without being looked at, so the
+  // time taken follows the size of the change. Unshared subtrees are compared node by node, so two
+  // trees parsed separately take time proportional to their size
+  Patch diff( const Object&, const Object& );
+
+  // Apply a patch in order. Throws if the patch does not match the tree
+  void apply( Object&, const Patch& );
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Publication of immutable trees to concurrent readers
+  class Snapshot
+  {
+    private:
+      // Published tree and its reference count. Defined in the implementation
+      struct Node;
+
+      // Readers part way through load(). Each count has a cache line of its own
+      struct alignas( 64 ) ReaderCount
+      {
+        std::atomic< long > count{ 0 };
+      };
+
+      std::atomic< Node* > _current;
+
+      // New readers join the group given here. A publish waits for each group to empty in turn
+      mutable std::atomic< unsigned > _group;
+      mutable ReaderCount _readers[2];
+
+      // Publishers are taken one at a time
+      std::mutex _publishing;
+
+      // Wait until no reader is part way through load() in a group
+      void _drain( unsigned ) const;
+
+      // Drop one reference, deleting the node with the last one
+      static void _release( Node* );
+
+    public:
+      // Holds a reference to a published tree. Trees are reclaimed when the last handle is dropped
+      class Handle
+      {
+        friend class Snapshot;
+
+        private:
+          Node* _node;
+
+          explicit Handle( Node* node ) : _node( node ) {}
+
+        public:
+          Handle() : _node( nullptr ) {}
+          Handle( const Handle& );
+          Handle( Handle&& );
+          Handle& operator=( Handle );
+          ~Handle();
+
+          // Access the tree. It must not be modified
+          const Object* get() const;
+          const Object& operator*() const { return *get(); }
+          const Object* operator->() const { return get(); }
+
+          explicit operator bool() const { return _node != nullptr; }
+      };
+
+      // Publish a null object
+      Snapshot();
+
+      // Publish the initial tree
+      explicit Snapshot( Object );
+
+      Snapshot( const Snapshot& ) = delete;
+      Snapshot& operator=( const Snapshot& ) = delete;
+
+      // All handles must be released or outlive the holder. No loads may be in progress
+      ~Snapshot();
+
+      // Never waits, whatever the publishers are doing. Returns a reference to the latest published tree
+      Handle load() const;
+
+      // Atomically replace the published tree. Readers holding the old one keep it until they drop it.
+      // Waits for loads already in progress, which take a few instructions, to finish
+      void publish( Object );
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Hot reloading of a file and all of its includes
+  class Watcher
+  {
+    public:
+      // Receives the paths in the root tree that changed
+      typedef std::function< void( const std::vector<Path>& ) > Callback;
+
+      // Receives the error if a changed file could not be reloaded
+      typedef std::function< void( const Exception& ) > ErrorCallback;
+
+    private:
+      // Where a file is included within another
+      struct Include
+      {
+        Path path;
+        std::string file;
+      };
+
+      // The parsed contents of a single file, with its includes already spliced in
+      struct Fragment
+      {
+        Object tree;
+        std::vector<Include> includes;
+        bool loading;
+      };
+
+      typedef std::map< std::string, Fragment > FragmentMap;
+
+      // The file at the root of the include tree
+      std::string _root;
+
+      // Every file in the include tree
+      FragmentMap _files;
+
+      // Inotify instance and the files watched through each directory watch
+      int _inotify;
+      std::map< int, std::vector< std::string > > _watches;
+
+      // The currently published tree
+      Snapshot _snapshot;
+
+      // Notification
+      std::mutex _callbackMutex;
+      std::vector< Callback > _callbacks;
+      ErrorCallback _errorCallback;
+
+      // Background polling
+      std::thread _thread;
+      std::atomic<bool> _running;
+
+      // Parse a single file, loading any includes not already known. Returns the tree it replaced
+      Object _load( const std::string& );
+
+      // Add the directory watch for a file
+      void _watch( const std::string& );
+
+      // Push a change to a file through everything that includes it
+      void _propagate( const std::string&, const Patch&, Patch& );
+
+      // Drop files that are no longer included from the root, and the watches only they needed
+      void _collect();
+
+      // Another holder of a tree. Only the root node is copied, the children are shared and copied
+      // when they are changed
+      static Object _share( const Object& );
+
+      // Publish the root tree. The published tree shares its children, which are copied when changed
+      void _publish();
+
+    public:
+      // Loads the root file and its includes. Throws if any of them fail to load
+      explicit Watcher( std::string );
+
+      Watcher( const Watcher& ) = delete;
+      Watcher& operator=( const Watcher& ) = delete;
+
+      // Stops the background thread and closes the inotify instance
+      ~Watcher();
+
+      // Return the latest published tree. Safe to call from any thread
+      Snapshot::Handle snapshot() const { return _snapshot.load(); }
+
+      // Register a callback for successful reloads
+      void addCallback( Callback );
+
+      // Register the callback for failed reloads
+      void setErrorCallback( ErrorCallback );
+
+      // Inotify descriptor, for use in an external event loop
+      int fileDescriptor() const { return _inotify; }
+
+      // Wait up to timeout milliseconds (negative blocks) for changes and reload them. Returns true if a new tree was published
+      bool poll( int );
+
+      // Poll on a background thread
+      void start();
+      void stop();
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Read-only view of several trees stacked on top of each other, such as a base config with
+  // environment and host overrides. Objects at the same path in different layers are merged key by
+  // key, while any other value hides everything below it in the lower layers. Paths are resolved
+  // through the layers as they are asked for and remembered. Merged objects share the values they
+  // take from a single layer with that layer, so values are never copied
+  class Overlay
+  {
+    private:
+      // What a path resolves to
+      struct Entry
+      {
+        // Nodes at the path, topmost layer first. More than one only when they are all objects
+        std::vector<const Object*> nodes;
+
+        // Keys of an object merged from several layers, counted when first asked for
+        size_t size = 0;
+        bool counted = false;
+
+        // Object merged from several layers, built when first asked for. Owned by _merged
+        Object* merged = nullptr;
+      };
+
+      // Bottom layer first. Not owned
+      std::vector<const Object*> _layers;
+
+      // Every path resolved so far, including the paths leading to them
+      mutable std::map< Path, Entry > _resolved;
+
+      // Every merged object built, kept until the overlay is destroyed so that references to them
+      // stay valid when layers are pushed
+      mutable std::vector<Object*> _merged;
+
+      // Resolve a path, and its parents, from the layers
+      Entry& _resolve( const Path& ) const;
+
+      // Resolve a path that must exist, throwing if it does not
+      Entry& _require( const Path& ) const;
+
+      // Build the merged object for a path resolved to several objects. Keys found in a single layer
+      // share that layer's node, and keys merged again share the merged object for their own path
+      Object* _build( const Path&, Entry& ) const;
+
+    public:
+      // No layers, where every path is missing
+      Overlay() {}
+
+      // Layers are given bottom first
+      Overlay( std::initializer_list< const Object* > );
+
+      Overlay( Overlay&& ) = default;
+      Overlay( const Overlay& ) = delete;
+      Overlay& operator=( const Overlay& ) = delete;
+
+      // Releases the merged objects
+      ~Overlay();
+
+      // Add a layer on top. Layers are referred to, not copied, and must outlive the overlay
+      // without being changed, or the resolved paths would go stale. Objects returned by get()
+      // before the push stay valid, but show the layers as they were
+      void push( const Object& );
+
+      // Number of layers
+      size_t layers() const { return _layers.size(); }
+
+      // Return true if any layer has a value at the path. Array items are given as decimal indices
+      bool has( const Path& ) const;
+
+      // Return the value at the path. An object spread over several layers is merged the first time
+      // it is asked for, and the same merged object is returned after that. Only the objects that
+      // are spread over several layers are built, everything else is shared with the layers. Valid
+      // until the overlay is destroyed. Throws if no layer has the path
+      const Object& get( const Path& ) const;
+
+      // As Object::getSize for the value at the path, counting the keys of every layer for merged
+      // objects. Throws if no layer has the path
+      size_t getSize( const Path& ) const;
+
+      // Merge every layer into a single tree. It shares its values with the layers, and copies them
+      // when they are changed through it
+      Object flatten() const;
+  };
+
 }
 
 #endif // CON_INCLUDE_FILE_H_
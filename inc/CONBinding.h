@@ -0,0 +1,430 @@
+#ifndef CON_BINDING_INCLUDE_FILE_H_
+#define CON_BINDING_INCLUDE_FILE_H_
+
+#include "CON.h"
+
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////
+  // Direct binding of C++ types to CON documents.
+  //
+  // A struct is bound by specialising Binding with a static members() function listing its keys:
+  //
+  //   template <> struct CON::Binding< Server >
+  //   {
+  //     static auto members() { return std::make_tuple( CON::member( "host", &Server::host ),
+  //                                                     CON::member( "port", &Server::port ) ); }
+  //   };
+  //
+  // Values are decoded straight from a Reader, no Object is built. Unknown keys are skipped and
+  // missing keys leave the member untouched. Members are written in the order they are listed.
+
+  template < class T >
+  struct Binding;
+
+
+  // A named member of a bound struct
+  template < class T, class M >
+  struct Member
+  {
+    const char* key;
+    M T::* pointer;
+  };
+
+  template < class T, class M >
+  Member< T, M > member( const char* key, M T::* pointer )
+  {
+    return Member< T, M >{ key, pointer };
+  }
+
+
+  // Reads and writes one type. The reader is positioned at the first event of the value
+  template < class T, class Enable = void >
+  struct Codec;
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Scalars
+
+  template < class T >
+  struct Codec< T, typename std::enable_if< std::is_integral< T >::value && ! std::is_same< T, bool >::value >::type >
+  {
+    static bool read( Reader& reader, T& value )
+    {
+      if ( reader.event() != Reader::Value || reader.type() != Type::Numeric )
+      {
+        reader.error( ParseError::WrongType, "an integer" );
+        return false;
+      }
+
+      const char* begin = reader.text().c_str();
+      char* end;
+      errno = 0;
+      bool fits;
+      if ( std::is_signed< T >::value )
+      {
+        long long number = std::strtoll( begin, &end, 10 );
+        fits = number >= static_cast< long long >( std::numeric_limits< T >::min() ) && number <= static_cast< long long >( std::numeric_limits< T >::max() );
+        value = static_cast< T >( number );
+      }
+      else
+      {
+        unsigned long long number = std::strtoull( begin, &end, 10 );
+        fits = *begin != '-' && number <= static_cast< unsigned long long >( std::numeric_limits< T >::max() );
+        value = static_cast< T >( number );
+      }
+
+      if ( *end != '\0' )
+      {
+        reader.error( ParseError::WrongType, "an integer" );
+        return false;
+      }
+      if ( errno != 0 || ! fits )
+      {
+        reader.error( ParseError::WrongType, "an integer in range" );
+        return false;
+      }
+      return true;
+    }
+
+    static void write( Writer& writer, const T& value )
+    {
+      if ( std::is_signed< T >::value )
+        writer.value( static_cast< long >( value ) );
+      else
+        writer.value( static_cast< unsigned long >( value ) );
+    }
+  };
+
+
+  template < class T >
+  struct Codec< T, typename std::enable_if< std::is_floating_point< T >::value >::type >
+  {
+    static bool read( Reader& reader, T& value )
+    {
+      if ( reader.event() != Reader::Value || reader.type() != Type::Numeric )
+      {
+        reader.error( ParseError::WrongType, "a number" );
+        return false;
+      }
+
+      value = static_cast< T >( std::strtod( reader.text().c_str(), nullptr ) );
+      return true;
+    }
+
+    static void write( Writer& writer, const T& value )
+    {
+      writer.value( static_cast< double >( value ) );
+    }
+  };
+
+
+  template <>
+  struct Codec< bool >
+  {
+    static bool read( Reader& reader, bool& value )
+    {
+      if ( reader.event() != Reader::Value || reader.type() != Type::Boolean )
+      {
+        reader.error( ParseError::WrongType, "a boolean" );
+        return false;
+      }
+
+      value = ( reader.text() == "true" );
+      return true;
+    }
+
+    static void write( Writer& writer, const bool& value )
+    {
+      writer.value( value );
+    }
+  };
+
+
+  template <>
+  struct Codec< std::string >
+  {
+    static bool read( Reader& reader, std::string& value )
+    {
+      if ( reader.event() != Reader::Value || reader.type() != Type::String )
+      {
+        reader.error( ParseError::WrongType, "a string" );
+        return false;
+      }
+
+      value = reader.text();
+      return true;
+    }
+
+    static void write( Writer& writer, const std::string& value )
+    {
+      writer.value( value );
+    }
+  };
+
+
+  // Untyped values fall back to a tree
+  template <>
+  struct Codec< Object >
+  {
+    static bool read( Reader& reader, Object& value )
+    {
+      return readValue( reader, value );
+    }
+
+    static void write( Writer& writer, const Object& value )
+    {
+      writer.value( value );
+    }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Containers
+
+  template < class T >
+  struct Codec< std::vector< T > >
+  {
+    static bool read( Reader& reader, std::vector< T >& value )
+    {
+      if ( reader.event() != Reader::BeginArray )
+      {
+        reader.error( ParseError::WrongType, "an array" );
+        return false;
+      }
+
+      value.clear();
+      while ( reader.next() != Reader::EndArray )
+      {
+        value.emplace_back();
+        if ( ! Codec< T >::read( reader, value.back() ) ) return false;
+      }
+      return true;
+    }
+
+    static void write( Writer& writer, const std::vector< T >& value )
+    {
+      writer.beginArray();
+      for ( typename std::vector< T >::const_iterator it = value.begin(); it != value.end(); ++it )
+      {
+        Codec< T >::write( writer, *it );
+      }
+      writer.end();
+    }
+  };
+
+
+  template < class T >
+  struct Codec< std::map< std::string, T > >
+  {
+    static bool read( Reader& reader, std::map< std::string, T >& value )
+    {
+      if ( reader.event() != Reader::BeginObject )
+      {
+        reader.error( ParseError::WrongType, "an object" );
+        return false;
+      }
+
+      value.clear();
+      while ( reader.next() == Reader::Key )
+      {
+        T& item = value[ reader.text() ];
+        reader.next();
+        if ( ! Codec< T >::read( reader, item ) ) return false;
+      }
+      return reader.event() == Reader::EndObject;
+    }
+
+    static void write( Writer& writer, const std::map< std::string, T >& value )
+    {
+      writer.beginObject();
+      for ( typename std::map< std::string, T >::const_iterator it = value.begin(); it != value.end(); ++it )
+      {
+        writer.key( it->first );
+        Codec< T >::write( writer, it->second );
+      }
+      writer.end();
+    }
+  };
+
+
+  // Null, or a missing key, leaves the optional empty
+  template < class T >
+  struct Codec< std::optional< T > >
+  {
+    static bool read( Reader& reader, std::optional< T >& value )
+    {
+      if ( reader.event() == Reader::Value && reader.type() == Type::Null )
+      {
+        value.reset();
+        return true;
+      }
+
+      value.emplace();
+      return Codec< T >::read( reader, *value );
+    }
+
+    static void write( Writer& writer, const std::optional< T >& value )
+    {
+      if ( value )
+        Codec< T >::write( writer, *value );
+      else
+        writer.null();
+    }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Bound structs
+
+  template < class T >
+  struct Codec< T, std::void_t< decltype( Binding< T >::members() ) > >
+  {
+    template < class M >
+    static bool readMember( Reader& reader, M& member )
+    {
+      reader.next();
+      return Codec< M >::read( reader, member );
+    }
+
+    template < class M >
+    static void writeMember( Writer& writer, const char* key, const M& member )
+    {
+      writer.key( key );
+      Codec< M >::write( writer, member );
+    }
+
+    // Decode the key's value into the matching member. Returns false if the key is not bound
+    template < class Tuple, size_t... I >
+    static bool readMembers( Reader& reader, T& value, const std::string& key, const Tuple& members, bool& success, std::index_sequence< I... > )
+    {
+      bool found = false;
+      ( ( ( ! found && key == std::get< I >( members ).key ) ? ( found = true, success = readMember( reader, value.*( std::get< I >( members ).pointer ) ) ) : false ), ... );
+      return found;
+    }
+
+    template < class Tuple, size_t... I >
+    static void writeMembers( Writer& writer, const T& value, const Tuple& members, std::index_sequence< I... > )
+    {
+      ( writeMember( writer, std::get< I >( members ).key, value.*( std::get< I >( members ).pointer ) ), ... );
+    }
+
+    static bool read( Reader& reader, T& value )
+    {
+      if ( reader.event() != Reader::BeginObject )
+      {
+        reader.error( ParseError::WrongType, "an object" );
+        return false;
+      }
+
+      const auto members = Binding< T >::members();
+      typedef std::make_index_sequence< std::tuple_size< typename std::decay< decltype( members ) >::type >::value > Indices;
+
+      while ( reader.next() == Reader::Key )
+      {
+        bool success = true;
+        if ( ! readMembers( reader, value, reader.text(), members, success, Indices() ) )
+        {
+          reader.skip();
+        }
+        if ( ! success ) return false;
+      }
+      return reader.event() == Reader::EndObject;
+    }
+
+    static void write( Writer& writer, const T& value )
+    {
+      const auto members = Binding< T >::members();
+      typedef std::make_index_sequence< std::tuple_size< typename std::decay< decltype( members ) >::type >::value > Indices;
+
+      writer.beginObject();
+      writeMembers( writer, value, members, Indices() );
+      writer.end();
+    }
+  };
+
+
+////////////////////////////////////////////////////////////////////////////////
+  // Creation and writing functions for bound types
+
+  // Decode the whole document into the value. Returns false and fills the error list on failure
+  template < class T >
+  bool tryBindFromStream( std::istream& input, T& value, ErrorList& errors, const ParseOptions& options = ParseOptions() )
+  {
+    Reader reader( input, options );
+    bool success = reader.next() != Reader::Error && Codec< T >::read( reader, value );
+    errors = reader.errors();
+    return success && errors.empty();
+  }
+
+
+  template < class T >
+  T bindFromStream( std::istream& input, const ParseOptions& options = ParseOptions() )
+  {
+    T value = T();
+    ErrorList errors;
+    if ( ! tryBindFromStream( input, value, errors, options ) )
+    {
+      throw Exception( std::move( errors ) );
+    }
+    return value;
+  }
+
+
+  template < class T >
+  T bindFromFile( std::string filename, const ParseOptions& options = ParseOptions() )
+  {
+    InputFile infile( filename );
+    if ( ! infile.is_open() )
+    {
+      throw Exception( std::string( "Failed to open file \"" ) + filename + "\"" );
+    }
+
+    T value = T();
+    ErrorList errors;
+    bool bound = tryBindFromStream( infile, value, errors, options );
+    if ( ! infile.error().empty() )
+    {
+      errors.insert( errors.begin(), ParseError{ ParseError::DecompressionFailed, ParseError::npos, filename, std::string(), infile.error(), nullptr } );
+      bound = false;
+    }
+
+    if ( ! bound )
+    {
+      Exception ex( std::move( errors ) );
+      ex.setFilename( filename );
+      throw ex;
+    }
+    return value;
+  }
+
+
+  template < class T >
+  void bindToStream( const T& value, std::ostream& output, Format format = Format::Pretty )
+  {
+    Writer writer( output, format );
+    Codec< T >::write( writer, value );
+  }
+
+
+  template < class T >
+  void bindToString( const T& value, std::string& output, Format format = Format::Pretty )
+  {
+    Writer writer( output, format );
+    Codec< T >::write( writer, value );
+  }
+
+}
+
+#endif // CON_BINDING_INCLUDE_FILE_H_
+
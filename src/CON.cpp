@@ -2,18 +2,54 @@
 #include "CON.h"
 
 #include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+
+#if defined( __SSE2__ ) && ! defined( CON_NO_SIMD )
+#include <emmintrin.h>
+#endif
 
 #ifndef CON_BUFFER_SIZE
 #define CON_BUFFER_SIZE 5000
 #endif
 
+// Output is flushed to the stream once this many bytes are buffered
+#ifndef CON_WRITE_BUFFER_SIZE
+#define CON_WRITE_BUFFER_SIZE 65536
+#endif
+
+// Objects with up to this many keys keep them in a sorted array instead of a tree
+#ifndef CON_SMALL_OBJECT_SIZE
+#define CON_SMALL_OBJECT_SIZE 8
+#endif
+
+// Parallel writing splits arrays longer than this into slices of this many elements
+#ifndef CON_PARALLEL_SLICE_SIZE
+#define CON_PARALLEL_SLICE_SIZE 4096
+#endif
+
+// Parallel writing batches up to this many consecutive top level members into one task
+#ifndef CON_PARALLEL_GROUP_SIZE
+#define CON_PARALLEL_GROUP_SIZE 64
+#endif
+
 namespace CON
 {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
   // Some useful function declarations
 
-  bool validateNumeric( std::string );
+  bool validateNumeric( const std::string& );
+
+  void printValue( const Object&, OutputBuffer& );
+
+  size_t parsePathIndex( const std::string&, const std::string& );
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -24,9 +60,14 @@ namespace CON
     _what(),
     _parseError( true )
   {
-    std::stringstream ss;
-    ss << "Found " << _errors.size() << " parse errors";
-    _what = ss.str();
+  }
+
+
+  Exception::Exception( ErrorList&& errors ) :
+    _errors( std::move( errors ) ),
+    _what(),
+    _parseError( true )
+  {
   }
 
 
@@ -40,6 +81,14 @@ namespace CON
 
   const char* Exception::what() const noexcept
   {
+    if ( _parseError && _what.empty() )
+    {
+      _what = std::string( "Found " ) + std::to_string( _errors.size() ) + " parse errors";
+      if ( ! _filename.empty() )
+      {
+        _what += std::string( " from file: " ) + _filename;
+      }
+    }
     return _what.c_str();
   }
 
@@ -47,9 +96,317 @@ namespace CON
   void Exception::setFilename( std::string file )
   {
     _filename = file;
-    _what += std::string( " from file: " ) + _filename;
+    if ( _parseError )
+    {
+      _what.clear();
+      for ( ErrorList::iterator it = _errors.begin(); it != _errors.end(); ++it )
+      {
+        if ( it->file.empty() ) it->file = _filename;
+      }
+    }
+    else
+    {
+      _what += std::string( " from file: " ) + _filename;
+    }
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Parse error function definitions
+
+  size_t ParseError::line() const
+  {
+    if ( offset == npos || ! newlines )
+    {
+      return 0;
+    }
+
+    return linesBefore + ( std::lower_bound( newlines->begin(), newlines->end(), offset ) - newlines->begin() ) + 1;
+  }
+
+
+  size_t ParseError::column() const
+  {
+    if ( offset == npos || ! newlines )
+    {
+      return 0;
+    }
+
+    std::vector<size_t>::const_iterator found = std::lower_bound( newlines->begin(), newlines->end(), offset );
+    if ( found == newlines->begin() )
+    {
+      return offset + 1;
+    }
+    return offset - *(--found);
+  }
+
+
+  std::string ParseError::message() const
+  {
+    std::string text( "Error" );
+    if ( ! file.empty() )
+    {
+      text += " in \"" + file + "\"";
+    }
+    if ( offset != npos && newlines )
+    {
+      text += " on line " + std::to_string( line() ) + ", column " + std::to_string( column() );
+    }
+    text += ": ";
+
+    switch ( code )
+    {
+      case Custom :
+        text += detail;
+        break;
+      case FileNotOpened :
+        text += "Failed to open file \"" + detail + "\"";
+        break;
+      case RootNotFound :
+        text += "Could not find root object in data stream";
+        break;
+      case InvalidRoot :
+        text += "Invalid root value";
+        break;
+      case UnexpectedEnd :
+        text += "Unexpected end of file";
+        break;
+      case InvalidIdentifier :
+        text += "Valid identifier expected";
+        break;
+      case ExpectedColon :
+        text += "Colon expected following identifier: " + identifier;
+        break;
+      case ExpectedValue :
+        text += "Value expected for identifier " + identifier;
+        break;
+      case InvalidExpression :
+        text += "Invalid expression. Must be boolean, numeric or string: " + detail;
+        break;
+      case InvalidValue :
+        text += "Invalid value for identifier " + identifier;
+        break;
+      case ExpectedComma :
+        text += "Expected either comma or closing bracket";
+        break;
+      case UnclosedObject :
+        text += "Closing bracket not found";
+        break;
+      case UnexpectedArrayEnd :
+        text += "Array ended unexpectedly";
+        break;
+      case InvalidArrayItem :
+        text += "Expected valid value type, object or array within array defitinition";
+        break;
+      case ExpectedArrayComma :
+        text += "Expected comma or closing bracket following array item";
+        break;
+      case UnclosedArray :
+        text += "Closing square bracket not found";
+        break;
+      case UnterminatedString :
+        text += "Unterminated string";
+        break;
+      case UnterminatedFilepath :
+        text += "Unterminated file path";
+        break;
+      case InvalidUnicode :
+        text += "Invalid unicode escape";
+        break;
+      case InvalidSurrogate :
+        text += "Invalid unicode surrogate pair";
+        break;
+      case IncludeFailed :
+        text += "Include for identifier " + identifier + " failed: " + detail;
+        break;
+      case WrongType :
+        text += "Wrong type for identifier " + identifier + ", expected " + detail;
+        break;
+      case SchemaType :
+        text += "Schema expects " + detail + " for identifier " + identifier;
+        break;
+      case SchemaRange :
+        text += "Schema expects a value " + detail + " for identifier " + identifier;
+        break;
+      case SchemaMissingKey :
+        text += "Schema requires key " + detail + ( identifier.empty() ? std::string( " in the root object" ) : " in identifier " + identifier );
+        break;
+      case SchemaUnexpectedKey :
+        text += "Schema does not allow identifier " + identifier;
+        break;
+      case SchemaSize :
+        text += "Schema expects " + detail + " items in identifier " + identifier;
+        break;
+      case InvalidUtf8 :
+        text += "Invalid UTF-8 sequence in string";
+        break;
+      case DecompressionFailed :
+        text += "Failed to decompress input: " + detail;
+        break;
+      case InvalidAnchor :
+        text += "Anchor " + detail + " must name an object, array or include";
+        break;
+      case UnknownAnchor :
+        text += "Reference to unknown anchor " + detail;
+        break;
+    }
+
+    text += '.';
+    return text;
+  }
+
+
+  std::ostream& operator<<( std::ostream& os, const ParseError& error )
+  {
+    return os << error.message();
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Children member function definitions
+
+  void Children::_grow()
+  {
+    _tree.reset( new Tree() );
+    for ( std::vector<Entry>::iterator it = _flat.begin(); it != _flat.end(); ++it )
+    {
+      _tree->emplace_hint( _tree->end(), Entry{ std::move( it->first ), it->second } );
+    }
+    std::vector<Entry>().swap( _flat );
+  }
+
+
+  Children::const_iterator Children::find( const std::string& key ) const
+  {
+    if ( _tree ) return const_iterator( _tree->find( key ) );
+
+    for ( std::vector<Entry>::const_iterator it = _flat.begin(); it != _flat.end(); ++it )
+    {
+      if ( it->first == key ) return const_iterator( &*it );
+    }
+    return end();
+  }
+
+
+  Object*& Children::operator[]( const std::string& key )
+  {
+    if ( ! _tree )
+    {
+      std::vector<Entry>::iterator it = _flat.begin();
+      int order = 1;
+      while ( it != _flat.end() && ( order = it->first.compare( key ) ) < 0 ) ++it;
+      if ( it != _flat.end() && order == 0 ) return it->second;
+
+      if ( _flat.size() < CON_SMALL_OBJECT_SIZE )
+      {
+        return _flat.insert( it, Entry{ key, nullptr } )->second;
+      }
+      _grow();
+    }
+
+    Tree::iterator found = _tree->lower_bound( key );
+    if ( found != _tree->end() && found->first == key ) return found->second;
+    return _tree->emplace_hint( found, Entry{ key, nullptr } )->second;
+  }
+
+
+  Object*& Children::append( std::string key, Object* value )
+  {
+    // Lookups, merges and the writers all rely on the entries staying sorted
+    assert( empty() || std::prev( end() )->first < key );
+
+    if ( ! _tree )
+    {
+      if ( _flat.size() < CON_SMALL_OBJECT_SIZE )
+      {
+        _flat.push_back( Entry{ std::move( key ), value } );
+        return _flat.back().second;
+      }
+      _grow();
+    }
+    return _tree->emplace_hint( _tree->end(), Entry{ std::move( key ), value } )->second;
+  }
+
+
+  Object*& Children::take( Children& from, const_iterator it )
+  {
+    if ( from._tree && _tree )
+    {
+      Tree::node_type node = from._tree->extract( it._node );
+      return _tree->insert( _tree->end(), std::move( node ) )->second;
+    }
+
+    Entry entry;
+    if ( from._tree )
+    {
+      Tree::node_type node = from._tree->extract( it._node );
+      entry = std::move( node.value() );
+    }
+    else
+    {
+      std::vector<Entry>::iterator at = from._flat.begin() + ( it._entry - from._flat.data() );
+      entry = std::move( *at );
+      from._flat.erase( at );
+    }
+
+    // Usually in order, when reloading what the writer wrote
+    if ( empty() || ( --end() )->first < entry.first ) return append( std::move( entry.first ), entry.second );
+
+    Object*& slot = (*this)[ entry.first ];
+    slot = entry.second;
+    return slot;
+  }
+
+
+  void Children::erase( const_iterator it )
+  {
+    if ( _tree )
+    {
+      _tree->erase( it._node );
+    }
+    else
+    {
+      _flat.erase( _flat.begin() + ( it._entry - _flat.data() ) );
+    }
+  }
+
+
+  void Children::clear()
+  {
+    _flat.clear();
+    _tree.reset();
+  }
+
+
+  void Children::reserve( size_t size )
+  {
+    if ( size > CON_SMALL_OBJECT_SIZE )
+    {
+      if ( ! _tree && _flat.empty() ) _tree.reset( new Tree() );
+    }
+    else if ( ! _tree )
+    {
+      _flat.reserve( size );
+    }
+  }
+
+
+  // A red-black tree node holds a colour and three pointers before the entry
+  const size_t treeNodeBytes = sizeof( Children::Entry ) + 4 * sizeof( void* );
+
+
+  size_t Children::heapBytes() const
+  {
+    return _tree ? sizeof( Tree ) + _tree->size() * treeNodeBytes : _flat.capacity() * sizeof( Entry );
   }
 
+
+  size_t Children::allocations() const
+  {
+    return _tree ? 1 + _tree->size() : ( _flat.capacity() > 0 ? 1 : 0 );
+  }
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
   // CON Object member function definitions
 
@@ -57,7 +414,8 @@ namespace CON
     _children(),
     _array(),
     _value(),
-    _type( Type::Null )
+    _type( Type::Null ),
+    _shares( 0 )
   {
   }
 
@@ -66,7 +424,8 @@ namespace CON
     _children(),
     _array(),
     _value(),
-    _type( t )
+    _type( t ),
+    _shares( 0 )
   {
   }
 
@@ -75,16 +434,11 @@ namespace CON
     _children(),
     _array(),
     _value( other._value ),
-    _type( other._type )
+    _type( other._type ),
+    _shares( 0 )
   {
-    for ( ObjectMap::const_iterator it = other._children.begin(); it != other._children.end() ; ++it )
-    {
-      _children[it->first] = new Object( *it->second );
-    }
-    for ( Array::const_iterator it = other._array.begin(); it != other._array.end() ; ++it )
-    {
-      _array.push_back( new Object( *(*it) ) );
-    }
+    Copies copies;
+    _copyChildren( other, copies );
   }
 
 
@@ -92,35 +446,32 @@ namespace CON
     _children( std::move( other._children ) ),
     _array( std::move( other._array ) ),
     _value( std::move( other._value ) ),
-    _type( std::move( other._type ) )
+    _type( std::move( other._type ) ),
+    _shares( 0 )
   {
   }
 
 
   Object& Object::operator=( const Object& other )
   {
+    if ( this == &other ) return *this;
+
     for ( ObjectMap::iterator it = _children.begin(); it != _children.end() ; ++it )
     {
-      delete it->second;
+      _release( it->second );
     }
     _children.clear();
     for ( Array::iterator it = _array.begin(); it != _array.end() ; ++it )
     {
-      delete *it;
+      _release( *it );
     }
     _array.clear();
 
     _value = other._value;
     _type = other._type;
 
-    for ( ObjectMap::const_iterator it = other._children.begin(); it != other._children.end() ; ++it )
-    {
-      _children[it->first] = new Object( *it->second );
-    }
-    for ( Array::iterator it = _array.begin(); it != _array.end() ; ++it )
-    {
-      _array.push_back( new Object( *(*it) ) );
-    }
+    Copies copies;
+    _copyChildren( other, copies );
 
     return *this;
   }
@@ -130,12 +481,12 @@ namespace CON
   {
     for ( ObjectMap::iterator it = _children.begin(); it != _children.end() ; ++it )
     {
-      delete it->second;
+      _release( it->second );
     }
     _children.clear();
     for ( Array::iterator it = _array.begin(); it != _array.end() ; ++it )
     {
-      delete *it;
+      _release( *it );
     }
     _array.clear();
 
@@ -153,17 +504,100 @@ namespace CON
   {
     for ( ObjectMap::iterator it = _children.begin(); it != _children.end(); ++it )
     {
-      delete it->second;
+      _release( it->second );
     }
     _children.clear();
     for ( Array::iterator it = _array.begin(); it != _array.end() ; ++it )
     {
-      delete *it;
+      _release( *it );
     }
     _array.clear();
   }
 
 
+  void Object::_copyChildren( const Object& other, Copies& copies )
+  {
+    _children.reserve( other._children.size() );
+    for ( ObjectMap::const_iterator it = other._children.begin(); it != other._children.end() ; ++it )
+    {
+      _children.append( it->first, _copy( it->second, copies ) );
+    }
+    _array.reserve( other._array.size() );
+    for ( Array::const_iterator it = other._array.begin(); it != other._array.end() ; ++it )
+    {
+      _array.push_back( _copy( *it, copies ) );
+    }
+  }
+
+
+  Object* Object::_copy( const Object* source, Copies& copies )
+  {
+    if ( source->_shares > 0 )
+    {
+      Copies::iterator found = copies.find( source );
+      if ( found != copies.end() )
+      {
+        ++found->second->_shares;
+        return found->second;
+      }
+    }
+
+    Object* copy = new Object( source->_type );
+    copy->_value = source->_value;
+    copy->_copyChildren( *source, copies );
+
+    if ( source->_shares > 0 ) copies[source] = copy;
+    return copy;
+  }
+
+
+  void Object::_shareChildren( const Object& other )
+  {
+    _children.reserve( other._children.size() );
+    for ( ObjectMap::const_iterator it = other._children.begin(); it != other._children.end() ; ++it )
+    {
+      it->second->_shares.fetch_add( 1, std::memory_order_relaxed );
+      _children.append( it->first, it->second );
+    }
+    _array.reserve( other._array.size() );
+    for ( Array::const_iterator it = other._array.begin(); it != other._array.end() ; ++it )
+    {
+      (*it)->_shares.fetch_add( 1, std::memory_order_relaxed );
+      _array.push_back( *it );
+    }
+  }
+
+
+  void Object::_release( Object* object )
+  {
+    // Another holder may be releasing the node on a different thread
+    uint32_t shares = object->_shares.load( std::memory_order_acquire );
+    while ( shares > 0 && ! object->_shares.compare_exchange_weak( shares, shares - 1, std::memory_order_acq_rel, std::memory_order_acquire ) );
+
+    if ( shares == 0 )
+    {
+      delete object;
+    }
+  }
+
+
+  Object* Object::_unshare( Object*& slot )
+  {
+    if ( slot->_shares.load( std::memory_order_acquire ) > 0 )
+    {
+      Object* copy = new Object( slot->_type );
+
+      // The anchor name belongs to the shared node
+      if ( copy->_type != Type::Object && copy->_type != Type::Array ) copy->_value = slot->_value;
+      copy->_shareChildren( *slot );
+
+      _release( slot );
+      slot = copy;
+    }
+    return slot;
+  }
+
+
   size_t Object::getSize() const
   {
     switch( _type )
@@ -190,31 +624,156 @@ namespace CON
   }
 
 
-  void Object::setType( Type type )
+  // Strings beyond the small string buffer own a heap block of their capacity
+  size_t stringHeapBytes( const std::string& string )
   {
-    if ( _type == type ) return;
-    switch( _type )
-    {
-      case Type::Null :
-        break;
+    return ( string.capacity() > std::string().capacity() ) ? string.capacity() + 1 : 0;
+  }
 
-      case Type::String :
-      case Type::Numeric :
-      case Type::Boolean :
-        switch ( type )
-        {
-          case Type::String :
-          case Type::Numeric :
-          case Type::Boolean :
-            break;
 
-          case Type::Null :
-          case Type::Array :
-          case Type::Object :
-            _value.clear();
-            break;
-        }
-        break;
+  // Heaviest first, ties in path order
+  bool heavierPath( const MemoryUsage::Path& a, const MemoryUsage::Path& b )
+  {
+    return a.bytes > b.bytes || ( a.bytes == b.bytes && a.path < b.path );
+  }
+
+
+  MemoryUsage Object::memoryUsage( size_t top ) const
+  {
+    MemoryUsage usage;
+    std::string path;
+    std::set<const Object*> counted;
+
+    usage.objects += sizeof( Object );
+    usage.bytes[ static_cast<size_t>( _type ) ] += sizeof( Object );
+    _memoryUsage( usage, path, top, counted );
+
+    std::sort_heap( usage.heaviest.begin(), usage.heaviest.end(), heavierPath );
+    return usage;
+  }
+
+
+  size_t Object::_memoryUsage( MemoryUsage& usage, std::string& path, size_t top, std::set<const Object*>& counted ) const
+  {
+    // The head is counted by the parent, which allocated it
+    size_t own = stringHeapBytes( _value );
+    size_t total = sizeof( Object ) + own;
+    size_t length = path.size();
+
+    usage.strings += own;
+    ++usage.count[ static_cast<size_t>( _type ) ];
+
+    size_t index = _children.heapBytes();
+    usage.mapNodes += index;
+    own += index;
+    total += index;
+
+    for ( ObjectMap::const_iterator it = _children.begin(); it != _children.end(); ++it )
+    {
+      size_t key = stringHeapBytes( it->first );
+      usage.strings += key;
+      own += key;
+      total += key;
+
+      if ( it->second->_shares > 0 && ! counted.insert( it->second ).second ) continue;
+      usage.objects += sizeof( Object );
+      usage.bytes[ static_cast<size_t>( it->second->_type ) ] += sizeof( Object );
+
+      if ( length > 0 ) path.push_back( '/' );
+      path.append( it->first );
+      total += it->second->_memoryUsage( usage, path, top, counted );
+      path.resize( length );
+    }
+
+    size_t buffer = _array.capacity() * sizeof( Object* );
+    usage.arrays += buffer;
+    own += buffer;
+    total += buffer;
+
+    for ( size_t i = 0; i < _array.size(); ++i )
+    {
+      if ( _array[i]->_shares > 0 && ! counted.insert( _array[i] ).second ) continue;
+      usage.objects += sizeof( Object );
+      usage.bytes[ static_cast<size_t>( _array[i]->_type ) ] += sizeof( Object );
+
+      if ( length > 0 ) path.push_back( '/' );
+      path.append( std::to_string( i ) );
+      total += _array[i]->_memoryUsage( usage, path, top, counted );
+      path.resize( length );
+    }
+
+    usage.bytes[ static_cast<size_t>( _type ) ] += own;
+
+    // Keep the heaviest subtrees in a heap with the lightest on top
+    if ( top > 0 && length > 0 )
+    {
+      std::vector<MemoryUsage::Path>& heaviest = usage.heaviest;
+
+      if ( heaviest.size() < top )
+      {
+        heaviest.push_back( MemoryUsage::Path{ path, total } );
+        std::push_heap( heaviest.begin(), heaviest.end(), heavierPath );
+      }
+      else if ( heavierPath( MemoryUsage::Path{ path, total }, heaviest.front() ) )
+      {
+        std::pop_heap( heaviest.begin(), heaviest.end(), heavierPath );
+        heaviest.back() = MemoryUsage::Path{ path, total };
+        std::push_heap( heaviest.begin(), heaviest.end(), heavierPath );
+      }
+    }
+
+    return total;
+  }
+
+
+  std::ostream& operator<<( std::ostream& os, const MemoryUsage& usage )
+  {
+    static const char* types[] = { "null", "string", "numeric", "boolean", "array", "object" };
+
+    os << "Total : " << usage.total() << " bytes\n";
+    os << "  objects " << usage.objects << ", children " << usage.mapNodes << ", arrays " << usage.arrays << ", strings " << usage.strings << '\n';
+    for ( size_t i = 0; i < 6; ++i )
+    {
+      os << "  " << types[i] << " : " << usage.count[i] << " nodes, " << usage.bytes[i] << " bytes\n";
+    }
+
+    if ( ! usage.heaviest.empty() )
+    {
+      os << "Heaviest :\n";
+      for ( std::vector<MemoryUsage::Path>::const_iterator it = usage.heaviest.begin(); it != usage.heaviest.end(); ++it )
+      {
+        os << "  " << it->path << " : " << it->bytes << " bytes\n";
+      }
+    }
+    return os;
+  }
+
+
+  void Object::setType( Type type )
+  {
+    if ( _type == type ) return;
+    switch( _type )
+    {
+      case Type::Null :
+        break;
+
+      case Type::String :
+      case Type::Numeric :
+      case Type::Boolean :
+        switch ( type )
+        {
+          case Type::String :
+          case Type::Numeric :
+          case Type::Boolean :
+            break;
+
+          case Type::Null :
+          case Type::Array :
+          case Type::Object :
+            _value.clear();
+            break;
+        }
+        break;
 
       case Type::Array :
         switch ( type )
@@ -229,7 +788,7 @@ namespace CON
           case Type::Object :
             for ( Array::iterator it = _array.begin(); it != _array.end() ; ++it )
             {
-              delete *it;
+              _release( *it );
             }
             _array.clear();
             break;
@@ -249,7 +808,7 @@ namespace CON
           case Type::Array :
             for ( ObjectMap::iterator it = _children.begin(); it != _children.end(); ++it )
             {
-              delete it->second;
+              _release( it->second );
             }
             _children.clear();
             break;
@@ -320,13 +879,34 @@ namespace CON
     ObjectMap::iterator found = _children.find( name );
     if ( found != _children.end() )
     {
-      delete found->second;
-      found->second = new Object( obj );
+      _release( found->second );
+      found->second = new Object( std::move( obj ) );
     }
     else
     {
-      _children[name] = new Object( obj );
+      _children[name] = new Object( std::move( obj ) );
+    }
+  }
+
+
+  void Object::removeChild( std::string name )
+  {
+    if ( _type != Type::Object )
+    {
+      throw Exception( "Calling removeChild(identifier) when not an object type" );
+    }
+
+    ObjectMap::iterator found = _children.find( name );
+    if ( found == _children.end() )
+    {
+      std::string string = "Could not find identifier \"";
+      string += name;
+      string += "\" in children";
+      throw Exception( string );
     }
+
+    _release( found->second );
+    _children.erase( found );
   }
 
 
@@ -488,6 +1068,73 @@ namespace CON
   }
 
 
+  bool Object::tryAsLong( long& result ) const
+  {
+    if ( _type != Type::Numeric )
+    {
+      return false;
+    }
+
+    const char* begin = _value.c_str();
+    char* end;
+    errno = 0;
+    long number = std::strtol( begin, &end, 10 );
+    if ( errno != 0 || end == begin || *end != '\0' )
+    {
+      return false;
+    }
+
+    result = number;
+    return true;
+  }
+
+
+  bool Object::tryAsInt( int& result ) const
+  {
+    long number;
+    if ( ! tryAsLong( number ) || number < INT_MIN || number > INT_MAX )
+    {
+      return false;
+    }
+
+    result = static_cast<int>( number );
+    return true;
+  }
+
+
+  bool Object::tryAsDouble( double& result ) const
+  {
+    if ( _type != Type::Numeric )
+    {
+      return false;
+    }
+
+    const char* begin = _value.c_str();
+    char* end;
+    errno = 0;
+    double number = std::strtod( begin, &end );
+    if ( errno == ERANGE || end == begin || *end != '\0' )
+    {
+      return false;
+    }
+
+    result = number;
+    return true;
+  }
+
+
+  bool Object::tryAsBool( bool& result ) const
+  {
+    if ( _type != Type::Boolean )
+    {
+      return false;
+    }
+
+    result = ( _value == "true" );
+    return true;
+  }
+
+
   Object& Object::get( std::string identifier )
   {
     if ( _type != Type::Object )
@@ -504,7 +1151,7 @@ namespace CON
       throw Exception( string );
     }
 
-    return *found->second;
+    return *_unshare( found->second );
   }
 
 
@@ -535,14 +1182,14 @@ namespace CON
       throw Exception( "Calling get(size_t) when not an array type" );
     }
 
-    if ( id > _array.size() )
+    if ( id >= _array.size() )
     {
       std::stringstream string;
       string << "Array index " << id << " outside array bounds: " << _array.size();
       throw Exception( string.str() );
     }
 
-    return *_array[id];
+    return *_unshare( _array[id] );
   }
 
 
@@ -553,7 +1200,7 @@ namespace CON
       throw Exception( "Calling get(size_t) when not an array type" );
     }
 
-    if ( id > _array.size() )
+    if ( id >= _array.size() )
     {
       std::stringstream string;
       string << "Array index " << id << " outside array bounds: " << _array.size();
@@ -564,6 +1211,105 @@ namespace CON
   }
 
 
+  Object* Object::find( const std::string& identifier )
+  {
+    if ( _type != Type::Object )
+    {
+      return nullptr;
+    }
+
+    ObjectMap::iterator found = _children.find( identifier );
+    return ( found == _children.end() ) ? nullptr : _unshare( found->second );
+  }
+
+
+  const Object* Object::find( const std::string& identifier ) const
+  {
+    if ( _type != Type::Object )
+    {
+      return nullptr;
+    }
+
+    ObjectMap::const_iterator found = _children.find( identifier );
+    return ( found == _children.end() ) ? nullptr : found->second;
+  }
+
+
+  Object* Object::find( size_t id )
+  {
+    if ( _type != Type::Array || id >= _array.size() )
+    {
+      return nullptr;
+    }
+
+    return _unshare( _array[id] );
+  }
+
+
+  const Object* Object::find( size_t id ) const
+  {
+    if ( _type != Type::Array || id >= _array.size() )
+    {
+      return nullptr;
+    }
+
+    return _array[id];
+  }
+
+
+  int Object::getOr( const std::string& identifier, int def ) const
+  {
+    const Object* child = find( identifier );
+    int result = def;
+    if ( child != nullptr ) child->tryAsInt( result );
+    return result;
+  }
+
+
+  long Object::getOr( const std::string& identifier, long def ) const
+  {
+    const Object* child = find( identifier );
+    long result = def;
+    if ( child != nullptr ) child->tryAsLong( result );
+    return result;
+  }
+
+
+  double Object::getOr( const std::string& identifier, double def ) const
+  {
+    const Object* child = find( identifier );
+    double result = def;
+    if ( child != nullptr ) child->tryAsDouble( result );
+    return result;
+  }
+
+
+  bool Object::getOr( const std::string& identifier, bool def ) const
+  {
+    const Object* child = find( identifier );
+    bool result = def;
+    if ( child != nullptr ) child->tryAsBool( result );
+    return result;
+  }
+
+
+  std::string Object::getOr( const std::string& identifier, const std::string& def ) const
+  {
+    const Object* child = find( identifier );
+    if ( child != nullptr && child->_type == Type::String )
+    {
+      return child->_value;
+    }
+    return def;
+  }
+
+
+  std::string Object::getOr( const std::string& identifier, const char* def ) const
+  {
+    return getOr( identifier, std::string( def ) );
+  }
+
+
   void Object::push( Object& obj )
   {
     setType( Type::Array );
@@ -571,6 +1317,13 @@ namespace CON
   }
 
 
+  void Object::push( Object&& obj )
+  {
+    setType( Type::Array );
+    _array.push_back( new Object( std::move( obj ) ) );
+  }
+
+
   void Object::push( std::string s )
   {
     setType( Type::Array );
@@ -625,6 +1378,40 @@ namespace CON
   }
 
 
+  void Object::insert( size_t id, const Object& obj )
+  {
+    setType( Type::Array );
+
+    if ( id > _array.size() )
+    {
+      std::stringstream string;
+      string << "Array index " << id << " outside array bounds: " << _array.size();
+      throw Exception( string.str() );
+    }
+
+    _array.insert( _array.begin() + id, new Object( obj ) );
+  }
+
+
+  void Object::erase( size_t id )
+  {
+    if ( _type != Type::Array )
+    {
+      throw Exception( "Calling erase(size_t) when not an array type" );
+    }
+
+    if ( id >= _array.size() )
+    {
+      std::stringstream string;
+      string << "Array index " << id << " outside array bounds: " << _array.size();
+      throw Exception( string.str() );
+    }
+
+    _release( _array[id] );
+    _array.erase( _array.begin() + id );
+  }
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
   // Comparison operators
 
@@ -710,915 +1497,3757 @@ namespace CON
 
     std::string string;
     Type type;
-    size_t lineNumber;
+
+    // Byte offset of the start of the token
+    size_t offset;
   };
 
 
-  // Turn a vector of tokens into a complete object tree
-  Object parseTokens( std::vector<Token>::iterator&, std::vector<Token>::iterator&, ErrorList& );
+  // Collects the errors for one input, up to the limit. Records where the newlines are so the
+  // errors can work out their line and column later
+  class Diagnostics
+  {
+    private:
+      ErrorList& _errors;
+      size_t _limit;
+      std::string _file;
+      std::shared_ptr< std::vector<size_t> > _newlines;
 
-  void parseArray( std::vector<Token>::iterator&, std::vector<Token>::iterator&, ErrorList&, Object& );
+      // Newlines dropped from the front of the index
+      size_t _linesBefore;
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-  // Errors and validation
-  std::string makeError( size_t ln, std::string err )
-  {
-    std::stringstream ss;
-    ss << "Error on line " << ln << ": " << err << '.';
-    return ss.str();
-  }
+    public:
+      Diagnostics( ErrorList& errors, size_t limit, std::string file ) :
+        _errors( errors ), _limit( limit ), _file( file ), _newlines( std::make_shared< std::vector<size_t> >() ), _linesBefore( 0 ) {}
 
+      // True once no more errors will be accepted
+      bool full() const { return _limit != 0 && _errors.size() >= _limit; }
 
-  // Validates a string to be numeric or boolean exactly
-  bool validateExpression( std::string& text, Type& valid_type )
+      void newline( size_t offset ) { _newlines->push_back( offset ); }
+
+      // Drop the newlines recorded so far, for inputs whose later errors never point back before the
+      // current position. The last one is kept for working out columns. Errors already recorded
+      // keep the index they were given
+      void restart()
+      {
+        if ( _newlines->size() < 2 ) return;
+
+        _linesBefore += _newlines->size() - 1;
+        if ( _newlines.use_count() == 1 )
+        {
+          _newlines->erase( _newlines->begin(), _newlines->end() - 1 );
+        }
+        else
+        {
+          _newlines = std::make_shared< std::vector<size_t> >( 1, _newlines->back() );
+        }
+      }
+
+      void add( ParseError::Code code, size_t offset, const std::string& identifier = std::string(), const std::string& detail = std::string() )
+      {
+        if ( full() ) return;
+        _errors.push_back( ParseError{ code, offset, _file, identifier, detail, _newlines, _linesBefore } );
+      }
+
+      // Errors from another input, e.g. an include
+      void append( const ErrorList& errors )
+      {
+        for ( ErrorList::const_iterator it = errors.begin(); it != errors.end() && ! full(); ++it )
+        {
+          _errors.push_back( *it );
+        }
+      }
+
+      size_t limit() const { return _limit; }
+  };
+
+
+  // Splits an input stream into tokens, reading it in blocks
+  class Lexer
   {
-    if ( text == "true" )
-    {
-      valid_type = Type::Boolean;
-      return true;
-    }
-    else if ( text == "false" )
-    {
-      valid_type = Type::Boolean;
-      return true;
-    }
-    else if ( text == "null" )
-    {
-      valid_type = Type::Null;
-      return true;
-    }
-    else if ( validateNumeric( text ) )
-    {
-      valid_type = Type::Numeric;
-      return true;
-    }
-    else
+    private:
+      std::istream& _input;
+      std::vector<char> _buffer;
+      size_t _position;
+      size_t _size;
+
+      // Bytes in the blocks before the current one
+      size_t _consumed;
+
+      // JSON string escapes, no includes
+      bool _json;
+
+      // Check that strings are valid UTF-8
+      bool _utf8;
+
+      // Decode escapes in quoted strings
+      bool _escapes;
+
+      // Lexical errors and newlines are recorded here
+      Diagnostics& _diagnostics;
+
+      // Bytes and read time are added here when measuring
+      ParseStats* _stats;
+
+      // Reads are recorded here when tracing
+      Trace* _trace;
+
+      // Read the next block. Returns false at the end of the input
+      bool _refill();
+
+      // Scan a quoted string or filepath up to the closing character
+      bool _scanQuote( Token&, char );
+
+      // Decode a \uXXXX escape, the 'u' having been read
+      void _scanUnicode( std::string& );
+
+      // Copy and check one multibyte UTF-8 sequence starting at the current character
+      void _scanUtf8( std::string& );
+
+      // Return the next character, or -1 at the end of the input
+      int _get() { return ( _position < _size || _refill() ) ? static_cast<unsigned char>( _buffer[_position++] ) : -1; }
+      int _peek() { return ( _position < _size || _refill() ) ? static_cast<unsigned char>( _buffer[_position] ) : -1; }
+
+      // Offset of the next character in the input
+      size_t _offset() const { return _consumed + _position; }
+
+    public:
+      Lexer( std::istream&, const ParseOptions&, Diagnostics& );
+
+      // Fill the next token. Returns false at the end of the input or once the error limit is reached
+      bool next( Token& );
+
+      // Pass over the rest of an open object or array, including its closing bracket, without
+      // building any tokens. Returns false if the input ends first
+      bool skipContainer();
+  };
+
+
+  // State carried through the recursive parse
+  struct ParseContext
+  {
+    ParseContext( const ParseOptions& opts, Diagnostics& diag ) : options( opts ), diagnostics( diag ), path(), anchors() {}
+
+    // Releases the anchored subtrees
+    ~ParseContext();
+
+    ParseContext( const ParseContext& ) = delete;
+    ParseContext& operator=( const ParseContext& ) = delete;
+
+    const ParseOptions& options;
+
+    Diagnostics& diagnostics;
+
+    // Location of the value currently being parsed
+    Path path;
+
+    // Set when an error leaves nothing sensible to continue parsing from
+    bool stopped = false;
+
+    // Subtrees named with &name so far. Each holds a share until the parse finishes, and a later
+    // anchor with the same name replaces an earlier one
+    std::map<std::string, Object*> anchors;
+
+    // Name a subtree once it has been parsed, so it can never refer to itself
+    void define( const std::string& name, Object& node );
+
+    // The subtree a *name token refers to, or null after recording an error
+    Object* anchor( const Token& token, const std::string& identifier );
+
+    // Record an error, stopping the parse if the limit has been reached
+    void error( ParseError::Code code, size_t offset, const std::string& identifier = std::string(), const std::string& detail = std::string() )
     {
-      valid_type = Type::String;
-      return false;
+      diagnostics.add( code, offset, identifier, detail );
+      if ( diagnostics.full() ) stopped = true;
     }
-  }
+  };
 
 
-  bool validateNumeric( std::string text )
+  // Refills an object or array in place. Children are taken from the previous contents where the
+  // key or index matches, so parsing a document of the same shape again allocates no new nodes.
+  // Whatever is left over is deleted when the rebuild finishes
+  class Rebuild
   {
-    bool digit = false;
-    bool point = false;
-    for ( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
-    {
-      if ( std::isdigit( *it ) )
-      {
-        digit = true;
-      }
-      else if ( ( (*it) == '-' ) || ( (*it) == '+' ) )
+    private:
+      Object& _object;
+
+      // Children from before the rebuild that have not been taken yet
+      Object::ObjectMap _previous;
+
+      // Array items, or the entries of a small object refilled in place, filled so far
+      size_t _items;
+
+      // A small object is refilled within its own array. The entries refilled so far are moved to
+      // the front in the order they arrive, and put back in key order when the rebuild finishes
+      bool _inPlace;
+
+      // Restore the key order of the entries refilled in place
+      void _sort()
       {
-        if ( digit ) return false;
+        std::vector<Children::Entry>& flat = _object._children._flatEntries();
+        auto less = []( const Children::Entry& a, const Children::Entry& b ) { return a.first < b.first; };
+        if ( ! std::is_sorted( flat.begin(), flat.end(), less ) ) std::sort( flat.begin(), flat.end(), less );
       }
-      else if ( (*it) == '.' )
+
+      // Set aside the entries not refilled yet, once the object grows too large for its array
+      void _leaveInPlace()
       {
-        if ( point ) return false;
-        if ( ! digit ) return false;
+        std::vector<Children::Entry>& flat = _object._children._flatEntries();
+        for ( size_t i = _items; i < flat.size(); ++i )
+        {
+          _previous.append( std::move( flat[i].first ), flat[i].second );
+        }
+        flat.erase( flat.begin() + _items, flat.end() );
+        _sort();
+        _inPlace = false;
       }
-      else
+
+    public:
+      Rebuild( Object& object, Type type ) : _object( object ), _previous(), _items( 0 ), _inPlace( false )
       {
-        return false;
+        _object.setType( type );
+        _object._value.clear();
+
+        if ( type == Type::Object && _object._children.small() )
+        {
+          _inPlace = true;
+        }
+        else
+        {
+          _previous.swap( _object._children );
+          _object._children.reserve( _previous.size() );
+        }
       }
-    }
-    return true;
-  }
 
+      ~Rebuild() { finish(); }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-  // The writing logic
+      Rebuild( const Rebuild& ) = delete;
+      Rebuild& operator=( const Rebuild& ) = delete;
 
-  void parseQuote( std::ostream& output, const std::string& text )
-  {
-    output << "\"";
-    for ( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
-    {
-      switch ( *it )
+      // Children or items filled so far
+      size_t size() const { return ( _object._type == Type::Array || _inPlace ) ? _items : _object._children.size(); }
+
+    private:
+      // The entry for a key, taken from the previous contents if it was there. Null if it is new
+      Object*& _slot( const std::string& key )
       {
-        case '"' :
-          output << "\\\"";
-          break;
+        if ( _inPlace )
+        {
+          std::vector<Children::Entry>& flat = _object._children._flatEntries();
 
-        case '\\' :
-          output << "\\\\";
-          break;
+          // Keys usually arrive in the same order as last time, so the next one is found first
+          for ( size_t i = _items; i < flat.size(); ++i )
+          {
+            if ( flat[i].first == key )
+            {
+              if ( i != _items ) std::swap( flat[i], flat[_items] );
+              return flat[_items++].second;
+            }
+          }
 
-        default :
-          output << *it;
-      }
-    }
-    output << "\"";
-  }
+          // A repeated key
+          for ( size_t i = 0; i < _items; ++i )
+          {
+            if ( flat[i].first == key ) return flat[i].second;
+          }
+
+          if ( flat.size() < CON_SMALL_OBJECT_SIZE )
+          {
+            flat.push_back( Children::Entry{ key, nullptr } );
+            std::swap( flat.back(), flat[_items] );
+            return flat[_items++].second;
+          }
+          _leaveInPlace();
+        }
 
+        if ( ! _previous.empty() )
+        {
+          // Keys usually arrive in the same sorted order the writer gives them
+          Object::ObjectMap::const_iterator found = ( _previous.begin()->first == key ) ? _previous.begin() : _previous.find( key );
+          if ( found != _previous.end() ) return _object._children.take( _previous, found );
+        }
 
-  void printObject( Object& obj, std::ostream& output, size_t indent )
-  {
-    auto indentLambda = [ &output, &indent ]() { for ( size_t i = 0; i < indent; ++i ) output << "  "; };
+        return _object._children[key];
+      }
 
-    if ( obj._type == Type::Object )
-    {
-      indentLambda();
-      output << "{" << '\n';
-      ++indent;
-      for ( Object::ObjectMap::iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+    public:
+      // The node to parse the value of a key into. A repeated key gets the same node again, unless
+      // it is shared, which is never refilled in place
+      Object& child( const std::string& key )
       {
-        indentLambda();
-        output << it->first << " : ";
-        if ( it->second->getType() == Type::Object || it->second->getType() == Type::Array ) output << '\n';
-        printObject( *it->second, output, indent );
-        if ( it != ( --obj._children.end() ) )
+        Object*& slot = _slot( key );
+        if ( slot != nullptr && slot->_shares > 0 )
         {
-          output << ",\n";
+          Object::_release( slot );
+          slot = nullptr;
         }
-        else
+        if ( slot == nullptr ) slot = new Object();
+        return *slot;
+      }
+
+      // The node to parse the next array item into
+      Object& item()
+      {
+        if ( _items == _object._array.size() )
+        {
+          _object._array.push_back( new Object() );
+        }
+        else if ( _object._array[_items]->_shares > 0 )
         {
-          output << "\n";
+          Object::_release( _object._array[_items] );
+          _object._array[_items] = new Object();
         }
+        return *_object._array[_items++];
       }
-      --indent;
-      indentLambda();
-      output << "}";
-    }
-    else if ( obj._type == Type::Array )
-    {
-      indentLambda();
-      output << "[" << '\n';
-      ++indent;
-      for ( Object::Array::iterator it = obj._array.begin(); it != obj._array.end(); ++it )
+
+      // Make a key another holder of a shared node
+      void share( const std::string& key, Object& node )
       {
-        if ( (*it)->getType() != Type::Object && (*it)->getType() != Type::Array ) indentLambda();
-        printObject( *(*it), output, indent );
-        if ( it != ( --obj._array.end() ) )
+        Object*& slot = _slot( key );
+        if ( slot != nullptr ) Object::_release( slot );
+        hold( node );
+        slot = &node;
+      }
+
+      // Make the next array item another holder of a shared node
+      void share( Object& node )
+      {
+        hold( node );
+        if ( _items == _object._array.size() )
         {
-          output << ",\n";
+          _object._array.push_back( &node );
         }
         else
         {
-          output << "\n";
+          Object::_release( _object._array[_items] );
+          _object._array[_items] = &node;
         }
+        ++_items;
       }
-      --indent;
-      indentLambda();
-      output << "]";
-    }
-    else
-    {
-      switch( obj._type )
-      {
-        case Type::Null :
-          output << "null";
-          break;
 
-        case Type::String :
-          parseQuote( output, obj._value );
-          break;
+      // Add or drop a holder of a node outside any tree
+      static void hold( Object& node ) { ++node._shares; }
+      static void release( Object* node ) { Object::_release( node ); }
 
-        case Type::Numeric :
-          output << obj._value;
-          break;
+      // The name an anchored subtree is written with
+      static void name( Object& node, const std::string& anchor ) { node._value = anchor; }
 
-        case Type::Boolean :
-          output << obj._value;
-          break;
+      // Set a value that has already been validated, keeping the string's capacity
+      static void assign( Object& object, const std::string& value, Type type )
+      {
+        object.setType( type );
+        object._value.assign( value );
+      }
 
-        default:
-          // This should be impossible
-          break;
+      // Drop the unused nodes
+      void finish()
+      {
+        if ( _inPlace )
+        {
+          std::vector<Children::Entry>& flat = _object._children._flatEntries();
+          for ( size_t i = _items; i < flat.size(); ++i )
+          {
+            Object::_release( flat[i].second );
+          }
+          flat.erase( flat.begin() + _items, flat.end() );
+          _sort();
+        }
+
+        for ( Object::ObjectMap::iterator it = _previous.begin(); it != _previous.end(); ++it )
+        {
+          Object::_release( it->second );
+        }
+        _previous.clear();
+
+        if ( _object._type == Type::Array )
+        {
+          for ( size_t i = _items; i < _object._array.size(); ++i )
+          {
+            Object::_release( _object._array[i] );
+          }
+          _object._array.resize( _items );
+        }
       }
+  };
+
+
+  ParseContext::~ParseContext()
+  {
+    for ( std::map<std::string, Object*>::iterator it = anchors.begin(); it != anchors.end(); ++it )
+    {
+      Rebuild::release( it->second );
     }
   }
 
 
-  void writeToStream( Object& obj, std::ostream& output )
+  void ParseContext::define( const std::string& name, Object& node )
   {
-    printObject( obj, output, 0 );
-    output << std::endl;
+    Rebuild::name( node, name );
+    Rebuild::hold( node );
+
+    Object*& slot = anchors[name];
+    if ( slot != nullptr ) Rebuild::release( slot );
+    slot = &node;
   }
 
 
-  void writeToString( Object& obj, std::string& output )
+  Object* ParseContext::anchor( const Token& token, const std::string& identifier )
   {
-    std::stringstream ss;
-    printObject( obj, ss, 0 );
-    ss << std::endl;
-    output = ss.str();
+    std::map<std::string, Object*>::iterator found = anchors.find( token.string.substr( 1 ) );
+    if ( found == anchors.end() )
+    {
+      error( ParseError::UnknownAnchor, token.offset, identifier, token.string.substr( 1 ) );
+      return nullptr;
+    }
+    return found->second;
   }
 
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-  // The parsing logic
+  // Text of the form &name before an object, array or include names it as an anchor, and *name
+  // in place of a value refers to one. Neither is part of JSON
+  bool isAnchor( const Token& token, const ParseContext& context )
+  {
+    return token.type == Token::Text && token.string.size() > 1 && token.string[0] == '&' && ! context.options.json;
+  }
 
-  Object buildFromFile( std::string filename )
+  bool isReference( const Token& token, const ParseContext& context )
   {
-    std::ifstream infile( filename, std::ios_base::in );
+    return token.type == Token::Text && token.string.size() > 1 && token.string[0] == '*' && ! context.options.json;
+  }
 
-    if ( ! infile.is_open() )
-    {
-      std::string string( "Failed to open file \"" );
-      string += filename;
-      string += "\"";
-      throw Exception( string );
-    }
 
-    Object object;
-    try
-    {
-      object = buildFromStream( infile );
-    }
-    catch( Exception& ex )
-    {
-      ex.setFilename( filename );
-      throw ex;
-    }
-    return object;
+  // Turn a vector of tokens into a complete object tree, checking it against the schema rule if
+  // there is one. An existing tree is refilled in place. Errors are recorded, never thrown
+  void parseTokens( std::vector<Token>::iterator&, std::vector<Token>::iterator&, ParseContext&, Object&, const Schema::Node* );
+
+  void parseArray( std::vector<Token>::iterator&, std::vector<Token>::iterator&, ParseContext&, Object&, const Schema::Node* );
+
+  // Load a <file> include, through the handler if one is provided
+  void parseInclude( const Token&, const std::string&, ParseContext&, Object&, const Schema::Node* );
+
+  // Find the subtree for a *name reference. Only its top level is checked against the schema, as
+  // for a tree from an include handler
+  Object* parseReference( const Token&, const std::string&, ParseContext&, const Schema::Node* );
+
+  // Parse the root value from the tokens. Anything before the root object is skipped
+  void parseRoot( std::vector<Token>::iterator, std::vector<Token>::iterator, ParseContext&, Object&, const Schema::Node* );
+
+  // Build an object from the stream, recording all errors in the list
+  void parseStream( std::istream&, const ParseOptions&, const std::string&, ErrorList&, Object&, const Schema::Node* );
+
+  // As parseStream, adding an error if the file could not be decompressed
+  void parseFile( InputFile&, const ParseOptions&, const std::string&, ErrorList&, Object&, const Schema::Node* );
+
+  // Schema checks made while parsing. Each returns false if the value did not match
+  bool checkSchemaValue( const Schema::Node*, Type, const Token&, const std::string&, ParseContext& );
+  bool checkSchemaContainer( const Schema::Node*, const Object&, const Token&, ParseContext& );
+  const Schema::Node* schemaProperty( const Schema::Node*, const Token&, const std::string&, ParseContext& );
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Parse statistics
+
+  static_assert( static_cast<int>( ParseStats::Filepath ) == static_cast<int>( Token::Filepath ), "Token kinds must match" );
+
+
+  const char* ParseStats::tokenName( size_t kind )
+  {
+    static const char* names[] = { "text", "quote", "colon", "comma", "open object", "close object", "open array", "close array", "comment", "filepath" };
+    return ( kind < TokenKinds ) ? names[kind] : "unknown";
   }
 
 
-  Object buildFromString( std::string& data )
+  const char* ParseStats::phaseName( size_t phase )
   {
-    std::stringstream ss( data );
+    static const char* names[] = { "read", "tokenize", "build" };
+    return ( phase < Phases ) ? names[phase] : "unknown";
+  }
 
-    return buildFromStream( ss );
+
+  void ParseStats::clear()
+  {
+    Timing timing = _timing;
+    *this = ParseStats();
+    _timing = timing;
   }
 
 
-  Object buildFromStream( std::istream& input )
+  // Charge the time since the last switch to the current phase and start timing another
+  ParseStats::Phase switchPhase( ParseStats& stats, ParseStats::Phase phase )
   {
-    // We need to analyse the white space
-    input.unsetf( std::ios_base::skipws );
+    ParseStats::Timing& timing = stats._timing;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    stats.seconds[ timing.phase ] += std::chrono::duration<double>( now - timing.mark ).count();
+    timing.mark = now;
+
+    ParseStats::Phase previous = timing.phase;
+    timing.phase = phase;
+    return previous;
+  }
 
-    // Current character being switch-ed
-    char c;
-    // Current string buffer
-    std::string current_string;
 
-    // Current line number
-    size_t lineNumber = 1;
+  void countString( const std::string& string, ParseStats& stats )
+  {
+    size_t bytes = stringHeapBytes( string );
+    if ( bytes > 0 )
+    {
+      ++stats.allocations;
+      stats.allocatedBytes += bytes;
+    }
+  }
 
-    // Token list
-    std::vector< Token > tokens;
 
-    // State flags
-    bool escape = false;
-    bool quote = false;
-    bool comment = false;
-    bool filepath = false;
+  void countNodes( const Object& object, ParseStats& stats, size_t depth )
+  {
+    ++stats.nodes[ static_cast<size_t>( object._type ) ];
+    stats.maxDepth = std::max( stats.maxDepth, depth );
+    countString( object._value, stats );
 
-    Token::Type current_type;
+    stats.allocations += object._children.allocations();
+    stats.allocatedBytes += object._children.heapBytes();
+    for ( Object::ObjectMap::const_iterator it = object._children.begin(); it != object._children.end(); ++it )
+    {
+      ++stats.allocations;
+      stats.allocatedBytes += sizeof( Object );
+      countString( it->first, stats );
+      countNodes( *it->second, stats, depth + 1 );
+    }
 
-    while ( input >> c )
+    if ( object._array.capacity() > 0 )
     {
-      if ( comment )
+      ++stats.allocations;
+      stats.allocatedBytes += object._array.capacity() * sizeof( Object* );
+    }
+    for ( Object::Array::const_iterator it = object._array.begin(); it != object._array.end(); ++it )
+    {
+      ++stats.allocations;
+      stats.allocatedBytes += sizeof( Object );
+      countNodes( **it, stats, depth + 1 );
+    }
+  }
+
+
+  // Times one call to parseStream. The outermost call resets the statistics, and measures the
+  // finished tree once it is complete
+  class StatsScope
+  {
+    private:
+      ParseStats* _stats;
+      const Object& _object;
+      ParseStats::Phase _outer;
+      std::chrono::steady_clock::time_point _start;
+
+    public:
+      StatsScope( ParseStats* stats, const Object& object ) : _stats( stats ), _object( object ), _outer( ParseStats::Build )
       {
-        if ( c == '\n' )
+        if ( ! _stats ) return;
+
+        if ( _stats->_timing.nesting++ == 0 )
         {
-          comment = false;
-          ++lineNumber;
+          _stats->clear();
+          _stats->_timing.mark = _start = std::chrono::steady_clock::now();
         }
-        continue;
+        _outer = switchPhase( *_stats, ParseStats::Tokenize );
       }
-      else if ( filepath )
+
+      ~StatsScope()
       {
-        if ( escape )
-        {
-          if ( c == '\n' )
-          {
-            comment = false;
-            ++lineNumber;
-          }
+        if ( ! _stats ) return;
 
-          current_string.push_back( c );
-          escape = false;
-        }
-        else
+        switchPhase( *_stats, _outer );
+        if ( --_stats->_timing.nesting == 0 )
         {
-          switch( c )
-          {
-            case '\\' :
-              escape = true;
-              break;
-
-            case '\n' :
-              ++lineNumber;
-              current_string.push_back( '\n' );
-              break;
-
-            case '>' :
-              {
-                filepath = false;
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = Token::Filepath;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-              break;
-
-            default:
-              current_string.push_back( c );
-              break;
-          }
+          countNodes( _object, *_stats, 0 );
+          _stats->totalSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - _start ).count();
         }
       }
-      else if ( quote )
+
+      // The lexing is finished. Only the first count tokens belong to this parse
+      void tokens( const std::vector<Token>& tokens, size_t count )
       {
-        if ( escape )
-        {
-          if ( c == '\n' )
-          {
-            comment = false;
-            ++lineNumber;
-          }
+        if ( ! _stats ) return;
 
-          current_string.push_back( c );
-          escape = false;
+        if ( tokens.capacity() > 0 )
+        {
+          ++_stats->allocations;
+          _stats->allocatedBytes += tokens.capacity() * sizeof( Token );
         }
-        else
+        for ( std::vector<Token>::const_iterator it = tokens.begin(); it != tokens.begin() + count; ++it )
         {
-          switch( c )
-          {
-            case '\\' :
-              escape = true;
-              break;
-
-            case '\n' :
-              ++lineNumber;
-              current_string.push_back( '\n' );
-              break;
-
-            case '\"' :
-              {
-                quote = false;
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = Token::Quote;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-              break;
-
-            default:
-              current_string.push_back( c );
-              break;
-          }
+          ++_stats->tokens[ it->type ];
+          countString( it->string, *_stats );
         }
+        switchPhase( *_stats, ParseStats::Build );
       }
-      else
+  };
+
+
+  // Records the time taken by one include, including anything it includes itself
+  class IncludeTimer
+  {
+    private:
+      ParseStats* _stats;
+      std::string _file;
+      size_t _bytes;
+      std::chrono::steady_clock::time_point _start;
+
+    public:
+      IncludeTimer( ParseStats* stats, const std::string& file ) : _stats( stats ), _bytes( 0 )
       {
-        if ( escape )
-        {
-          if ( current_string.size() == 0 )
-          {
-            current_type = Token::Text;
-          }
-          escape = false;
-        }
-        else
-        {
-          switch( c )
-          {
-            case '\n' :
-              ++lineNumber;
-              break;
-
-
-            case '\\' :
-              if ( escape ) current_string.push_back( '\\' );
-              else escape = true;
-              break;
-
-            case ' ' :
-              if ( current_string.size() > 0 )
-              {
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = current_type;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-              break;
-
-
-
-            case '{' :
-              if ( escape ) current_string.push_back( '{' );
-              else
-              {
-                if ( current_string.size() > 0 )
-                {
-                  Token new_token;
-                  new_token.string = current_string;
-                  new_token.type = current_type;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                  current_string.clear();
-                }
-                {
-                  Token new_token;
-                  new_token.string = '{';
-                  new_token.type = Token::OpenObject;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                }
-              }
-              break;
-
-
-            case '}' :
-              if ( escape ) current_string.push_back( '}' );
-              else
-              {
-                if ( current_string.size() > 0 )
-                {
-                  Token new_token;
-                  new_token.string = current_string;
-                  new_token.type = current_type;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                  current_string.clear();
-                }
-                {
-                  Token new_token;
-                  new_token.string = '}';
-                  new_token.type = Token::CloseObject;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                }
-              }
-              break;
-
-
-            case '[' :
-              if ( escape ) current_string.push_back( '[' );
-              else
-              {
-                if ( current_string.size() > 0 )
-                {
-                  Token new_token;
-                  new_token.string = current_string;
-                  new_token.type = current_type;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                  current_string.clear();
-                }
-                {
-                  Token new_token;
-                  new_token.string = '[';
-                  new_token.type = Token::OpenArray;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                }
-              }
-              break;
-
-
-            case ']' :
-              if ( escape ) current_string.push_back( ']' );
-              else
-              {
-                if ( current_string.size() > 0 )
-                {
-                  Token new_token;
-                  new_token.string = current_string;
-                  new_token.type = current_type;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                  current_string.clear();
-                }
-                {
-                  Token new_token;
-                  new_token.string = ']';
-                  new_token.type = Token::CloseArray;
-                  new_token.lineNumber = lineNumber;
-                  tokens.push_back( new_token );
-                }
-              }
-              break;
-
-
-            case '\"' :
-              if ( current_string.size() > 0 )
-              {
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = current_type;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-
-              quote = true;
-              break;
-
-
-            case '<' :
-              if ( current_string.size() > 0 )
-              {
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = current_type;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-
-              filepath = true;
-              break;
-
-
-            case ',' :
-              if ( current_string.size() > 0 )
-              {
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = current_type;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-              {
-                Token new_token;
-                new_token.string = ',';
-                new_token.type = Token::Comma;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-              }
-              break;
-
-
-            case ':' :
-              if ( current_string.size() > 0 )
-              {
-                Token new_token;
-                new_token.string = current_string;
-                new_token.type = current_type;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-                current_string.clear();
-              }
-              {
-                Token new_token;
-                new_token.string = ':';
-                new_token.type = Token::Colon;
-                new_token.lineNumber = lineNumber;
-                tokens.push_back( new_token );
-              }
-              break;
-
-
-            case '#' :
-              comment = true;
-              break;
-
-
-            default:
-              if ( current_string.size() == 0 )
-              {
-                current_type = Token::Text;
-              }
-              current_string += c;
-              break;
-          }
-        }
+        if ( ! _stats ) return;
+        _file = file;
+        _bytes = _stats->bytes;
+        _start = std::chrono::steady_clock::now();
       }
-    }
 
-    /*
-    // Useful debugging loop
-    for ( std::vector<Token>::iterator it = tokens.begin(); it != tokens.end(); ++it )
-    {
-      std::cout << "Token : ";
-      switch( it->type )
+      ~IncludeTimer()
       {
-        case Token::Text :
-          std::cout << " Text ";
-          break;
-        case Token::Quote :
-          std::cout << " Quote ";
+        if ( ! _stats ) return;
+        double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - _start ).count();
+        _stats->includes.push_back( ParseStats::Include{ _file, seconds, _stats->bytes - _bytes } );
+      }
+  };
+
+
+  std::ostream& operator<<( std::ostream& os, const ParseStats& stats )
+  {
+    static const char* types[] = { "null", "string", "numeric", "boolean", "array", "object" };
+
+    os << "Bytes read : " << stats.bytes << '\n';
+    os << "Maximum depth : " << stats.maxDepth << '\n';
+    os << "Allocations : " << stats.allocations << " (" << stats.allocatedBytes << " bytes)\n";
+
+    os << "Tokens :";
+    for ( size_t i = 0; i < ParseStats::TokenKinds; ++i ) os << ' ' << ParseStats::tokenName( i ) << '=' << stats.tokens[i];
+    os << "\nNodes :";
+    for ( size_t i = 0; i < 6; ++i ) os << ' ' << types[i] << '=' << stats.nodes[i];
+
+    os << "\nTime : " << stats.totalSeconds << " s";
+    for ( size_t i = 0; i < ParseStats::Phases; ++i ) os << ", " << ParseStats::phaseName( i ) << ' ' << stats.seconds[i] << " s";
+
+    os << "\nIncludes : " << stats.includes.size() << '\n';
+    for ( std::vector<ParseStats::Include>::const_iterator it = stats.includes.begin(); it != stats.includes.end(); ++it )
+    {
+      os << "  " << it->file << " : " << it->seconds << " s, " << it->bytes << " bytes\n";
+    }
+    return os;
+  }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Errors and validation
+
+  // Validates a string to be numeric or boolean exactly
+  bool validateExpression( std::string& text, Type& valid_type )
+  {
+    if ( text == "true" )
+    {
+      valid_type = Type::Boolean;
+      return true;
+    }
+    else if ( text == "false" )
+    {
+      valid_type = Type::Boolean;
+      return true;
+    }
+    else if ( text == "null" )
+    {
+      valid_type = Type::Null;
+      return true;
+    }
+    else if ( validateNumeric( text ) )
+    {
+      valid_type = Type::Numeric;
+      return true;
+    }
+    else
+    {
+      valid_type = Type::String;
+      return false;
+    }
+  }
+
+
+  // Optional sign, digits, an optional fraction and an optional exponent
+  bool validateNumeric( const std::string& text )
+  {
+    std::string::const_iterator it = text.begin();
+    if ( it != text.end() && ( (*it) == '-' || (*it) == '+' ) ) ++it;
+
+    std::string::const_iterator digits = it;
+    while ( it != text.end() && std::isdigit( *it ) ) ++it;
+    if ( it == digits ) return false;
+
+    if ( it != text.end() && (*it) == '.' )
+    {
+      ++it;
+      while ( it != text.end() && std::isdigit( *it ) ) ++it;
+    }
+
+    if ( it != text.end() && ( (*it) == 'e' || (*it) == 'E' ) )
+    {
+      ++it;
+      if ( it != text.end() && ( (*it) == '-' || (*it) == '+' ) ) ++it;
+
+      std::string::const_iterator exponent = it;
+      while ( it != text.end() && std::isdigit( *it ) ) ++it;
+      if ( it == exponent ) return false;
+    }
+
+    return it == text.end();
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Schema checks during parsing
+
+  const Schema::Node* schemaRoot( const ParseOptions& options )
+  {
+    return ( options.schema != nullptr ) ? &options.schema->root() : nullptr;
+  }
+
+
+  // Readable list of the types a rule allows
+  std::string describeTypes( const Schema::Node& schema )
+  {
+    static const char* names[] = { "null", "string", "number", "boolean", "array", "object" };
+
+    std::string text;
+    for ( unsigned i = 0; i < 6; ++i )
+    {
+      if ( ! ( schema.types & ( 1u << i ) ) ) continue;
+      if ( ! text.empty() ) text += " or ";
+      text += ( i == static_cast<unsigned>( Type::Numeric ) && schema.integer ) ? "integer" : names[i];
+    }
+    return text;
+  }
+
+
+  bool checkSchemaValue( const Schema::Node* schema, Type type, const Token& token, const std::string& identifier, ParseContext& context )
+  {
+    if ( schema == nullptr ) return true;
+
+    if ( ! schema->allows( type ) )
+    {
+      context.error( ParseError::SchemaType, token.offset, identifier, describeTypes( *schema ) );
+      return false;
+    }
+
+    if ( type == Type::Numeric && ( schema->integer || schema->hasMinimum || schema->hasMaximum ) )
+    {
+      double number = std::strtod( token.string.c_str(), nullptr );
+      // Any finite whole number is an integer, however large
+      if ( schema->integer && ( ! std::isfinite( number ) || std::trunc( number ) != number ) )
+      {
+        context.error( ParseError::SchemaType, token.offset, identifier, describeTypes( *schema ) );
+        return false;
+      }
+      if ( ( schema->hasMinimum && number < schema->minimum ) || ( schema->hasMaximum && number > schema->maximum ) )
+      {
+        std::ostringstream range;
+        if ( schema->hasMinimum && number < schema->minimum )
+          range << "at least " << schema->minimum;
+        else
+          range << "at most " << schema->maximum;
+        context.error( ParseError::SchemaRange, token.offset, identifier, range.str() );
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+  const Schema::Node* schemaProperty( const Schema::Node* schema, const Token& token, const std::string& identifier, ParseContext& context )
+  {
+    if ( schema == nullptr ) return nullptr;
+
+    std::map<std::string, Schema::Node>::const_iterator found = schema->properties.find( identifier );
+    if ( found != schema->properties.end() )
+    {
+      return &found->second;
+    }
+
+    if ( ! schema->additional )
+    {
+      context.error( ParseError::SchemaUnexpectedKey, token.offset, identifier );
+    }
+    return nullptr;
+  }
+
+
+  bool checkSchemaContainer( const Schema::Node* schema, const Object& object, const Token& token, ParseContext& context )
+  {
+    if ( schema == nullptr ) return true;
+
+    const std::string& identifier = context.path.empty() ? std::string() : context.path.back();
+    bool valid = true;
+
+    if ( object.getType() == Type::Object )
+    {
+      for ( std::vector<std::string>::const_iterator it = schema->required.begin(); it != schema->required.end(); ++it )
+      {
+        if ( ! object.has( *it ) )
+        {
+          context.error( ParseError::SchemaMissingKey, token.offset, identifier, *it );
+          valid = false;
+        }
+      }
+    }
+
+    size_t size = object.getSize();
+    if ( size < schema->minItems || size > schema->maxItems )
+    {
+      context.error( ParseError::SchemaSize, token.offset, identifier, ( size < schema->minItems ) ? "at least " + std::to_string( schema->minItems ) : "at most " + std::to_string( schema->maxItems ) );
+      valid = false;
+    }
+
+    return valid;
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // The writing logic
+
+  OutputBuffer::OutputBuffer( std::ostream& output ) :
+    _output( &output ),
+    _storage(),
+    _buffer( _storage ),
+    _limit( CON_WRITE_BUFFER_SIZE ),
+    _anchors( nullptr )
+  {
+    _storage.reserve( CON_WRITE_BUFFER_SIZE + CON_WRITE_BUFFER_SIZE / 4 );
+  }
+
+
+  OutputBuffer::OutputBuffer( std::string& output ) :
+    _output( nullptr ),
+    _storage(),
+    _buffer( output ),
+    _limit( std::string::npos ),
+    _anchors( nullptr )
+  {
+  }
+
+
+  OutputBuffer::~OutputBuffer()
+  {
+    flush();
+  }
+
+
+  void OutputBuffer::flush()
+  {
+    if ( _output != nullptr && _buffer.size() > 0 )
+    {
+      _output->write( _buffer.data(), _buffer.size() );
+      _buffer.clear();
+    }
+  }
+
+
+  void parseQuote( OutputBuffer& output, const std::string& text )
+  {
+    output.put( '"' );
+
+    // Copy the runs between characters that need escaping in one go
+    const char* run = text.data();
+    const char* end = run + text.size();
+    for ( const char* it = run; it != end; ++it )
+    {
+      if ( *it == '"' || *it == '\\' )
+      {
+        output.write( run, it - run );
+        output.put( '\\' );
+        run = it;
+      }
+    }
+    output.write( run, end - run );
+
+    output.put( '"' );
+  }
+
+
+  struct WrittenAnchors
+  {
+    enum Sharing { None, Anchor, Reference };
+
+    // Names given to the shared subtrees written so far
+    std::map<const Object*, std::string> names;
+    std::set<std::string> used;
+
+    // Whether a subtree is written as usual, as &name followed by the subtree, or as a *name
+    // reference. Only objects and arrays are ever shared
+    static Sharing check( const Object&, OutputBuffer&, const std::string*& );
+  };
+
+
+  WrittenAnchors::Sharing WrittenAnchors::check( const Object& obj, OutputBuffer& output, const std::string*& name )
+  {
+    WrittenAnchors* anchors = output.anchors();
+    if ( anchors == nullptr || obj._shares == 0 || ( obj._type != Type::Object && obj._type != Type::Array ) ) return None;
+
+    // Nodes shared by copying on write were never anchored, only those read from an anchor are named
+    if ( obj._value.empty() ) return None;
+
+    std::map<const Object*, std::string>::const_iterator found = anchors->names.find( &obj );
+    if ( found != anchors->names.end() )
+    {
+      name = &found->second;
+      return Reference;
+    }
+
+    // The same anchor name may have been given to different subtrees in the source
+    const std::string& base = obj._value;
+    std::string unique = base;
+    for ( size_t number = 2; ! anchors->used.insert( unique ).second; ++number )
+    {
+      unique = base + "_" + std::to_string( number );
+    }
+
+    name = &( anchors->names[&obj] = unique );
+    return Anchor;
+  }
+
+
+  void printMarker( WrittenAnchors::Sharing shared, const std::string* name, OutputBuffer& output )
+  {
+    if ( shared == WrittenAnchors::None ) return;
+
+    output.put( ( shared == WrittenAnchors::Anchor ) ? '&' : '*' );
+    output.write( *name );
+  }
+
+
+  void printObject( const Object& obj, OutputBuffer& output, size_t indent )
+  {
+    const std::string* name = nullptr;
+
+    if ( obj._type == Type::Object )
+    {
+      output.indent( indent );
+      output.write( "{\n", 2 );
+      ++indent;
+      for ( Object::ObjectMap::const_iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+      {
+        output.indent( indent );
+        output.write( it->first );
+        output.write( " : ", 3 );
+
+        WrittenAnchors::Sharing shared = WrittenAnchors::check( *it->second, output, name );
+        printMarker( shared, name, output );
+        if ( shared != WrittenAnchors::Reference )
+        {
+          if ( it->second->getType() == Type::Object || it->second->getType() == Type::Array ) output.put( '\n' );
+          printObject( *it->second, output, indent );
+        }
+        if ( it != ( --obj._children.end() ) )
+        {
+          output.write( ",\n", 2 );
+        }
+        else
+        {
+          output.put( '\n' );
+        }
+        output.check();
+      }
+      --indent;
+      output.indent( indent );
+      output.put( '}' );
+    }
+    else if ( obj._type == Type::Array )
+    {
+      output.indent( indent );
+      output.write( "[\n", 2 );
+      ++indent;
+      for ( Object::Array::const_iterator it = obj._array.begin(); it != obj._array.end(); ++it )
+      {
+        WrittenAnchors::Sharing shared = WrittenAnchors::check( *(*it), output, name );
+        if ( shared != WrittenAnchors::None || ( (*it)->getType() != Type::Object && (*it)->getType() != Type::Array ) ) output.indent( indent );
+        printMarker( shared, name, output );
+        if ( shared == WrittenAnchors::Anchor ) output.put( '\n' );
+        if ( shared != WrittenAnchors::Reference ) printObject( *(*it), output, indent );
+        if ( it != ( --obj._array.end() ) )
+        {
+          output.write( ",\n", 2 );
+        }
+        else
+        {
+          output.put( '\n' );
+        }
+        output.check();
+      }
+      --indent;
+      output.indent( indent );
+      output.put( ']' );
+    }
+    else
+    {
+      printValue( obj, output );
+    }
+  }
+
+
+  void printCompact( const Object& obj, OutputBuffer& output )
+  {
+    const std::string* name = nullptr;
+
+    if ( obj._type == Type::Object )
+    {
+      output.put( '{' );
+      for ( Object::ObjectMap::const_iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+      {
+        if ( it != obj._children.begin() ) output.put( ',' );
+        output.write( it->first );
+        output.put( ':' );
+
+        WrittenAnchors::Sharing shared = WrittenAnchors::check( *it->second, output, name );
+        printMarker( shared, name, output );
+        if ( shared != WrittenAnchors::Reference ) printCompact( *it->second, output );
+        output.check();
+      }
+      output.put( '}' );
+    }
+    else if ( obj._type == Type::Array )
+    {
+      output.put( '[' );
+      for ( Object::Array::const_iterator it = obj._array.begin(); it != obj._array.end(); ++it )
+      {
+        if ( it != obj._array.begin() ) output.put( ',' );
+
+        WrittenAnchors::Sharing shared = WrittenAnchors::check( *(*it), output, name );
+        printMarker( shared, name, output );
+        if ( shared != WrittenAnchors::Reference ) printCompact( *(*it), output );
+        output.check();
+      }
+      output.put( ']' );
+    }
+    else
+    {
+      printValue( obj, output );
+    }
+  }
+
+
+  void printValue( const Object& obj, OutputBuffer& output )
+  {
+    switch( obj._type )
+    {
+      case Type::Null :
+        output.write( "null", 4 );
+        break;
+
+      case Type::String :
+        parseQuote( output, obj._value );
+        break;
+
+      case Type::Numeric :
+        output.write( obj._value );
+        break;
+
+      case Type::Boolean :
+        output.write( obj._value );
+        break;
+
+      default:
+        // This should be impossible
+        break;
+    }
+  }
+
+
+  void writeToBuffer( const Object& obj, OutputBuffer& output, Format format )
+  {
+    if ( format == Format::Compact )
+    {
+      printCompact( obj, output );
+    }
+    else
+    {
+      printObject( obj, output, 0 );
+    }
+    output.put( '\n' );
+  }
+
+
+  void writeParallel( const Object& obj, std::ostream& output, Format format, unsigned threads )
+  {
+    const bool pretty = ( format == Format::Pretty );
+
+    // Pieces of output in order. Each is rendered into its own buffer, possibly on another thread
+    typedef std::function< void( OutputBuffer& ) > Piece;
+    std::vector< Piece > pieces;
+
+    auto literal = [ &pieces ]( std::string text )
+    {
+      pieces.push_back( [ text ]( OutputBuffer& out ) { out.write( text ); } );
+    };
+
+    auto indentString = []( size_t depth ) { return std::string( 2 * depth, ' ' ); };
+
+    // Slices of array elements at the given depth, with the same separators printObject writes
+    auto addSlices = [ &pieces, pretty ]( const Object& array, size_t depth )
+    {
+      const size_t size = array._array.size();
+      for ( size_t first = 0; first < size; first += CON_PARALLEL_SLICE_SIZE )
+      {
+        size_t last = std::min( size, first + CON_PARALLEL_SLICE_SIZE );
+        pieces.push_back( [ &array, first, last, size, depth, pretty ]( OutputBuffer& out )
+        {
+          for ( size_t i = first; i < last; ++i )
+          {
+            const Object& item = *array._array[i];
+            if ( pretty )
+            {
+              if ( item.getType() != Type::Object && item.getType() != Type::Array ) out.indent( depth );
+              printObject( item, out, depth );
+              if ( i + 1 != size ) out.write( ",\n", 2 );
+              else out.put( '\n' );
+            }
+            else
+            {
+              if ( i != 0 ) out.put( ',' );
+              printCompact( item, out );
+            }
+          }
+        } );
+      }
+    };
+
+    if ( obj._type == Type::Object )
+    {
+      literal( pretty ? "{\n" : "{" );
+
+      Object::ObjectMap::const_iterator group = obj._children.begin();
+      size_t group_size = 0;
+
+      // Batch consecutive members that are not split up
+      auto flush = [ &pieces, &obj, &group, pretty ]( Object::ObjectMap::const_iterator end )
+      {
+        if ( group == end ) return;
+        Object::ObjectMap::const_iterator first = group;
+        pieces.push_back( [ &obj, first, end, pretty ]( OutputBuffer& out )
+        {
+          for ( Object::ObjectMap::const_iterator it = first; it != end; ++it )
+          {
+            if ( pretty )
+            {
+              out.indent( 1 );
+              out.write( it->first );
+              out.write( " : ", 3 );
+              if ( it->second->getType() == Type::Object || it->second->getType() == Type::Array ) out.put( '\n' );
+              printObject( *it->second, out, 1 );
+              if ( it != ( --obj._children.end() ) ) out.write( ",\n", 2 );
+              else out.put( '\n' );
+            }
+            else
+            {
+              if ( it != obj._children.begin() ) out.put( ',' );
+              out.write( it->first );
+              out.put( ':' );
+              printCompact( *it->second, out );
+            }
+          }
+        } );
+        group = end;
+      };
+
+      for ( Object::ObjectMap::const_iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+      {
+        const Object& child = *it->second;
+        if ( child._type == Type::Array && child._array.size() > CON_PARALLEL_SLICE_SIZE )
+        {
+          flush( it );
+          bool last = ( it == --obj._children.end() );
+          if ( pretty )
+          {
+            literal( indentString( 1 ) + it->first + " : \n" + indentString( 1 ) + "[\n" );
+            addSlices( child, 2 );
+            literal( indentString( 1 ) + ( last ? "]\n" : "],\n" ) );
+          }
+          else
+          {
+            literal( ( it == obj._children.begin() ? "" : "," ) + it->first + ":[" );
+            addSlices( child, 0 );
+            literal( "]" );
+          }
+          group = std::next( it );
+          group_size = 0;
+        }
+        else if ( ++group_size >= CON_PARALLEL_GROUP_SIZE )
+        {
+          flush( std::next( it ) );
+          group_size = 0;
+        }
+      }
+      flush( obj._children.end() );
+
+      literal( "}\n" );
+    }
+    else if ( obj._type == Type::Array )
+    {
+      literal( pretty ? "[\n" : "[" );
+      addSlices( obj, 1 );
+      literal( "]\n" );
+    }
+    else
+    {
+      writeToStream( const_cast< Object& >( obj ), output, format );
+      return;
+    }
+
+    // Render the pieces across the threads. Each piece is written out as soon as those before it have
+    // been, and rendering runs at most a few pieces ahead of the output so they are not all held at once
+    const size_t window = 2 * static_cast< size_t >( threads );
+    std::vector< std::string > results( pieces.size() );
+    std::vector< bool > ready( pieces.size(), false );
+    size_t next = 0;
+    size_t written = 0;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::exception_ptr failure;
+
+    // Render the next piece if there is room for it. Called with the lock held, returns false if
+    // there was nothing to do
+    auto render = [ &pieces, &results, &ready, &next, &written, window, &changed, &failure ]( std::unique_lock< std::mutex >& lock )
+    {
+      if ( failure || next >= pieces.size() || next >= written + window ) return false;
+
+      size_t index = next++;
+      lock.unlock();
+      try
+      {
+        OutputBuffer buffer( results[index] );
+        pieces[index]( buffer );
+      }
+      catch ( ... )
+      {
+        lock.lock();
+        if ( ! failure ) failure = std::current_exception();
+        changed.notify_all();
+        return true;
+      }
+      lock.lock();
+      ready[index] = true;
+      changed.notify_all();
+      return true;
+    };
+
+    auto work = [ &pieces, &next, &mutex, &changed, &failure, &render ]()
+    {
+      std::unique_lock< std::mutex > lock( mutex );
+      while ( ! failure && next < pieces.size() )
+      {
+        if ( ! render( lock ) ) changed.wait( lock );
+      }
+    };
+
+    std::vector< std::thread > workers;
+    try
+    {
+      for ( unsigned i = 1; i < threads && i < pieces.size(); ++i )
+      {
+        workers.push_back( std::thread( work ) );
+      }
+
+      // This thread writes the pieces in order, rendering whenever the next one is not ready
+      std::unique_lock< std::mutex > lock( mutex );
+      while ( ! failure && written < pieces.size() )
+      {
+        if ( ready[written] )
+        {
+          std::string piece;
+          piece.swap( results[written++] );
+          changed.notify_all();
+
+          lock.unlock();
+          output.write( piece.data(), piece.size() );
+          lock.lock();
+        }
+        else if ( ! render( lock ) )
+        {
+          changed.wait( lock );
+        }
+      }
+    }
+    catch ( ... )
+    {
+      std::lock_guard< std::mutex > lock( mutex );
+      if ( ! failure ) failure = std::current_exception();
+      changed.notify_all();
+    }
+
+    // Workers stop once a piece has failed, so they can all be joined before reporting it
+    for ( std::vector< std::thread >::iterator it = workers.begin(); it != workers.end(); ++it )
+    {
+      it->join();
+    }
+
+    if ( failure )
+    {
+      std::rethrow_exception( failure );
+    }
+    output.flush();
+  }
+
+
+  void writeToStream( Object& obj, std::ostream& output, Format format, unsigned threads )
+  {
+    if ( threads <= 1 )
+    {
+      writeToStream( obj, output, format );
+    }
+    else
+    {
+      writeParallel( obj, output, format, threads );
+    }
+  }
+
+
+  void writeToStream( Object& obj, std::ostream& output )
+  {
+    writeToStream( obj, output, Format::Pretty );
+  }
+
+
+  void writeToStream( Object& obj, std::ostream& output, Format format )
+  {
+    {
+      OutputBuffer buffer( output );
+      writeToBuffer( obj, buffer, format );
+    }
+    output.flush();
+  }
+
+
+  void writeToStream( Object& obj, std::ostream& output, Format format, Trace& trace )
+  {
+    Trace::Span span( &trace, "write", "write" );
+    writeToStream( obj, output, format );
+  }
+
+
+  void writeToString( Object& obj, std::string& output )
+  {
+    writeToString( obj, output, Format::Pretty );
+  }
+
+
+  void writeToString( Object& obj, std::string& output, Format format )
+  {
+    output.clear();
+    OutputBuffer buffer( output );
+    writeToBuffer( obj, buffer, format );
+  }
+
+
+  void writeToStream( Object& obj, std::ostream& output, Format format, References references )
+  {
+    WrittenAnchors anchors;
+    {
+      OutputBuffer buffer( output );
+      if ( references == References::Preserve ) buffer.preserveReferences( &anchors );
+      writeToBuffer( obj, buffer, format );
+    }
+    output.flush();
+  }
+
+
+  void writeToString( Object& obj, std::string& output, Format format, References references )
+  {
+    WrittenAnchors anchors;
+    output.clear();
+    OutputBuffer buffer( output );
+    if ( references == References::Preserve ) buffer.preserveReferences( &anchors );
+    writeToBuffer( obj, buffer, format );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // JSON writing
+
+  void printJSONQuote( OutputBuffer& output, const std::string& text )
+  {
+    static const char hex[] = "0123456789abcdef";
+
+    output.put( '"' );
+
+    // Copy the runs between characters that need escaping in one go
+    const char* run = text.data();
+    const char* end = run + text.size();
+    for ( const char* it = run; it != end; ++it )
+    {
+      unsigned char c = static_cast<unsigned char>( *it );
+      if ( c >= 0x20 && c != '"' && c != '\\' ) continue;
+
+      output.write( run, it - run );
+      run = it + 1;
+      switch ( c )
+      {
+        case '"' : output.write( "\\\"", 2 ); break;
+        case '\\' : output.write( "\\\\", 2 ); break;
+        case '\n' : output.write( "\\n", 2 ); break;
+        case '\t' : output.write( "\\t", 2 ); break;
+        case '\r' : output.write( "\\r", 2 ); break;
+        case '\b' : output.write( "\\b", 2 ); break;
+        case '\f' : output.write( "\\f", 2 ); break;
+        default :
+          output.write( "\\u00", 4 );
+          output.put( hex[c >> 4] );
+          output.put( hex[c & 0xF] );
+          break;
+      }
+    }
+    output.write( run, end - run );
+
+    output.put( '"' );
+  }
+
+
+  // CON allows a leading '+', leading zeros and a trailing point, JSON does not
+  void printJSONNumber( OutputBuffer& output, const std::string& text )
+  {
+    std::string::const_iterator it = text.begin();
+    if ( it != text.end() && (*it) == '+' ) ++it;
+    if ( it != text.end() && (*it) == '-' )
+    {
+      output.put( '-' );
+      ++it;
+    }
+
+    while ( it != text.end() && (*it) == '0' && ( it + 1 ) != text.end() && std::isdigit( *( it + 1 ) ) ) ++it;
+
+    for ( ; it != text.end(); ++it )
+    {
+      output.put( *it );
+      if ( (*it) == '.' && ( ( it + 1 ) == text.end() || ! std::isdigit( *( it + 1 ) ) ) ) output.put( '0' );
+    }
+  }
+
+
+  void printJSON( const Object& obj, OutputBuffer& output, size_t indent, bool pretty )
+  {
+    if ( obj._type == Type::Object )
+    {
+      if ( obj._children.empty() )
+      {
+        output.write( "{}", 2 );
+        return;
+      }
+
+      output.put( '{' );
+      ++indent;
+      for ( Object::ObjectMap::const_iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+      {
+        if ( it != obj._children.begin() ) output.put( ',' );
+        if ( pretty )
+        {
+          output.put( '\n' );
+          output.indent( indent );
+        }
+        printJSONQuote( output, it->first );
+        if ( pretty )
+          output.write( ": ", 2 );
+        else
+          output.put( ':' );
+        printJSON( *it->second, output, indent, pretty );
+        output.check();
+      }
+      --indent;
+      if ( pretty )
+      {
+        output.put( '\n' );
+        output.indent( indent );
+      }
+      output.put( '}' );
+    }
+    else if ( obj._type == Type::Array )
+    {
+      if ( obj._array.empty() )
+      {
+        output.write( "[]", 2 );
+        return;
+      }
+
+      output.put( '[' );
+      ++indent;
+      for ( Object::Array::const_iterator it = obj._array.begin(); it != obj._array.end(); ++it )
+      {
+        if ( it != obj._array.begin() ) output.put( ',' );
+        if ( pretty )
+        {
+          output.put( '\n' );
+          output.indent( indent );
+        }
+        printJSON( *(*it), output, indent, pretty );
+        output.check();
+      }
+      --indent;
+      if ( pretty )
+      {
+        output.put( '\n' );
+        output.indent( indent );
+      }
+      output.put( ']' );
+    }
+    else
+    {
+      switch( obj._type )
+      {
+        case Type::String :
+          printJSONQuote( output, obj._value );
+          break;
+
+        case Type::Numeric :
+          printJSONNumber( output, obj._value );
+          break;
+
+        case Type::Boolean :
+          output.write( obj._value );
+          break;
+
+        default :
+          output.write( "null", 4 );
+          break;
+      }
+    }
+  }
+
+
+  void writeJSON( Object& obj, std::ostream& output )
+  {
+    writeJSON( obj, output, Format::Compact );
+  }
+
+
+  void writeJSON( Object& obj, std::ostream& output, Format format )
+  {
+    {
+      OutputBuffer buffer( output );
+      printJSON( obj, buffer, 0, format == Format::Pretty );
+      buffer.put( '\n' );
+    }
+    output.flush();
+  }
+
+
+  Object buildFromJSON( std::istream& input )
+  {
+    ParseOptions options;
+    options.json = true;
+    return buildFromStream( input, options );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Streaming writer member function definitions
+
+  Writer::Writer( std::ostream& output ) :
+    Writer( output, Format::Pretty )
+  {
+  }
+
+
+  Writer::Writer( std::ostream& output, Format format ) :
+    _buffer( output ),
+    _format( format ),
+    _stack(),
+    _complete( false )
+  {
+  }
+
+
+  Writer::Writer( std::string& output ) :
+    Writer( output, Format::Pretty )
+  {
+  }
+
+
+  Writer::Writer( std::string& output, Format format ) :
+    _buffer( output ),
+    _format( format ),
+    _stack(),
+    _complete( false )
+  {
+  }
+
+
+  void Writer::_beginValue( bool container )
+  {
+    if ( _complete )
+    {
+      throw Exception( "Writer has already completed the root value" );
+    }
+
+    if ( _stack.empty() ) return;
+
+    Level& level = _stack.back();
+    if ( level.type == Type::Object )
+    {
+      if ( ! level.hasKey )
+      {
+        throw Exception( "Writer expected a key before the value" );
+      }
+      if ( container && _format == Format::Pretty ) _buffer.put( '\n' );
+    }
+    else
+    {
+      if ( level.count > 0 )
+      {
+        if ( _format == Format::Pretty )
+          _buffer.write( ",\n", 2 );
+        else
+          _buffer.put( ',' );
+      }
+      if ( ! container && _format == Format::Pretty ) _buffer.indent( _stack.size() );
+    }
+  }
+
+
+  void Writer::_endValue()
+  {
+    if ( _stack.empty() )
+    {
+      _buffer.put( '\n' );
+      _buffer.flush();
+      _complete = true;
+      return;
+    }
+
+    Level& level = _stack.back();
+    level.hasKey = false;
+    ++level.count;
+    _buffer.check();
+  }
+
+
+  void Writer::_begin( Type type, char bracket )
+  {
+    _beginValue( true );
+
+    if ( _format == Format::Pretty )
+    {
+      _buffer.indent( _stack.size() );
+      _buffer.put( bracket );
+      _buffer.put( '\n' );
+    }
+    else
+    {
+      _buffer.put( bracket );
+    }
+
+    Level level;
+    level.type = type;
+    level.count = 0;
+    level.hasKey = false;
+    _stack.push_back( level );
+  }
+
+
+  void Writer::beginObject()
+  {
+    _begin( Type::Object, '{' );
+  }
+
+
+  void Writer::beginArray()
+  {
+    _begin( Type::Array, '[' );
+  }
+
+
+  void Writer::key( const std::string& name )
+  {
+    if ( _stack.empty() || _stack.back().type != Type::Object )
+    {
+      throw Exception( "Writer can only write a key within an object" );
+    }
+
+    Level& level = _stack.back();
+    if ( level.hasKey )
+    {
+      throw Exception( std::string( "Writer expected a value for key: " ) + name );
+    }
+
+    // Identifiers are unquoted, so cannot contain any character the parser treats as syntax
+    if ( name.empty() || name.find_first_of( " \t\r\n:,{}[]\"<>#\\" ) != std::string::npos )
+    {
+      throw Exception( std::string( "Invalid identifier for writing: " ) + name );
+    }
+
+    if ( _format == Format::Pretty )
+    {
+      if ( level.count > 0 ) _buffer.write( ",\n", 2 );
+      _buffer.indent( _stack.size() );
+      _buffer.write( name );
+      _buffer.write( " : ", 3 );
+    }
+    else
+    {
+      if ( level.count > 0 ) _buffer.put( ',' );
+      _buffer.write( name );
+      _buffer.put( ':' );
+    }
+
+    level.hasKey = true;
+  }
+
+
+  void Writer::value( const std::string& text )
+  {
+    _beginValue( false );
+    parseQuote( _buffer, text );
+    _endValue();
+  }
+
+
+  void Writer::value( const char* text )
+  {
+    value( std::string( text ) );
+  }
+
+
+  void Writer::value( int number )
+  {
+    _beginValue( false );
+    _buffer.write( std::to_string( number ) );
+    _endValue();
+  }
+
+
+  void Writer::value( long number )
+  {
+    _beginValue( false );
+    _buffer.write( std::to_string( number ) );
+    _endValue();
+  }
+
+
+  void Writer::value( unsigned long number )
+  {
+    _beginValue( false );
+    _buffer.write( std::to_string( number ) );
+    _endValue();
+  }
+
+
+  void Writer::value( float number )
+  {
+    _beginValue( false );
+    _buffer.write( std::to_string( number ) );
+    _endValue();
+  }
+
+
+  void Writer::value( double number )
+  {
+    _beginValue( false );
+    _buffer.write( std::to_string( number ) );
+    _endValue();
+  }
+
+
+  void Writer::value( bool boolean )
+  {
+    _beginValue( false );
+    if ( boolean )
+      _buffer.write( "true", 4 );
+    else
+      _buffer.write( "false", 5 );
+    _endValue();
+  }
+
+
+  void Writer::null()
+  {
+    _beginValue( false );
+    _buffer.write( "null", 4 );
+    _endValue();
+  }
+
+
+  void Writer::value( const Object& obj )
+  {
+    bool container = ( obj.getType() == Type::Object || obj.getType() == Type::Array );
+    _beginValue( container );
+
+    if ( _format == Format::Compact )
+      printCompact( obj, _buffer );
+    else if ( container )
+      printObject( obj, _buffer, _stack.size() );
+    else
+      printValue( obj, _buffer );
+
+    _endValue();
+  }
+
+
+  void Writer::end()
+  {
+    if ( _stack.empty() )
+    {
+      throw Exception( "Writer has no open object or array to end" );
+    }
+
+    const Level& level = _stack.back();
+    if ( level.hasKey )
+    {
+      throw Exception( "Writer expected a value before the end of the object" );
+    }
+
+    char bracket = ( level.type == Type::Object ) ? '}' : ']';
+    bool empty = ( level.count == 0 );
+    _stack.pop_back();
+
+    if ( _format == Format::Pretty )
+    {
+      if ( ! empty ) _buffer.put( '\n' );
+      _buffer.indent( _stack.size() );
+    }
+    _buffer.put( bracket );
+
+    _endValue();
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // The parsing logic
+
+  Object buildFromFile( std::string filename )
+  {
+    return buildFromFile( filename, ParseOptions() );
+  }
+
+
+  Object buildFromFile( std::string filename, const ParseOptions& options )
+  {
+    InputFile infile( filename );
+
+    if ( ! infile.is_open() )
+    {
+      std::string string( "Failed to open file \"" );
+      string += filename;
+      string += "\"";
+      throw Exception( string );
+    }
+
+    ErrorList errorList;
+    Object object;
+
+    parseFile( infile, options, filename, errorList, object, schemaRoot( options ) );
+
+    if ( errorList.size() > 0 )
+    {
+      Exception ex( std::move( errorList ) );
+      ex.setFilename( filename );
+      throw ex;
+    }
+
+    return object;
+  }
+
+
+  Object buildFromString( std::string& data )
+  {
+    return buildFromString( data, ParseOptions() );
+  }
+
+
+  Object buildFromString( std::string& data, const ParseOptions& options )
+  {
+    std::stringstream ss( data );
+
+    return buildFromStream( ss, options );
+  }
+
+
+  Object buildFromStream( std::istream& input )
+  {
+    return buildFromStream( input, ParseOptions() );
+  }
+
+
+  Object buildFromStream( std::istream& input, const ParseOptions& options )
+  {
+    ErrorList errorList;
+    Object object;
+
+    parseStream( input, options, std::string(), errorList, object, schemaRoot( options ) );
+
+    if ( errorList.size() > 0 )
+      throw Exception( std::move( errorList ) );
+
+    return object;
+  }
+
+
+  void parseInto( Object& object, std::string filename )
+  {
+    parseInto( object, filename, ParseOptions() );
+  }
+
+
+  void parseInto( Object& object, std::string filename, const ParseOptions& options )
+  {
+    InputFile infile( filename );
+
+    if ( ! infile.is_open() )
+    {
+      std::string string( "Failed to open file \"" );
+      string += filename;
+      string += "\"";
+      throw Exception( string );
+    }
+
+    ErrorList errorList;
+    parseFile( infile, options, filename, errorList, object, schemaRoot( options ) );
+
+    if ( errorList.size() > 0 )
+    {
+      Exception ex( std::move( errorList ) );
+      ex.setFilename( filename );
+      throw ex;
+    }
+  }
+
+
+  void parseInto( Object& object, std::istream& input )
+  {
+    parseInto( object, input, ParseOptions() );
+  }
+
+
+  void parseInto( Object& object, std::istream& input, const ParseOptions& options )
+  {
+    ErrorList errorList;
+    parseStream( input, options, std::string(), errorList, object, schemaRoot( options ) );
+
+    if ( errorList.size() > 0 )
+      throw Exception( std::move( errorList ) );
+  }
+
+
+  ParseResult tryBuildFromFile( std::string filename )
+  {
+    return tryBuildFromFile( filename, ParseOptions() );
+  }
+
+
+  ParseResult tryBuildFromFile( std::string filename, const ParseOptions& options )
+  {
+    ParseResult result;
+    InputFile infile( filename );
+
+    if ( ! infile.is_open() )
+    {
+      result.errors.push_back( ParseError{ ParseError::FileNotOpened, ParseError::npos, std::string(), std::string(), filename, nullptr } );
+      return result;
+    }
+
+    parseFile( infile, options, filename, result.errors, result.object, schemaRoot( options ) );
+    return result;
+  }
+
+
+  ParseResult tryBuildFromStream( std::istream& input )
+  {
+    return tryBuildFromStream( input, ParseOptions() );
+  }
+
+
+  ParseResult tryBuildFromStream( std::istream& input, const ParseOptions& options )
+  {
+    ParseResult result;
+    parseStream( input, options, std::string(), result.errors, result.object, schemaRoot( options ) );
+    return result;
+  }
+
+
+  void parseStream( std::istream& input, const ParseOptions& options, const std::string& file, ErrorList& errorList, Object& object, const Schema::Node* schema )
+  {
+    StatsScope stats( options.stats, object );
+    Diagnostics diagnostics( errorList, options.errorLimit, file );
+    Lexer lexer( input, options, diagnostics );
+
+    // Token list. Each token is lexed in place so its string is not copied
+    std::vector< Token > tokens;
+    {
+      Trace::Span span( options.trace, "lex", "parse", file );
+      do
+      {
+        tokens.emplace_back();
+      }
+      while ( lexer.next( tokens.back() ) );
+      tokens.pop_back();
+    }
+    stats.tokens( tokens, tokens.size() );
+
+    Trace::Span span( options.trace, "build", "parse", file );
+    ParseContext context( options, diagnostics );
+    parseRoot( tokens.begin(), tokens.end(), context, object, schema );
+  }
+
+
+  void parseFile( InputFile& input, const ParseOptions& options, const std::string& file, ErrorList& errorList, Object& object, const Schema::Node* schema )
+  {
+    size_t first = errorList.size();
+
+    // An unsupported format is known before anything is read
+    if ( input.error().empty() )
+    {
+      parseStream( input, options, file, errorList, object, schema );
+    }
+    else
+    {
+      object.setType( Type::Null );
+    }
+
+    // Ahead of the errors that the data ending early caused
+    if ( ! input.error().empty() )
+    {
+      errorList.insert( errorList.begin() + first, ParseError{ ParseError::DecompressionFailed, ParseError::npos, file, std::string(), input.error(), nullptr } );
+    }
+  }
+
+
+  void parseRoot( std::vector<Token>::iterator root_begin, std::vector<Token>::iterator root_end, ParseContext& context, Object& object, const Schema::Node* schema )
+  {
+    if ( context.options.json )
+    {
+      // Any value may be the root of a JSON document
+      if ( root_begin == root_end )
+      {
+        context.error( ParseError::RootNotFound, ParseError::npos );
+        object.setType( Type::Null );
+      }
+      else if ( root_begin->type == Token::OpenObject )
+      {
+        const Token& open = *root_begin;
+        if ( ! checkSchemaValue( schema, Type::Object, open, std::string(), context ) ) schema = nullptr;
+        parseTokens( ++root_begin, root_end, context, object, schema );
+      }
+      else if ( root_begin->type == Token::OpenArray )
+      {
+        const Token& open = *root_begin;
+        if ( ! checkSchemaValue( schema, Type::Array, open, std::string(), context ) ) schema = nullptr;
+        parseArray( ++root_begin, root_end, context, object, schema );
+      }
+      else if ( root_begin->type == Token::Quote )
+      {
+        checkSchemaValue( schema, Type::String, *root_begin, std::string(), context );
+        Rebuild::assign( object, root_begin->string, Type::String );
+      }
+      else
+      {
+        Type valid_type;
+        if ( root_begin->type == Token::Text && validateExpression( root_begin->string, valid_type ) )
+        {
+          checkSchemaValue( schema, valid_type, *root_begin, std::string(), context );
+          Rebuild::assign( object, root_begin->string, valid_type );
+        }
+        else
+        {
+          context.error( ParseError::InvalidRoot, root_begin->offset );
+          object.setType( Type::Null );
+        }
+      }
+    }
+    else
+    {
+      // Find the start of the root node
+      while( (root_begin != root_end) && (root_begin->type != Token::OpenObject) ) ++root_begin;
+
+      if ( root_begin == root_end )
+      {
+        context.error( ParseError::RootNotFound, ParseError::npos );
+        object.setType( Type::Null );
+        return;
+      }
+
+      if ( ! checkSchemaValue( schema, Type::Object, *root_begin, std::string(), context ) ) schema = nullptr;
+      parseTokens( ++root_begin, root_end, context, object, schema );
+    }
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Document stream member function definitions
+
+  struct DocumentStream::State
+  {
+    State( std::istream& input, const ParseOptions& opts ) :
+      options( opts ), errors(), diagnostics( errors, options.errorLimit, std::string() ), lexer( input, options, diagnostics ),
+      tokens(), used( 0 ), brackets(), count( 0 ) {}
+
+    ParseOptions options;
+
+    // Errors of the current document
+    ErrorList errors;
+    Diagnostics diagnostics;
+    Lexer lexer;
+
+    // Tokens of the current document. The first used are valid, the rest are kept for their storage
+    std::vector< Token > tokens;
+    size_t used;
+
+    // Closing brackets expected, innermost last
+    std::vector< Token::Type > brackets;
+
+    size_t count;
+
+    // Read the tokens of the next document. Returns false if the input holds no more
+    bool read();
+  };
+
+
+  bool DocumentStream::State::read()
+  {
+    brackets.clear();
+    used = 0;
+
+    while ( true )
+    {
+      if ( used == tokens.size() ) tokens.emplace_back();
+      Token& token = tokens[used];
+      if ( ! lexer.next( token ) ) break;
+
+      // Skip ahead to the start of a root
+      if ( used == 0 && ! options.json && token.type != Token::OpenObject ) continue;
+
+      ++used;
+      switch ( token.type )
+      {
+        case Token::OpenObject :
+          brackets.push_back( Token::CloseObject );
+          break;
+
+        case Token::OpenArray :
+          brackets.push_back( Token::CloseArray );
+          break;
+
+        case Token::CloseObject :
+        case Token::CloseArray :
+          // A bracket also closes anything left open inside it, so one mistake cannot swallow the
+          // documents after it
+          if ( std::find( brackets.begin(), brackets.end(), token.type ) != brackets.end() )
+          {
+            while ( brackets.back() != token.type ) brackets.pop_back();
+            brackets.pop_back();
+          }
+          break;
+
+        default :
+          break;
+      }
+
+      if ( brackets.empty() ) return true;
+    }
+
+    // An unclosed document is reported when it is parsed
+    return used > 0;
+  }
+
+
+  DocumentStream::DocumentStream( std::istream& input ) :
+    _state( new State( input, ParseOptions() ) )
+  {
+  }
+
+
+  DocumentStream::DocumentStream( std::istream& input, const ParseOptions& options ) :
+    _state( new State( input, options ) )
+  {
+  }
+
+
+  DocumentStream::DocumentStream( DocumentStream&& ) = default;
+  DocumentStream& DocumentStream::operator=( DocumentStream&& ) = default;
+  DocumentStream::~DocumentStream() = default;
+
+
+  bool DocumentStream::next( Object& object )
+  {
+    State& state = *_state;
+    state.errors.clear();
+
+    // Errors of the next document only point into it, so the newlines before it need not be kept
+    state.diagnostics.restart();
+
+    StatsScope stats( state.options.stats, object );
+    {
+      Trace::Span span( state.options.trace, "lex", "parse" );
+      if ( ! state.read() ) return false;
+    }
+    stats.tokens( state.tokens, state.used );
+    ++state.count;
+
+    Trace::Span span( state.options.trace, "build", "parse" );
+    ParseContext context( state.options, state.diagnostics );
+    parseRoot( state.tokens.begin(), state.tokens.begin() + state.used, context, object, schemaRoot( state.options ) );
+
+    if ( ! state.errors.empty() )
+    {
+      throw Exception( std::move( state.errors ) );
+    }
+    return true;
+  }
+
+
+  size_t DocumentStream::count() const
+  {
+    return _state->count;
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Lexer member function definitions
+
+  Lexer::Lexer( std::istream& input, const ParseOptions& options, Diagnostics& diagnostics ) :
+    _input( input ),
+    _buffer( CON_BUFFER_SIZE ),
+    _position( 0 ),
+    _size( 0 ),
+    _consumed( 0 ),
+    _json( options.json ),
+    _utf8( options.validateUtf8 ),
+    _escapes( options.json || options.decodeEscapes ),
+    _diagnostics( diagnostics ),
+    _stats( options.stats ),
+    _trace( options.trace )
+  {
+  }
+
+
+  bool Lexer::_refill()
+  {
+    Trace::Span span( _trace, "read", "read" );
+    ParseStats::Phase previous = _stats ? switchPhase( *_stats, ParseStats::Read ) : ParseStats::Read;
+
+    _consumed += _size;
+    _input.read( _buffer.data(), _buffer.size() );
+    _size = _input.gcount();
+    _position = 0;
+
+    if ( _stats )
+    {
+      switchPhase( *_stats, previous );
+      _stats->bytes += _size;
+    }
+    return _size > 0;
+  }
+
+
+  bool Lexer::next( Token& token )
+  {
+    token.string.clear();
+    token.type = Token::Text;
+
+    if ( _diagnostics.full() ) return false;
+
+    int c;
+    while ( ( c = _peek() ) != -1 )
+    {
+      Token::Type punctuation;
+      switch ( c )
+      {
+        case '\n' :
+        case ' ' :
+        case '\t' :
+        case '\r' :
+          if ( token.string.size() > 0 )
+          {
+            return true;
+          }
+          if ( c == '\n' ) _diagnostics.newline( _offset() );
+          ++_position;
+          continue;
+
+        case '#' :
+          if ( token.string.size() > 0 )
+          {
+            return true;
+          }
+          // Comments run to the end of the line
+          while ( ( c = _peek() ) != -1 && c != '\n' ) ++_position;
+          continue;
+
+        case '\\' :
+          // Take the next character literally
+          if ( token.string.size() == 0 ) token.offset = _offset();
+          ++_position;
+          if ( ( c = _peek() ) == -1 ) continue;
+          if ( c == '\n' ) _diagnostics.newline( _offset() );
+          ++_position;
+          token.string.push_back( static_cast<char>( c ) );
+          continue;
+
+        case '"' :
+        case '<' :
+          if ( c == '<' && _json )
+          {
+            if ( token.string.size() == 0 ) token.offset = _offset();
+            token.string.push_back( static_cast<char>( c ) );
+            ++_position;
+            continue;
+          }
+          if ( token.string.size() > 0 )
+          {
+            return true;
+          }
+          token.offset = _offset();
+          ++_position;
+          return _scanQuote( token, ( c == '"' ) ? '"' : '>' );
+
+        case '{' : punctuation = Token::OpenObject; break;
+        case '}' : punctuation = Token::CloseObject; break;
+        case '[' : punctuation = Token::OpenArray; break;
+        case ']' : punctuation = Token::CloseArray; break;
+        case ',' : punctuation = Token::Comma; break;
+        case ':' : punctuation = Token::Colon; break;
+
+        default :
+          if ( token.string.size() == 0 ) token.offset = _offset();
+          token.string.push_back( static_cast<char>( c ) );
+          ++_position;
+          continue;
+      }
+
+      // Punctuation ends any text in progress and is returned on the next call
+      if ( token.string.size() == 0 )
+      {
+        token.offset = _offset();
+        token.string.push_back( static_cast<char>( c ) );
+        token.type = punctuation;
+        ++_position;
+      }
+      return true;
+    }
+
+    // End of input
+    if ( token.string.size() == 0 ) token.offset = _offset();
+    return token.string.size() > 0;
+  }
+
+
+  bool Lexer::skipContainer()
+  {
+    size_t depth = 1;
+
+    while ( _position < _size || _refill() )
+    {
+      const char* it = _buffer.data() + _position;
+      const char* end = _buffer.data() + _size;
+
+      // Find the next character that matters
+      while ( it != end )
+      {
+        char c = *it;
+        if ( c == '{' || c == '}' || c == '[' || c == ']' || c == '"' || c == '\\' || c == '\n' || c == '#' || ( c == '<' && ! _json ) ) break;
+        ++it;
+      }
+      _position = it - _buffer.data();
+      if ( it == end ) continue;
+
+      char c = *it;
+      ++_position;
+      switch ( c )
+      {
+        case '{' :
+        case '[' :
+          ++depth;
+          break;
+
+        case '}' :
+        case ']' :
+          if ( --depth == 0 ) return true;
+          break;
+
+        case '\n' :
+          // Nothing skipped is pointed to by an error unless it is in an unterminated string, so
+          // only the latest newline is kept
+          _diagnostics.newline( _offset() - 1 );
+          _diagnostics.restart();
+          break;
+
+        case '\\' :
+          if ( _peek() == '\n' ) _diagnostics.newline( _offset() );
+          if ( _peek() != -1 ) ++_position;
+          break;
+
+        case '#' :
+          while ( ( c = _peek() ) != -1 && c != '\n' ) ++_position;
           break;
-        case Token::Colon :
-          std::cout << " Colon ";
+
+        default :
+        {
+          // Strings and file paths may hold brackets
+          char terminator = ( c == '"' ) ? '"' : '>';
+          size_t quote = _offset() - 1;
+          int q;
+          while ( ( q = _get() ) != -1 && q != terminator )
+          {
+            if ( q == '\n' ) _diagnostics.newline( _offset() - 1 );
+            else if ( q == '\\' )
+            {
+              if ( _peek() == '\n' ) _diagnostics.newline( _offset() );
+              if ( _peek() != -1 ) ++_position;
+            }
+          }
+          if ( q == -1 )
+          {
+            _diagnostics.add( ( terminator == '"' ) ? ParseError::UnterminatedString : ParseError::UnterminatedFilepath, quote );
+            return false;
+          }
           break;
-        case Token::Comma :
-          std::cout << " Comma ";
+        }
+      }
+    }
+
+    _diagnostics.add( ParseError::UnexpectedEnd, _offset() );
+    return false;
+  }
+
+
+  // Length of the run before the first byte that is the terminator, a backslash or a newline, or
+  // outside ASCII when checking UTF-8. Blocks of sixteen bytes are tested at once with SSE2
+  size_t plainLength( const char* begin, const char* end, char terminator, bool ascii )
+  {
+    const char* it = begin;
+
+#if defined( __SSE2__ ) && ! defined( CON_NO_SIMD )
+    const __m128i quote = _mm_set1_epi8( terminator );
+    const __m128i backslash = _mm_set1_epi8( '\\' );
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const int high = ascii ? 0xFFFF : 0;
+
+    for ( ; end - it >= 16; it += 16 )
+    {
+      __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( it ) );
+      __m128i special = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( block, quote ), _mm_cmpeq_epi8( block, backslash ) ), _mm_cmpeq_epi8( block, newline ) );
+
+      // The sign bit of each byte marks non-ASCII
+      int mask = _mm_movemask_epi8( special ) | ( _mm_movemask_epi8( block ) & high );
+      if ( mask != 0 ) return ( it - begin ) + __builtin_ctz( mask );
+    }
+#endif
+
+    while ( it != end && *it != terminator && *it != '\\' && *it != '\n' && ! ( ascii && ( *it & 0x80 ) ) ) ++it;
+    return it - begin;
+  }
+
+
+  bool Lexer::_scanQuote( Token& token, char terminator )
+  {
+    token.type = ( terminator == '"' ) ? Token::Quote : Token::Filepath;
+    bool validate = _utf8 && token.type == Token::Quote;
+
+    while ( _position < _size || _refill() )
+    {
+      // Copy everything up to the next special character in one go
+      const char* start = _buffer.data() + _position;
+      size_t length = plainLength( start, _buffer.data() + _size, terminator, validate );
+
+      token.string.append( start, length );
+      _position += length;
+      if ( _position == _size ) continue;
+
+      char c = _buffer[_position];
+      if ( c & 0x80 )
+      {
+        _scanUtf8( token.string );
+        continue;
+      }
+      ++_position;
+
+      if ( c == terminator )
+      {
+        return true;
+      }
+      else if ( c == '\n' )
+      {
+        _diagnostics.newline( _offset() - 1 );
+        token.string.push_back( '\n' );
+      }
+      else
+      {
+        int escaped = _peek();
+        if ( escaped == -1 ) break;
+
+        if ( escaped == '\n' ) _diagnostics.newline( _offset() );
+        ++_position;
+
+        // File paths, and strings unless decoding, are taken literally. Other escaped characters
+        // stand for themselves
+        if ( _escapes && token.type == Token::Quote )
+        {
+          switch ( escaped )
+          {
+            case 'n' : token.string.push_back( '\n' ); break;
+            case 't' : token.string.push_back( '\t' ); break;
+            case 'r' : token.string.push_back( '\r' ); break;
+            case 'u' : _scanUnicode( token.string ); break;
+            case 'b' : token.string.push_back( _json ? '\b' : 'b' ); break;
+            case 'f' : token.string.push_back( _json ? '\f' : 'f' ); break;
+            default : token.string.push_back( static_cast<char>( escaped ) ); break;
+          }
+        }
+        else
+        {
+          token.string.push_back( static_cast<char>( escaped ) );
+        }
+      }
+    }
+
+    _diagnostics.add( ( terminator == '"' ) ? ParseError::UnterminatedString : ParseError::UnterminatedFilepath, token.offset );
+    return false;
+  }
+
+
+  void Lexer::_scanUtf8( std::string& output )
+  {
+    size_t offset = _offset();
+    unsigned char lead = static_cast<unsigned char>( _buffer[_position++] );
+    output.push_back( static_cast<char>( lead ) );
+
+    // Stray continuation bytes after a bad sequence belong to the same error. Anything else is
+    // left for the caller, it may be the closing quote
+    auto reject = [ this, &output, offset ]()
+    {
+      _diagnostics.add( ParseError::InvalidUtf8, offset );
+      int c;
+      while ( ( c = _peek() ) >= 0x80 && c <= 0xBF )
+      {
+        output.push_back( static_cast<char>( c ) );
+        ++_position;
+      }
+    };
+
+    // Continuation bytes, with tighter bounds on the first to rule out overlong forms, surrogates
+    // and code points beyond U+10FFFF
+    size_t continuation;
+    int low = 0x80;
+    int high = 0xBF;
+
+    if ( lead >= 0xC2 && lead <= 0xDF )
+    {
+      continuation = 1;
+    }
+    else if ( lead >= 0xE0 && lead <= 0xEF )
+    {
+      continuation = 2;
+      if ( lead == 0xE0 ) low = 0xA0;
+      if ( lead == 0xED ) high = 0x9F;
+    }
+    else if ( lead >= 0xF0 && lead <= 0xF4 )
+    {
+      continuation = 3;
+      if ( lead == 0xF0 ) low = 0x90;
+      if ( lead == 0xF4 ) high = 0x8F;
+    }
+    else
+    {
+      reject();
+      return;
+    }
+
+    for ( size_t i = 0; i < continuation; ++i )
+    {
+      int c = _peek();
+      if ( c < low || c > high )
+      {
+        reject();
+        return;
+      }
+
+      output.push_back( static_cast<char>( c ) );
+      ++_position;
+      low = 0x80;
+      high = 0xBF;
+    }
+  }
+
+
+  void Lexer::_scanUnicode( std::string& output )
+  {
+    auto readHex = [ this ]( unsigned long& value ) -> bool
+    {
+      value = 0;
+      for ( int i = 0; i < 4; ++i )
+      {
+        int c = _get();
+        if ( c == -1 || ! std::isxdigit( c ) ) return false;
+        value = value * 16 + ( std::isdigit( c ) ? c - '0' : std::tolower( c ) - 'a' + 10 );
+      }
+      return true;
+    };
+
+    unsigned long code;
+    if ( ! readHex( code ) )
+    {
+      _diagnostics.add( ParseError::InvalidUnicode, _offset() );
+      return;
+    }
+
+    // Surrogate pairs encode characters outside the basic multilingual plane
+    if ( code >= 0xD800 && code <= 0xDBFF )
+    {
+      unsigned long low;
+      if ( _get() != '\\' || _get() != 'u' || ! readHex( low ) || low < 0xDC00 || low > 0xDFFF )
+      {
+        _diagnostics.add( ParseError::InvalidSurrogate, _offset() );
+        return;
+      }
+      code = 0x10000 + ( ( code - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+    }
+    else if ( code >= 0xDC00 && code <= 0xDFFF )
+    {
+      _diagnostics.add( ParseError::InvalidSurrogate, _offset() );
+      return;
+    }
+
+    // Encode as UTF-8
+    if ( code < 0x80 )
+    {
+      output.push_back( static_cast<char>( code ) );
+    }
+    else if ( code < 0x800 )
+    {
+      output.push_back( static_cast<char>( 0xC0 | ( code >> 6 ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( code & 0x3F ) ) );
+    }
+    else if ( code < 0x10000 )
+    {
+      output.push_back( static_cast<char>( 0xE0 | ( code >> 12 ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( code & 0x3F ) ) );
+    }
+    else
+    {
+      output.push_back( static_cast<char>( 0xF0 | ( code >> 18 ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( ( code >> 12 ) & 0x3F ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) ) );
+      output.push_back( static_cast<char>( 0x80 | ( code & 0x3F ) ) );
+    }
+  }
+
+
+  void parseInclude( const Token& token, const std::string& identifier, ParseContext& context, Object& object, const Schema::Node* schema )
+  {
+    IncludeTimer timer( context.options.stats, token.string );
+    Trace::Span span( context.options.trace, "include", "include", token.string );
+
+    if ( context.options.include )
+    {
+      // User handlers report failures by throwing
+      try
+      {
+        object = context.options.include( token.string, context.path );
+      }
+      catch( Exception& ex )
+      {
+        if ( ex.number() == 0 )
+        {
+          context.error( ParseError::IncludeFailed, token.offset, identifier, ex.what() );
+        }
+        else
+        {
+          context.diagnostics.append( ErrorList( ex.begin(), ex.end() ) );
+          if ( context.diagnostics.full() ) context.stopped = true;
+        }
+        object.setType( Type::Null );
+        return;
+      }
+
+      // Only the top level of a tree from a handler is checked
+      checkSchemaContainer( schema, object, token, context );
+    }
+    else
+    {
+      InputFile infile( token.string );
+      if ( ! infile.is_open() )
+      {
+        context.error( ParseError::FileNotOpened, token.offset, identifier, token.string );
+        object.setType( Type::Null );
+        return;
+      }
+
+      // The included file is checked against the rule for the value it replaces
+      ParseOptions options;
+      options.errorLimit = context.diagnostics.limit();
+      options.stats = context.options.stats;
+      options.trace = context.options.trace;
+      options.validateUtf8 = context.options.validateUtf8;
+      options.decodeEscapes = context.options.decodeEscapes;
+
+      ErrorList errors;
+      parseFile( infile, options, token.string, errors, object, schema );
+
+      context.diagnostics.append( errors );
+      if ( context.diagnostics.full() ) context.stopped = true;
+    }
+  }
+
+
+  Object* parseReference( const Token& token, const std::string& identifier, ParseContext& context, const Schema::Node* schema )
+  {
+    Object* shared = context.anchor( token, identifier );
+    if ( shared != nullptr && checkSchemaValue( schema, shared->getType(), token, identifier, context ) )
+    {
+      checkSchemaContainer( schema, *shared, token, context );
+    }
+    return shared;
+  }
+
+
+  void parseTokens( std::vector<Token>::iterator& start, std::vector<Token>::iterator& end, ParseContext& context, Object& object, const Schema::Node* schema )
+  {
+    Rebuild children( object, Type::Object );
+
+    // Awful file
+    if ( start == end )
+    {
+      context.error( ParseError::UnexpectedEnd, (start-1)->offset );
+      context.stopped = true;
+      return;
+    }
+
+    std::vector<Token>::iterator current = start;
+
+    // The empty object
+    if ( current->type == Token::CloseObject )
+    {
+      children.finish();
+      checkSchemaContainer( schema, object, *current, context );
+      start = ++current;
+      return;
+    }
+
+    std::string identifier;
+    const Schema::Node* child_schema = nullptr;
+
+    // Iterate through the tokens
+    while ( current != end && ! context.stopped )
+    {
+//////////////////// The Identifier
+      if ( current->type != Token::Text && ! ( context.options.json && current->type == Token::Quote ) )
+      {
+        context.error( ParseError::InvalidIdentifier, current->offset, current->string );
+        ++current;
+      }
+      else
+      {
+        identifier = current->string;
+        child_schema = schemaProperty( schema, *current, identifier, context );
+        ++current;
+      }
+
+//////////////////// Colon Separator
+      if ( current == end )
+      {
+        context.error( ParseError::ExpectedColon, (current-1)->offset, identifier );
+        context.stopped = true;
+        break;
+      }
+      else if ( current->type != Token::Colon )
+      {
+        context.error( ParseError::ExpectedColon, current->offset, identifier );
+      }
+      else
+      {
+        ++current;
+      }
+
+//////////////////// Anchor naming the value
+      std::string anchor;
+      if ( current != end && isAnchor( *current, context ) )
+      {
+        anchor.assign( current->string, 1, std::string::npos );
+        ++current;
+        if ( current != end && current->type != Token::OpenObject && current->type != Token::OpenArray && current->type != Token::Filepath )
+        {
+          context.error( ParseError::InvalidAnchor, (current-1)->offset, identifier, anchor );
+          anchor.clear();
+        }
+      }
+
+//////////////////// Value expression
+      if ( current == end )
+      {
+        context.error( ParseError::ExpectedValue, (current-1)->offset, identifier );
+        context.stopped = true;
+        break;
+      }
+      else if ( isReference( *current, context ) )
+      {
+        context.path.push_back( identifier );
+        Object* shared = parseReference( *current, identifier, context, child_schema );
+        context.path.pop_back();
+        if ( shared != nullptr ) children.share( identifier, *shared );
+
+        ++current;
+      }
+      else if ( current->type == Token::Text ) 
+      {
+        Type valid_type;
+        if ( ! validateExpression( current->string, valid_type ) )
+        {
+          context.error( ParseError::InvalidExpression, current->offset, identifier, current->string );
+        }
+        else
+        {
+          checkSchemaValue( child_schema, valid_type, *current, identifier, context );
+          Rebuild::assign( children.child( identifier ), current->string, valid_type );
+        }
+
+        ++current;
+      }
+      else if ( current->type == Token::Quote )
+      {
+        checkSchemaValue( child_schema, Type::String, *current, identifier, context );
+        Rebuild::assign( children.child( identifier ), current->string, Type::String );
+
+        ++current;
+      }
+      else if ( current->type == Token::Filepath )
+      {
+        if ( ! checkSchemaValue( child_schema, Type::Object, *current, identifier, context ) ) child_schema = nullptr;
+        context.path.push_back( identifier );
+        Object& child = children.child( identifier );
+        parseInclude( *current, identifier, context, child, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, child );
+        ++current;
+      }
+      else if ( current->type == Token::OpenObject )
+      {
+        if ( ! checkSchemaValue( child_schema, Type::Object, *current, identifier, context ) ) child_schema = nullptr;
+        ++current;
+        context.path.push_back( identifier );
+        Object& child = children.child( identifier );
+        parseTokens( current, end, context, child, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, child );
+      }
+      else if ( current->type == Token::OpenArray )
+      {
+        if ( ! checkSchemaValue( child_schema, Type::Array, *current, identifier, context ) ) child_schema = nullptr;
+        context.path.push_back( identifier );
+        Object& child = children.child( identifier );
+        parseArray( ++current, end, context, child, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, child );
+      }
+      else
+      {
+        context.error( ParseError::InvalidValue, current->offset, identifier );
+        context.stopped = true;
+        break;
+      }
+
+      if ( context.stopped ) break;
+
+//////////////////// Comma or closing bracket
+      if ( current == end )
+      {
+        break;
+      }
+      else if ( current->type == Token::Comma )
+      {
+        ++current;
+        continue;
+      }
+      else if ( current->type == Token::CloseObject )
+      {
+        children.finish();
+        checkSchemaContainer( schema, object, *current, context );
+        start = ++current;
+        return;
+      }
+      else
+      {
+        context.error( ParseError::ExpectedComma, current->offset, identifier );
+      }
+    }
+
+    if ( ! context.stopped )
+    {
+      context.error( ParseError::UnclosedObject, (start-1)->offset );
+    }
+    start = current;
+  }
+
+
+  void parseArray( std::vector<Token>::iterator& start, std::vector<Token>::iterator& end, ParseContext& context, Object& object, const Schema::Node* schema )
+  {
+    if ( start == end )
+    {
+      context.error( ParseError::UnexpectedEnd, (start-1)->offset );
+      context.stopped = true;
+      return;
+    }
+
+    std::vector<Token>::iterator current = start;
+    Rebuild items( object, Type::Array );
+
+    const Schema::Node* item_schema = ( schema != nullptr ) ? schema->items.get() : nullptr;
+
+    // The empty array
+    if ( current->type == Token::CloseArray )
+    {
+      items.finish();
+      checkSchemaContainer( schema, object, *current, context );
+      start = ++current;
+      return;
+    }
+
+    while ( current != end && ! context.stopped )
+    {
+      std::string anchor;
+      if ( isAnchor( *current, context ) )
+      {
+        anchor.assign( current->string, 1, std::string::npos );
+        ++current;
+        if ( current == end )
+        {
+          context.error( ParseError::UnexpectedEnd, (current-1)->offset );
+          context.stopped = true;
           break;
+        }
+        else if ( current->type != Token::OpenObject && current->type != Token::OpenArray && current->type != Token::Filepath )
+        {
+          context.error( ParseError::InvalidAnchor, (current-1)->offset, std::to_string( items.size() ), anchor );
+          anchor.clear();
+        }
+      }
+
+      if ( isReference( *current, context ) )
+      {
+        context.path.push_back( std::to_string( items.size() ) );
+        Object* shared = parseReference( *current, context.path.back(), context, item_schema );
+        context.path.pop_back();
+        if ( shared != nullptr ) items.share( *shared );
+        ++current;
+      }
+      else if ( current->type == Token::Text )
+      {
+        Type valid_type;
+        if ( ! validateExpression( current->string, valid_type ) )
+        {
+          context.error( ParseError::InvalidExpression, current->offset, std::to_string( items.size() ), current->string );
+        }
+        else
+        {
+          checkSchemaValue( item_schema, valid_type, *current, std::to_string( items.size() ), context );
+          Rebuild::assign( items.item(), current->string, valid_type );
+        }
+        ++current;
+      }
+      else if ( current->type == Token::Quote )
+      {
+        checkSchemaValue( item_schema, Type::String, *current, std::to_string( items.size() ), context );
+        Rebuild::assign( items.item(), current->string, Type::String );
+
+        ++current;
+      }
+      else if ( current->type == Token::Filepath )
+      {
+        context.path.push_back( std::to_string( items.size() ) );
+        const Schema::Node* child_schema = checkSchemaValue( item_schema, Type::Object, *current, context.path.back(), context ) ? item_schema : nullptr;
+        Object& item = items.item();
+        parseInclude( *current, context.path.back(), context, item, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, item );
+        ++current;
+      }
+      else if ( current->type == Token::OpenObject )
+      {
+        context.path.push_back( std::to_string( items.size() ) );
+        const Schema::Node* child_schema = checkSchemaValue( item_schema, Type::Object, *current, context.path.back(), context ) ? item_schema : nullptr;
+        Object& item = items.item();
+        parseTokens( ++current, end, context, item, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, item );
+      }
+      else if ( current->type == Token::OpenArray )
+      {
+        context.path.push_back( std::to_string( items.size() ) );
+        const Schema::Node* child_schema = checkSchemaValue( item_schema, Type::Array, *current, context.path.back(), context ) ? item_schema : nullptr;
+        Object& item = items.item();
+        parseArray( ++current, end, context, item, child_schema );
+        context.path.pop_back();
+        if ( ! anchor.empty() ) context.define( anchor, item );
+      }
+      else if ( current->type == Token::CloseArray )
+      {
+        context.error( ParseError::UnexpectedArrayEnd, current->offset );
+        start = ++current;
+        return;
+      }
+      else
+      {
+        context.error( ParseError::InvalidArrayItem, current->offset, std::to_string( items.size() ) );
+        ++current;
+      }
+
+      if ( current == end || context.stopped )
+      {
+        break;
+      }
+      else if ( current->type == Token::Comma )
+      {
+        ++current;
+        continue;
+      }
+      else if ( current->type == Token::CloseArray )
+      {
+        items.finish();
+        checkSchemaContainer( schema, object, *current, context );
+        start = ++current;
+        return;
+      }
+      else
+      {
+        context.error( ParseError::ExpectedArrayComma, current->offset, std::to_string( items.size() ) );
+        ++current;
+      }
+
+    }
+
+    if ( ! context.stopped )
+    {
+      context.error( ParseError::UnclosedArray, (start-1)->offset );
+    }
+    start = current;
+    return;
+  }
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Pull parser member function definitions
+
+  // Produces the tokens of a tree that is already built, as if it had been written out and lexed
+  // again. Used for trees returned by include handlers. The tokens have no offset
+  class TreeLexer
+  {
+    private:
+      // An open object or array and how far through it the tokens have got
+      struct Frame
+      {
+        enum Step { Separator, Item, Colon, Value };
+
+        const Object* object;
+        Object::ObjectMap::const_iterator key;
+        size_t index;
+        Step step;
+        bool first;
+      };
+
+      Object _root;
+      std::vector<Frame> _frames;
+      bool _started;
+
+      // The token starting a value, opening a frame for a container
+      void _value( const Object& object, Token& token )
+      {
+        switch ( object._type )
+        {
+          case Type::Object :
+            token.type = Token::OpenObject;
+            _frames.push_back( Frame{ &object, object._children.begin(), 0, Frame::Separator, true } );
+            break;
+
+          case Type::Array :
+            token.type = Token::OpenArray;
+            _frames.push_back( Frame{ &object, Object::ObjectMap::const_iterator(), 0, Frame::Separator, true } );
+            break;
+
+          case Type::String :
+            token.type = Token::Quote;
+            token.string = object._value;
+            break;
+
+          case Type::Null :
+            token.type = Token::Text;
+            token.string = "null";
+            break;
+
+          default :
+            token.type = Token::Text;
+            token.string = object._value;
+            break;
+        }
+      }
+
+    public:
+      explicit TreeLexer( Object&& root ) : _root( std::move( root ) ), _frames(), _started( false ) {}
+
+      // Fill the next token. Returns false once the root value is complete
+      bool next( Token& token )
+      {
+        token.string.clear();
+        token.offset = 0;
+
+        if ( ! _started )
+        {
+          _started = true;
+          _value( _root, token );
+          return true;
+        }
+        if ( _frames.empty() ) return false;
+
+        // The step is moved on before a child may push a frame of its own
+        Frame& frame = _frames.back();
+        bool object = frame.object->_type == Type::Object;
+        switch ( frame.step )
+        {
+          case Frame::Separator :
+            if ( object ? frame.key == frame.object->_children.end() : frame.index == frame.object->_array.size() )
+            {
+              token.type = object ? Token::CloseObject : Token::CloseArray;
+              _frames.pop_back();
+              return true;
+            }
+            if ( ! frame.first )
+            {
+              token.type = Token::Comma;
+              frame.step = Frame::Item;
+              return true;
+            }
+            frame.first = false;
+            // Fall through
+
+          case Frame::Item :
+            if ( object )
+            {
+              token.type = Token::Text;
+              token.string = frame.key->first;
+              frame.step = Frame::Colon;
+            }
+            else
+            {
+              frame.step = Frame::Separator;
+              _value( *frame.object->_array[ frame.index++ ], token );
+            }
+            return true;
+
+          case Frame::Colon :
+            token.type = Token::Colon;
+            frame.step = Frame::Value;
+            return true;
+
+          case Frame::Value :
+            frame.step = Frame::Separator;
+            _value( *( frame.key++ )->second, token );
+            return true;
+        }
+        return false;
+      }
+
+      // Pass over the rest of the container opened last, including its closing bracket
+      bool skipContainer()
+      {
+        _frames.pop_back();
+        return true;
+      }
+  };
+
+
+  // One input being read. Included files push a new source on top of the stack. A source is either
+  // a stream being lexed, or a tree returned by an include handler
+  struct ReaderSource
+  {
+    ReaderSource( std::istream& input, const ParseOptions& options, ErrorList& errors, const std::string& file ) :
+      diagnostics( errors, options.errorLimit, file ), lexer( new Lexer( input, options, diagnostics ) ) {}
+
+    ReaderSource( Object&& tree, const ParseOptions& options, ErrorList& errors ) :
+      diagnostics( errors, options.errorLimit, std::string() ), tree( new TreeLexer( std::move( tree ) ) ) {}
+
+    bool next( Token& token ) { return lexer ? lexer->next( token ) : tree->next( token ); }
+    bool skipContainer() { return lexer ? lexer->skipContainer() : tree->skipContainer(); }
+
+    // Only set if the source owns its stream
+    std::unique_ptr<std::istream> stream;
+
+    Diagnostics diagnostics;
+    std::unique_ptr<Lexer> lexer;
+    std::unique_ptr<TreeLexer> tree;
+  };
+
+
+  struct Reader::State
+  {
+    struct Container
+    {
+      Type type;
+      bool first;
+
+      // The last key read within an object
+      std::string identifier;
+
+      // Items read so far
+      size_t count;
+
+      // Set for the root object of an included file
+      bool included;
+    };
+
+    State( std::istream& input, const ParseOptions& opts ) :
+      options( opts ), errors(), sources(), containers(), token(), event( Reader::End ), type( Type::Null ),
+      started( false ), expectValue( false ), failed( false )
+    {
+      sources.push_back( std::unique_ptr<ReaderSource>( new ReaderSource( input, options, errors, std::string() ) ) );
+    }
+
+    ParseOptions options;
+    ErrorList errors;
+    std::vector< std::unique_ptr<ReaderSource> > sources;
+    std::vector< Container > containers;
+
+    // The current token
+    Token token;
+
+    Reader::Event event;
+    Type type;
+
+    bool started;
+
+    // A key has been read and its value is next
+    bool expectValue;
+
+    bool failed;
+
+    // Read the next token from the current source. Records an error at the end of the input.
+    // Errors only ever point at the current token, so the newlines before it are dropped and
+    // the index stays small however long the input is
+    bool read()
+    {
+      sources.back()->diagnostics.restart();
+      if ( sources.back()->next( token ) ) return true;
+      failEnd( ParseError::UnexpectedEnd );
+      return false;
+    }
+
+    // Record the input ending early, or the reason it could not be decompressed
+    Reader::Event failEnd( ParseError::Code code )
+    {
+      const InputFile* file = dynamic_cast<const InputFile*>( sources.back()->stream.get() );
+      if ( file && ! file->error().empty() ) return fail( ParseError::DecompressionFailed, file->error() );
+      return fail( code );
+    }
+
+    // Record an error. Errors about a container that has just been opened refer to it by its
+    // identifier in the parent
+    Reader::Event fail( ParseError::Code code, const std::string& detail = std::string(), bool outer = false )
+    {
+      if ( ! failed )
+      {
+        std::string identifier;
+        size_t level = containers.size() - ( outer ? 1 : 0 );
+        if ( level > 0 )
+        {
+          const Container& container = containers[level-1];
+          if ( container.type == Type::Object ) identifier = container.identifier;
+          else if ( container.count > 0 ) identifier = std::to_string( container.count - 1 );
+        }
+        sources.back()->diagnostics.add( code, token.offset, identifier, detail );
+        failed = true;
+      }
+      return ( event = Reader::Error );
+    }
+
+    // Find the opening bracket of a CON root object
+    bool findRoot()
+    {
+      while ( true )
+      {
+        sources.back()->diagnostics.restart();
+        if ( ! sources.back()->next( token ) ) break;
+        if ( token.type == Token::OpenObject ) return true;
+      }
+      failEnd( ParseError::RootNotFound );
+      return false;
+    }
+
+    Reader::Event open( Type container, bool included )
+    {
+      containers.push_back( Container{ container, true, std::string(), 0, included } );
+      return ( event = ( container == Type::Object ) ? Reader::BeginObject : Reader::BeginArray );
+    }
+
+    Reader::Event close()
+    {
+      Container container = containers.back();
+      containers.pop_back();
+      if ( container.included ) sources.pop_back();
+      return ( event = ( container.type == Type::Object ) ? Reader::EndObject : Reader::EndArray );
+    }
+
+    // Location of the value about to be read, as given to include handlers
+    Path path() const
+    {
+      Path location;
+      for ( std::vector< Container >::const_iterator it = containers.begin(); it != containers.end(); ++it )
+      {
+        location.push_back( ( it->type == Type::Object ) ? it->identifier : std::to_string( it->count - 1 ) );
+      }
+      return location;
+    }
+
+    // Load an include as a new source and return its root. A handler may return any value, which is
+    // streamed from the tree itself. Files must hold an object
+    Reader::Event include()
+    {
+      if ( options.include )
+      {
+        Object object;
+        try
+        {
+          object = options.include( token.string, path() );
+        }
+        catch ( Exception& ex )
+        {
+          return fail( ParseError::IncludeFailed, ex.what() );
+        }
+        sources.push_back( std::unique_ptr<ReaderSource>( new ReaderSource( std::move( object ), options, errors ) ) );
+
+        if ( ! read() ) return Reader::Error;
+        if ( token.type == Token::OpenObject ) return open( Type::Object, true );
+        if ( token.type == Token::OpenArray ) return open( Type::Array, true );
+
+        // A single value leaves nothing more to read from the source
+        Reader::Event result = value();
+        sources.pop_back();
+        return result;
+      }
+
+      InputFile* file = new InputFile( token.string );
+      std::unique_ptr<std::istream> stream( file );
+      if ( ! file->is_open() )
+      {
+        return fail( ParseError::IncludeFailed, std::string( "Failed to open file \"" ) + token.string + "\"" );
+      }
+
+      // JSON has no includes, so the options apply as they are
+      ReaderSource* source = new ReaderSource( *stream, options, errors, token.string );
+      source->stream = std::move( stream );
+      sources.push_back( std::unique_ptr<ReaderSource>( source ) );
+
+      if ( ! findRoot() ) return Reader::Error;
+      return open( Type::Object, true );
+    }
+
+    // Interpret the current token as the start of a value
+    Reader::Event value()
+    {
+      switch ( token.type )
+      {
+        case Token::Text :
+          if ( ! validateExpression( token.string, type ) )
+          {
+            return fail( ParseError::InvalidExpression, token.string );
+          }
+          return ( event = Reader::Value );
+
+        case Token::Quote :
+          type = Type::String;
+          return ( event = Reader::Value );
+
         case Token::OpenObject :
-          std::cout << " OpenObject ";
-          break;
-        case Token::CloseObject :
-          std::cout << " CloseObject ";
-          break;
+          return open( Type::Object, false );
+
         case Token::OpenArray :
-          std::cout << " OpenArray ";
-          break;
-        case Token::CloseArray :
-          std::cout << " CloseArray ";
-          break;
-        case Token::Comment :
-          std::cout << " Comment ";
-          break;
+          return open( Type::Array, false );
+
         case Token::Filepath :
-          std::cout << " File ";
+          if ( options.json ) break;
+          return include();
+
+        default :
           break;
       }
-      std::cout << it->lineNumber << " : " << it->string << std::endl;
+      return fail( containers.empty() ? ParseError::InvalidRoot : ( containers.back().type == Type::Array ? ParseError::InvalidArrayItem : ParseError::InvalidValue ) );
+    }
+
+    // Read the separator and the first token of the next item in the current container. Returns
+    // false if the container ended, or on an error, with the event set accordingly
+    bool item()
+    {
+      Container& container = containers.back();
+      if ( ! read() ) return false;
+
+      Token::Type closing = ( container.type == Type::Object ) ? Token::CloseObject : Token::CloseArray;
+      if ( token.type == closing )
+      {
+        close();
+        return false;
+      }
+      if ( ! container.first )
+      {
+        if ( token.type != Token::Comma )
+        {
+          fail( ( container.type == Type::Object ) ? ParseError::ExpectedComma : ParseError::ExpectedArrayComma );
+          return false;
+        }
+        if ( ! read() ) return false;
+      }
+
+      container.first = false;
+      ++container.count;
+      return true;
+    }
+
+    // Skip the rest of the container that is already open, without building tokens
+    void skipContainer()
+    {
+      if ( ! sources.back()->skipContainer() )
+      {
+        failed = true;
+        event = Reader::Error;
+      }
+    }
+
+    // Skip the value that starts with the current token. Includes are never loaded
+    void skipValue()
+    {
+      if ( token.type == Token::OpenObject || token.type == Token::OpenArray )
+      {
+        skipContainer();
+      }
+      else if ( token.type != Token::Text && token.type != Token::Quote && ! ( token.type == Token::Filepath && ! options.json ) )
+      {
+        fail( containers.back().type == Type::Array ? ParseError::InvalidArrayItem : ParseError::InvalidValue );
+      }
+    }
+  };
+
+
+  Reader::Reader( std::istream& input ) :
+    _state( new State( input, ParseOptions() ) )
+  {
+  }
+
+
+  Reader::Reader( std::istream& input, const ParseOptions& options ) :
+    _state( new State( input, options ) )
+  {
+  }
+
+
+  Reader::Reader( Reader&& ) = default;
+  Reader& Reader::operator=( Reader&& ) = default;
+  Reader::~Reader() = default;
+
+
+  Reader::Event Reader::next()
+  {
+    State& state = *_state;
+    if ( state.failed ) return Reader::Error;
+
+    // The root value
+    if ( ! state.started )
+    {
+      state.started = true;
+      if ( state.options.json )
+      {
+        if ( ! state.sources.back()->next( state.token ) ) return state.fail( ParseError::RootNotFound );
+        return state.value();
+      }
+      if ( ! state.findRoot() ) return Reader::Error;
+      return state.open( Type::Object, false );
     }
-    */
 
-    // Find the start of the root node
-    std::vector<Token>::iterator root_begin = tokens.begin();
-    std::vector<Token>::iterator root_end = tokens.end();
+    if ( state.containers.empty() )
+    {
+      return ( state.event = Reader::End );
+    }
 
-    while( (root_begin != tokens.end()) && (root_begin->type != Token::OpenObject) ) ++root_begin;
+    State::Container& container = state.containers.back();
 
-    if ( root_begin == tokens.end() )
+    if ( state.expectValue )
     {
-      throw Exception( "Could not find root object in data stream." );
+      state.expectValue = false;
+      if ( ! state.read() ) return Reader::Error;
+      return state.value();
     }
 
-    ErrorList errorList;
-    Object object = parseTokens( ++root_begin, root_end, errorList );
+    // The end of the container, or the first token of the next item
+    if ( ! state.item() ) return state.event;
 
-    if ( errorList.size() > 0 )
-      throw Exception( errorList );
+    if ( container.type == Type::Array )
+    {
+      return state.value();
+    }
 
-    return object;
+    if ( state.token.type != Token::Text && ! ( state.options.json && state.token.type == Token::Quote ) )
+    {
+      return state.fail( ParseError::InvalidIdentifier, state.token.string );
+    }
+    container.identifier = state.token.string;
+
+    size_t offset = state.token.offset;
+    if ( ! state.read() ) return Reader::Error;
+    if ( state.token.type != Token::Colon )
+    {
+      return state.fail( ParseError::ExpectedColon );
+    }
+
+    // Report the key itself
+    state.token.string = container.identifier;
+    state.token.offset = offset;
+    state.expectValue = true;
+    return ( state.event = Reader::Key );
   }
 
 
-  Object parseTokens( std::vector<Token>::iterator& start, std::vector<Token>::iterator& end, ErrorList& errors )
+  Reader::Event Reader::event() const
   {
-    // Awful file
-    if ( start == end )
-    {
-      throw Exception( "Unexpected end of file" );
-    }
+    return _state->event;
+  }
 
-    std::vector<Token>::iterator current = start;
-    Object object( Type::Object );
 
-    // The empty object
-    if ( current->type == Token::CloseObject )
+  const std::string& Reader::text() const
+  {
+    return _state->token.string;
+  }
+
+
+  Type Reader::type() const
+  {
+    return _state->type;
+  }
+
+
+  size_t Reader::offset() const
+  {
+    return _state->token.offset;
+  }
+
+
+  void Reader::skip()
+  {
+    State& state = *_state;
+    if ( state.failed ) return;
+
+    if ( state.event == Reader::Key && state.expectValue )
     {
-      start = ++current;
-      return object;
+      state.expectValue = false;
+      if ( ! state.read() ) return;
+      state.skipValue();
     }
+    else if ( state.event == Reader::BeginObject || state.event == Reader::BeginArray )
+    {
+      state.skipContainer();
+      if ( ! state.failed ) state.close();
+    }
+  }
 
-    std::string identifier;
 
-    // Iterate through the tokens
-    while ( current != end )
-    {
-//////////////////// The Identifier
-      if ( current->type != Token::Text )
-      {
-        errors.push_back( makeError( current->lineNumber, "Valid identifier expected" ) );
-//        throw Exception( errors );
-        ++current;
-      }
-      else
-      {
-        identifier = current->string;
-        ++current;
-      }
+  bool Reader::skipItem()
+  {
+    State& state = *_state;
+    if ( state.failed || state.containers.empty() || state.containers.back().type != Type::Array ) return false;
 
-//////////////////// Colon Separator
-      if ( current == end )
-      {
-        errors.push_back( makeError( (--current)->lineNumber, std::string( "Colon expected following identifier: " ) + identifier ) );
-        throw Exception( errors );
-      }
-      else if ( current->type != Token::Colon )
-      {
-        errors.push_back( makeError( current->lineNumber, std::string( "Colon expected following identifier: " ) + identifier ) );
-//        throw Exception( errors );
-      }
-      else
-      {
-        ++current;
-      }
+    if ( ! state.item() ) return false;
+    state.skipValue();
+    return ! state.failed;
+  }
 
-//////////////////// Value expression
-      if ( current == end )
-      {
-        errors.push_back( makeError( (--current)->lineNumber, std::string( "Value expected for identifier " ) + identifier ) );
-        throw Exception( errors );
-      }
-      else if ( current->type == Token::Text ) 
-      {
-        Type valid_type;
-        if ( ! validateExpression( current->string, valid_type ) )
+
+  void Reader::error( ParseError::Code code, const std::string& detail )
+  {
+    State& state = *_state;
+    state.fail( code, detail, state.event == Reader::BeginObject || state.event == Reader::BeginArray );
+  }
+
+
+  bool Reader::failed() const
+  {
+    return _state->failed;
+  }
+
+
+  const ErrorList& Reader::errors() const
+  {
+    return _state->errors;
+  }
+
+
+  bool readValue( Reader& reader, Object& object )
+  {
+    switch ( reader.event() )
+    {
+      case Reader::Value :
+        if ( reader.type() == Type::String )
+          object.setValue( reader.text() );
+        else
+          object.setRawValue( reader.text(), reader.type() );
+        return true;
+
+      case Reader::BeginObject :
+        object.setType( Type::Object );
+        while ( reader.next() == Reader::Key )
         {
-          errors.push_back( makeError( current->lineNumber, std::string( "Invalid expression. Must be boolean, numeric or string" ) ) );
+          std::string key = reader.text();
+          Object child;
+          reader.next();
+          if ( ! readValue( reader, child ) ) return false;
+          object.addChild( key, std::move( child ) );
         }
-        else
+        return reader.event() == Reader::EndObject;
+
+      case Reader::BeginArray :
+        object.setType( Type::Array );
+        while ( reader.next() != Reader::EndArray )
         {
           Object child;
-          child.setRawValue( current->string, valid_type );
-          object.addChild( identifier, child );
+          if ( ! readValue( reader, child ) ) return false;
+          object.push( std::move( child ) );
         }
+        return true;
 
-        ++current;
-      }
-      else if ( current->type == Token::Quote )
-      {
-        Object child( Type::String );
+      default :
+        return false;
+    }
+  }
 
-        child.setValue( current->string );
-        object.addChild( identifier, child );
 
-        ++current;
-      }
-      else if ( current->type == Token::Filepath )
-      {
-        try
-        {
-          object.addChild( identifier, buildFromFile( current->string ) );
-        }
-        catch( Exception& ex )
-        {
-          throw ex;
-        }
-        ++current;
-      }
-      else if ( current->type == Token::OpenObject )
-      {
-        ++current;
-        try
-        {
-          object.addChild( identifier, parseTokens( current, end, errors ) );
-        }
-        catch( Exception& ex )
-        {
-          throw ex;
-        }
-      }
-      else if ( current->type == Token::OpenArray )
-      {
-        try
-        {
-          Object child( Type::Array );
-          parseArray( ++current, end, errors, child );
-          object.addChild( identifier, child );
-        }
-        catch ( Exception& ex )
-        {
-          throw ex;
-        }
-      }
-      else
-      {
-        errors.push_back( makeError( current->lineNumber, std::string( "Invalid value for identifier " ) + identifier ) );
-        throw Exception( errors );
-      }
 
-//////////////////// Comma or closing bracket
-      if ( current == end )
-      {
-        errors.push_back( makeError( start->lineNumber, "Closing bracket not found" ) );
-//        throw Exception( errors );
-      }
-      else if ( current->type == Token::Comma )
-      {
-        ++current;
-        continue;
-      }
-      else if ( current->type == Token::CloseObject )
-      {
-        start = ++current;
-        return object;
-      }
-      else
-      {
-        errors.push_back( makeError( current->lineNumber, "Expected either comma or closing bracket" ) );
-//        throw Exception( errors );
-      }
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Projection parsing
+
+  Projection::Projection( std::initializer_list<std::string> paths )
+  {
+    for ( std::initializer_list<std::string>::iterator it = paths.begin(); it != paths.end(); ++it )
+    {
+      add( *it );
     }
+  }
 
-    errors.push_back( makeError( start->lineNumber, "Closing bracket not found" ) );
-    return object;
+
+  Projection::Projection( const std::vector<std::string>& paths )
+  {
+    for ( std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it )
+    {
+      add( *it );
+    }
   }
 
 
-  void parseArray( std::vector<Token>::iterator& start, std::vector<Token>::iterator& end, ErrorList& errors, Object& object )
+  void Projection::add( const std::string& path )
   {
-    if ( start == end )
+    Node* node = &_root;
+    std::string::const_iterator it = path.begin();
+    if ( it != path.end() && *it == '/' ) ++it;
+
+    while ( it != path.end() && ! node->whole )
     {
-      throw Exception( "Unexpected end of file" );
+      std::string::const_iterator slash = std::find( it, path.end(), '/' );
+      std::string step( it, slash );
+
+      // Steps that are all digits are also array indices, so they must fit one
+      if ( ! step.empty() && std::all_of( step.begin(), step.end(), ::isdigit ) ) parsePathIndex( step, path );
+
+      node = &node->children[ step ];
+      it = ( slash == path.end() ) ? slash : slash + 1;
     }
 
-    std::vector<Token>::iterator current = start;
+    // Anything more specific below is now redundant
+    node->whole = true;
+    node->children.clear();
+  }
 
-    // The empty array
-    if ( current->type == Token::CloseArray )
+
+  bool readProjected( Reader& reader, Object& object, const Projection::Node& node )
+  {
+    if ( node.whole || reader.event() == Reader::Value )
     {
-      start = ++current;
-      return;
+      return readValue( reader, object );
     }
 
-    while ( current != end )
+    if ( reader.event() == Reader::BeginObject )
     {
-      if ( current->type == Token::Text )
+      object.setType( Type::Object );
+      while ( reader.next() == Reader::Key )
       {
-        Type valid_type;
-        if ( ! validateExpression( current->string, valid_type ) )
-        {
-          errors.push_back( makeError( current->lineNumber, std::string( "Invalid expression. Must be boolean, numeric or string" ) ) );
-        }
-        else
+        std::map<std::string, Projection::Node>::const_iterator found = node.children.find( reader.text() );
+        if ( found == node.children.end() )
         {
-          Object child( valid_type );
-          child.setRawValue( current->string, valid_type );
-          object.push( child );
+          reader.skip();
+          continue;
         }
-        ++current;
-      }
-      else if ( current->type == Token::Quote )
-      {
+
+        std::string key = reader.text();
         Object child;
+        reader.next();
+        if ( ! readProjected( reader, child, found->second ) ) return false;
+        object.addChild( key, std::move( child ) );
+      }
+      return reader.event() == Reader::EndObject;
+    }
 
-        child.setValue( current->string );
-        object.push( child );
+    if ( reader.event() == Reader::BeginArray )
+    {
+      object.setType( Type::Array );
 
-        ++current;
-      }
-      else if ( current->type == Token::Filepath )
-      {
-        try
-        {
-          Object child = buildFromFile( current->string );
-          object.push( child );
-        }
-        catch( Exception& ex )
-        {
-          throw ex;
-        }
-        ++current;
-      }
-      else if ( current->type == Token::OpenObject )
+      // The requested items in order
+      std::map<size_t, const Projection::Node*> items;
+      for ( std::map<std::string, Projection::Node>::const_iterator it = node.children.begin(); it != node.children.end(); ++it )
       {
-        try
-        {
-          Object child = parseTokens( ++current, end, errors );
-          object.push( child );
-        }
-        catch( Exception& ex )
+        if ( ! it->first.empty() && std::all_of( it->first.begin(), it->first.end(), ::isdigit ) )
         {
-          throw ex;
+          items[ parsePathIndex( it->first, it->first ) ] = &it->second;
         }
       }
-      else if ( current->type == Token::OpenArray )
+
+      size_t index = 0;
+      for ( std::map<size_t, const Projection::Node*>::iterator it = items.begin(); it != items.end(); ++it )
       {
-        try
-        {
-          Object child( Type::Array );
-          parseArray( ++current, end, errors, child );
-          object.push( child );
-        }
-        catch ( Exception& ex )
+        for ( ; index < it->first; ++index )
         {
-          throw ex;
+          if ( ! reader.skipItem() ) return reader.event() == Reader::EndArray;
+          object.push( Object() );
         }
-      }
-      else if ( current->type == Token::CloseArray )
-      {
-        errors.push_back( makeError( current->lineNumber, std::string( "Array ended unexpectedly" ) ) );
-        start = ++current;
-        return;
-      }
-      else
-      {
-        errors.push_back( makeError( current->lineNumber, std::string( "Expected valid value type, object or array within array defitinition" ) ) );
-        ++current;
-      }
 
-      if ( current->type == Token::Comma )
-      {
-        ++current;
-        continue;
-      }
-      else if ( current->type == Token::CloseArray )
-      {
-        start = ++current;
-        return;
-      }
-      else
-      {
-        errors.push_back( makeError( current->lineNumber, std::string( "Expected comma or closing bracket following array item" ) ) );
-        ++current;
+        if ( reader.next() == Reader::EndArray ) return true;
+
+        Object child;
+        if ( ! readProjected( reader, child, *it->second ) ) return false;
+        object.push( std::move( child ) );
+        ++index;
       }
 
+      while ( reader.skipItem() ) {}
+      return reader.event() == Reader::EndArray;
     }
 
-    errors.push_back( makeError( start->lineNumber, "Closing square bracket not found" ) );
-    start = current;
-    return;
+    return false;
+  }
+
+
+  Object buildFromStream( std::istream& input, const Projection& projection )
+  {
+    return buildFromStream( input, projection, ParseOptions() );
+  }
+
+
+  Object buildFromStream( std::istream& input, const Projection& projection, const ParseOptions& options )
+  {
+    Reader reader( input, options );
+    Object object;
+
+    if ( reader.next() != Reader::Error )
+    {
+      readProjected( reader, object, projection.root() );
+    }
+
+    if ( ! reader.errors().empty() )
+    {
+      ErrorList errors( reader.errors() );
+      throw Exception( std::move( errors ) );
+    }
+
+    return object;
   }
 
 }
@@ -0,0 +1,302 @@
+
+#include "CON.h"
+
+#include <cstring>
+
+#ifdef CON_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CON_ZSTD
+#include <zstd.h>
+#endif
+
+// Size of each of the compressed and decompressed buffers
+#ifndef CON_DECOMPRESS_BUFFER_SIZE
+#define CON_DECOMPRESS_BUFFER_SIZE 65536
+#endif
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Streaming decompression
+
+  // Decompresses everything read from the source into a fixed buffer at a time. Also passes data
+  // through unchanged for inputs that cannot be rewound after checking their first bytes
+  class InputFile::Decoder : public std::streambuf
+  {
+    private:
+      std::streambuf& _source;
+      Compression _compression;
+
+      // Compressed data not yet decoded
+      std::vector<char> _input;
+      char* _next;
+      size_t _available;
+
+      // Decoded data being read
+      std::vector<char> _output;
+
+      // The last compressed stream was finished, so the input may end here
+      bool _ended;
+
+      std::string _error;
+
+#ifdef CON_ZLIB
+      z_stream _zlib;
+#endif
+
+#ifdef CON_ZSTD
+      ZSTD_DStream* _zstd;
+#endif
+
+      // Read more compressed data once the last has been used. Returns false at the end of the source
+      bool _fill();
+
+      // Decode into the output buffer. Returns the number of bytes, zero at the end or on an error
+      size_t _decode();
+
+      void _fail( const std::string& error ) { if ( _error.empty() ) _error = error; }
+
+    protected:
+      virtual int_type underflow() override;
+
+    public:
+      Decoder( std::streambuf&, Compression, const char*, size_t );
+      ~Decoder();
+
+      Decoder( const Decoder& ) = delete;
+      Decoder& operator=( const Decoder& ) = delete;
+
+      const std::string& error() const { return _error; }
+  };
+
+
+  InputFile::Decoder::Decoder( std::streambuf& source, Compression compression, const char* head, size_t length ) :
+    _source( source ),
+    _compression( compression ),
+    _input( CON_DECOMPRESS_BUFFER_SIZE ),
+    _next( _input.data() ),
+    _available( length ),
+    _output( CON_DECOMPRESS_BUFFER_SIZE ),
+    _ended( false ),
+    _error()
+  {
+    // The bytes read to recognise the format come first
+    std::memcpy( _input.data(), head, length );
+
+    switch ( _compression )
+    {
+      case None :
+        break;
+
+      case Gzip :
+#ifdef CON_ZLIB
+        std::memset( &_zlib, 0, sizeof( _zlib ) );
+        // Gzip header and trailer only
+        if ( inflateInit2( &_zlib, 16 + MAX_WBITS ) != Z_OK ) _fail( "could not start zlib" );
+#else
+        _fail( "gzip input needs a build with CON_ZLIB defined" );
+#endif
+        break;
+
+      case Zstd :
+#ifdef CON_ZSTD
+        _zstd = ZSTD_createDStream();
+        if ( _zstd == nullptr || ZSTD_isError( ZSTD_initDStream( _zstd ) ) ) _fail( "could not start zstd" );
+#else
+        _fail( "zstd input needs a build with CON_ZSTD defined" );
+#endif
+        break;
+    }
+  }
+
+
+  InputFile::Decoder::~Decoder()
+  {
+#ifdef CON_ZLIB
+    if ( _compression == Gzip ) inflateEnd( &_zlib );
+#endif
+
+#ifdef CON_ZSTD
+    if ( _compression == Zstd ) ZSTD_freeDStream( _zstd );
+#endif
+  }
+
+
+  bool InputFile::Decoder::_fill()
+  {
+    if ( _available > 0 ) return true;
+
+    _next = _input.data();
+    _available = static_cast<size_t>( _source.sgetn( _input.data(), _input.size() ) );
+    return _available > 0;
+  }
+
+
+  size_t InputFile::Decoder::_decode()
+  {
+    if ( ! _error.empty() ) return 0;
+
+    size_t produced = 0;
+    switch ( _compression )
+    {
+      case None :
+        if ( _available > 0 )
+        {
+          produced = _available;
+          std::memcpy( _output.data(), _next, produced );
+          _available = 0;
+        }
+        else
+        {
+          produced = static_cast<size_t>( _source.sgetn( _output.data(), _output.size() ) );
+        }
+        break;
+
+      case Gzip :
+#ifdef CON_ZLIB
+        while ( produced == 0 )
+        {
+          bool more = _fill();
+
+          _zlib.next_in = reinterpret_cast<Bytef*>( _next );
+          _zlib.avail_in = static_cast<uInt>( _available );
+          _zlib.next_out = reinterpret_cast<Bytef*>( _output.data() );
+          _zlib.avail_out = static_cast<uInt>( _output.size() );
+
+          int result = inflate( &_zlib, Z_NO_FLUSH );
+
+          size_t consumed = _available - _zlib.avail_in;
+          _next += consumed;
+          _available -= consumed;
+          produced = _output.size() - _zlib.avail_out;
+
+          if ( result == Z_STREAM_END )
+          {
+            // Further members may follow, as with concatenated .gz files
+            _ended = true;
+            inflateReset( &_zlib );
+          }
+          else if ( result == Z_OK || result == Z_BUF_ERROR )
+          {
+            if ( consumed > 0 ) _ended = false;
+          }
+          else
+          {
+            _fail( _zlib.msg ? _zlib.msg : "corrupt gzip data" );
+            return 0;
+          }
+
+          if ( ! more && produced == 0 )
+          {
+            if ( ! _ended ) _fail( "unexpected end of gzip data" );
+            break;
+          }
+        }
+#endif
+        break;
+
+      case Zstd :
+#ifdef CON_ZSTD
+        while ( produced == 0 )
+        {
+          bool more = _fill();
+
+          ZSTD_inBuffer in = { _next, _available, 0 };
+          ZSTD_outBuffer out = { _output.data(), _output.size(), 0 };
+
+          size_t result = ZSTD_decompressStream( _zstd, &out, &in );
+          if ( ZSTD_isError( result ) )
+          {
+            _fail( ZSTD_getErrorName( result ) );
+            return 0;
+          }
+
+          _next += in.pos;
+          _available -= in.pos;
+          produced = out.pos;
+
+          // Zero once a frame is complete and flushed
+          if ( in.pos > 0 || result == 0 ) _ended = ( result == 0 );
+
+          if ( ! more && produced == 0 )
+          {
+            if ( ! _ended ) _fail( "unexpected end of zstd data" );
+            break;
+          }
+        }
+#endif
+        break;
+    }
+
+    return produced;
+  }
+
+
+  InputFile::Decoder::int_type InputFile::Decoder::underflow()
+  {
+    if ( gptr() < egptr() ) return traits_type::to_int_type( *gptr() );
+
+    size_t length = _decode();
+    if ( length == 0 ) return traits_type::eof();
+
+    setg( _output.data(), _output.data(), _output.data() + length );
+    return traits_type::to_int_type( *gptr() );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Input file member function definitions
+
+  InputFile::InputFile( const std::string& filename ) :
+    std::istream( nullptr ),
+    _file(),
+    _decoder(),
+    _compression( None )
+  {
+    if ( ! _file.open( filename, std::ios_base::in | std::ios_base::binary ) )
+    {
+      setstate( std::ios_base::failbit );
+      return;
+    }
+
+    char head[4];
+    size_t length = static_cast<size_t>( _file.sgetn( head, sizeof( head ) ) );
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( head );
+
+    if ( length >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B )
+    {
+      _compression = Gzip;
+    }
+    else if ( length == 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD )
+    {
+      _compression = Zstd;
+    }
+
+    // Plain files are read straight from the file buffer if they can be rewound
+    if ( _compression == None && _file.pubseekpos( 0, std::ios_base::in ) == std::streampos( 0 ) )
+    {
+      rdbuf( &_file );
+      return;
+    }
+
+    _decoder.reset( new Decoder( _file, _compression, head, length ) );
+    rdbuf( _decoder.get() );
+  }
+
+
+  InputFile::~InputFile()
+  {
+  }
+
+
+  const std::string& InputFile::error() const
+  {
+    static const std::string none;
+    return _decoder ? _decoder->error() : none;
+  }
+
+}
+
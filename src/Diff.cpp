@@ -0,0 +1,416 @@
+
+#include "CON.h"
+
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+// Largest array middle section (length product) aligned with a full LCS table
+#ifndef CON_DIFF_LCS_LIMIT
+#define CON_DIFF_LCS_LIMIT 1048576
+#endif
+
+namespace CON
+{
+  size_t parsePathIndex( const std::string&, const std::string& );
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Diff state and helpers
+
+  struct DiffState
+  {
+    // Subtree hashes, only cached for arrays and objects. Scalars are cheap to rehash. Only the
+    // elements of array sections that are aligned by value are hashed
+    std::unordered_map<const Object*, size_t> hashes;
+
+    // Location of the nodes currently being compared
+    Path path;
+
+    // The output
+    Patch patch;
+  };
+
+
+  void combineHash( size_t& seed, size_t value )
+  {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + ( seed << 6 ) + ( seed >> 2 );
+  }
+
+
+  size_t hashObject( const Object& obj, DiffState& state )
+  {
+    size_t seed = static_cast<size_t>( obj._type );
+
+    switch ( obj._type )
+    {
+      case Type::Null :
+        return seed;
+
+      case Type::String :
+      case Type::Numeric :
+      case Type::Boolean :
+        combineHash( seed, std::hash<std::string>()( obj._value ) );
+        return seed;
+
+      case Type::Array :
+      case Type::Object :
+        break;
+    }
+
+    std::unordered_map<const Object*, size_t>::const_iterator found = state.hashes.find( &obj );
+    if ( found != state.hashes.end() )
+    {
+      return found->second;
+    }
+
+    if ( obj._type == Type::Array )
+    {
+      for ( Object::Array::const_iterator it = obj._array.begin(); it != obj._array.end(); ++it )
+      {
+        combineHash( seed, hashObject( *(*it), state ) );
+      }
+    }
+    else
+    {
+      for ( Object::ObjectMap::const_iterator it = obj._children.begin(); it != obj._children.end(); ++it )
+      {
+        combineHash( seed, std::hash<std::string>()( it->first ) );
+        combineHash( seed, hashObject( *it->second, state ) );
+      }
+    }
+
+    state.hashes[&obj] = seed;
+    return seed;
+  }
+
+
+  // Structural comparison. Stops at the first difference, and at nodes shared by both trees
+  bool equalTrees( const Object& first, const Object& second )
+  {
+    if ( &first == &second ) return true;
+    if ( first._type != second._type ) return false;
+
+    switch ( first._type )
+    {
+      case Type::Null :
+        return true;
+
+      case Type::String :
+      case Type::Numeric :
+      case Type::Boolean :
+        return first._value == second._value;
+
+      case Type::Array :
+        if ( first._array.size() != second._array.size() ) return false;
+        for ( size_t i = 0; i < first._array.size(); ++i )
+        {
+          if ( ! equalTrees( *first._array[i], *second._array[i] ) ) return false;
+        }
+        return true;
+
+      case Type::Object :
+        break;
+    }
+
+    if ( first._children.size() != second._children.size() ) return false;
+    Object::ObjectMap::const_iterator second_it = second._children.begin();
+    for ( Object::ObjectMap::const_iterator it = first._children.begin(); it != first._children.end(); ++it, ++second_it )
+    {
+      if ( it->first != second_it->first || ! equalTrees( *it->second, *second_it->second ) ) return false;
+    }
+    return true;
+  }
+
+
+  // The first element seen with the same value as this one. Equal elements share a representative,
+  // so they can be matched by pointer. Hashes only narrow down the candidates
+  typedef std::unordered_map< size_t, std::vector<const Object*> > Representatives;
+
+  const Object* representative( const Object& obj, Representatives& seen, DiffState& state )
+  {
+    std::vector<const Object*>& candidates = seen[ hashObject( obj, state ) ];
+    for ( std::vector<const Object*>::const_iterator it = candidates.begin(); it != candidates.end(); ++it )
+    {
+      if ( equalTrees( *(*it), obj ) ) return *it;
+    }
+    candidates.push_back( &obj );
+    return &obj;
+  }
+
+
+  void addOperation( DiffState& state, Operation::Kind kind, const Object* value )
+  {
+    state.patch.push_back( Operation() );
+    Operation& op = state.patch.back();
+    op.kind = kind;
+    op.path = state.path;
+    if ( value != nullptr ) op.value = *value;
+  }
+
+
+  void addIndexOperation( DiffState& state, Operation::Kind kind, size_t index, const Object* value )
+  {
+    state.path.push_back( std::to_string( index ) );
+    addOperation( state, kind, value );
+    state.path.pop_back();
+  }
+
+
+  // Compare two array elements that occupy the same index in the output
+  void diffElement( const Object& first, const Object& second, size_t index, DiffState& state )
+  {
+    if ( &first == &second ) return;
+
+    state.path.push_back( std::to_string( index ) );
+    diffObjects( first, second, state );
+    state.path.pop_back();
+  }
+
+
+  void diffArrays( const Object& first, const Object& second, DiffState& state )
+  {
+    const size_t first_size = first.getSize();
+    const size_t second_size = second.getSize();
+    const size_t common = std::min( first_size, second_size );
+
+    // Trim the common prefix and suffix
+    size_t prefix = 0;
+    while ( prefix < common && equalTrees( first[prefix], second[prefix] ) ) ++prefix;
+
+    size_t suffix = 0;
+    while ( suffix < common - prefix && equalTrees( first[first_size-1-suffix], second[second_size-1-suffix] ) ) ++suffix;
+
+    const size_t first_middle = first_size - prefix - suffix;
+    const size_t second_middle = second_size - prefix - suffix;
+
+    // Current index in the array as it is being patched
+    size_t position = prefix;
+
+    if ( first_middle == 0 || second_middle == 0 || ( first_middle * second_middle ) > CON_DIFF_LCS_LIMIT )
+    {
+      // Pairwise comparison followed by a tail of insertions or removals
+      size_t pairs = std::min( first_middle, second_middle );
+      for ( size_t i = 0; i < pairs; ++i, ++position )
+      {
+        diffElement( first[prefix+i], second[prefix+i], position, state );
+      }
+      for ( size_t i = pairs; i < first_middle; ++i )
+      {
+        addIndexOperation( state, Operation::Erase, position, nullptr );
+      }
+      for ( size_t i = pairs; i < second_middle; ++i, ++position )
+      {
+        addIndexOperation( state, Operation::Insert, position, &second[prefix+i] );
+      }
+      return;
+    }
+
+    // Longest common subsequence of the middle sections, by value.
+    // table[i][j] is the LCS length of first[i..] and second[j..]
+    const size_t width = second_middle + 1;
+    std::vector<uint32_t> table( ( first_middle + 1 ) * width, 0 );
+    std::vector<const Object*> first_values( first_middle );
+    std::vector<const Object*> second_values( second_middle );
+    Representatives seen;
+    for ( size_t i = 0; i < first_middle; ++i ) first_values[i] = representative( first[prefix+i], seen, state );
+    for ( size_t j = 0; j < second_middle; ++j ) second_values[j] = representative( second[prefix+j], seen, state );
+
+    for ( size_t i = first_middle; i-- > 0; )
+    {
+      for ( size_t j = second_middle; j-- > 0; )
+      {
+        if ( first_values[i] == second_values[j] )
+          table[i*width+j] = table[(i+1)*width+j+1] + 1;
+        else
+          table[i*width+j] = std::max( table[(i+1)*width+j], table[i*width+j+1] );
+      }
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    while ( i < first_middle || j < second_middle )
+    {
+      if ( i < first_middle && j < second_middle && first_values[i] == second_values[j] && table[i*width+j] == table[(i+1)*width+j+1] + 1 )
+      {
+        ++i;
+        ++j;
+        ++position;
+      }
+      else if ( i < first_middle && j < second_middle && table[i*width+j] == table[(i+1)*width+j+1] )
+      {
+        // Neither element is part of the subsequence, modify one into the other
+        diffElement( first[prefix+i], second[prefix+j], position, state );
+        ++i;
+        ++j;
+        ++position;
+      }
+      else if ( i < first_middle && ( j == second_middle || table[(i+1)*width+j] >= table[i*width+j+1] ) )
+      {
+        addIndexOperation( state, Operation::Erase, position, nullptr );
+        ++i;
+      }
+      else
+      {
+        addIndexOperation( state, Operation::Insert, position, &second[prefix+j] );
+        ++j;
+        ++position;
+      }
+    }
+  }
+
+
+  void diffObjects( const Object& first, const Object& second, DiffState& state )
+  {
+    if ( &first == &second ) return;
+
+    if ( first._type != second._type )
+    {
+      addOperation( state, Operation::Replace, &second );
+      return;
+    }
+
+    switch ( first._type )
+    {
+      case Type::Null :
+        break;
+
+      case Type::String :
+      case Type::Numeric :
+      case Type::Boolean :
+        if ( first._value != second._value )
+        {
+          addOperation( state, Operation::Replace, &second );
+        }
+        break;
+
+      case Type::Array :
+        diffArrays( first, second, state );
+        break;
+
+      case Type::Object :
+        {
+          // Both maps are sorted so they can be merged in a single pass
+          Object::ObjectMap::const_iterator first_it = first._children.begin();
+          Object::ObjectMap::const_iterator second_it = second._children.begin();
+          while ( first_it != first._children.end() || second_it != second._children.end() )
+          {
+            if ( second_it == second._children.end() || ( first_it != first._children.end() && first_it->first < second_it->first ) )
+            {
+              state.path.push_back( first_it->first );
+              addOperation( state, Operation::Remove, nullptr );
+              state.path.pop_back();
+              ++first_it;
+            }
+            else if ( first_it == first._children.end() || second_it->first < first_it->first )
+            {
+              state.path.push_back( second_it->first );
+              addOperation( state, Operation::Add, second_it->second );
+              state.path.pop_back();
+              ++second_it;
+            }
+            else
+            {
+              // Subtrees shared by both trees are passed over without looking inside
+              if ( first_it->second != second_it->second )
+              {
+                state.path.push_back( first_it->first );
+                diffObjects( *first_it->second, *second_it->second, state );
+                state.path.pop_back();
+              }
+              ++first_it;
+              ++second_it;
+            }
+          }
+        }
+        break;
+    }
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Diff and patch
+
+  Patch diff( const Object& first, const Object& second )
+  {
+    DiffState state;
+    diffObjects( first, second, state );
+    return state.patch;
+  }
+
+
+  size_t parseIndex( const std::string& text )
+  {
+    if ( text.empty() || text.find_first_not_of( "0123456789" ) != std::string::npos )
+    {
+      throw Exception( std::string( "Invalid array index in patch path: " ) + text );
+    }
+    return parsePathIndex( text, text );
+  }
+
+
+  void apply( Object& root, const Patch& patch )
+  {
+    for ( Patch::const_iterator op = patch.begin(); op != patch.end(); ++op )
+    {
+      if ( op->path.empty() )
+      {
+        if ( op->kind != Operation::Replace )
+        {
+          throw Exception( "Only a replace operation can be applied to the root object" );
+        }
+        root = op->value;
+        continue;
+      }
+
+      // Find the parent of the node being changed
+      Object* parent = &root;
+      for ( Path::const_iterator it = op->path.begin(); it != op->path.end() - 1; ++it )
+      {
+        if ( parent->getType() == Type::Array )
+          parent = &parent->get( parseIndex( *it ) );
+        else
+          parent = &parent->get( *it );
+      }
+
+      const std::string& last = op->path.back();
+
+      switch ( op->kind )
+      {
+        case Operation::Add :
+          if ( parent->getType() != Type::Object )
+          {
+            throw Exception( "Cannot add a child to a node that is not an object" );
+          }
+          parent->addChild( last, op->value );
+          break;
+
+        case Operation::Remove :
+          parent->removeChild( last );
+          break;
+
+        case Operation::Replace :
+          if ( parent->getType() == Type::Array )
+            parent->get( parseIndex( last ) ) = op->value;
+          else
+            parent->get( last ) = op->value;
+          break;
+
+        case Operation::Insert :
+          if ( parent->getType() != Type::Array )
+          {
+            throw Exception( "Cannot insert into a node that is not an array" );
+          }
+          parent->insert( parseIndex( last ), op->value );
+          break;
+
+        case Operation::Erase :
+          parent->erase( parseIndex( last ) );
+          break;
+      }
+    }
+  }
+
+}
+
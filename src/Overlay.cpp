@@ -0,0 +1,203 @@
+
+#include "CON.h"
+
+#include <cstdlib>
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Overlay member function definitions
+
+  Overlay::Overlay( std::initializer_list< const Object* > layers ) :
+    _layers( layers ),
+    _resolved(),
+    _merged()
+  {
+  }
+
+
+  Overlay::~Overlay()
+  {
+    for ( std::vector<Object*>::iterator it = _merged.begin(); it != _merged.end(); ++it )
+    {
+      Object::_release( *it );
+    }
+  }
+
+
+  void Overlay::push( const Object& layer )
+  {
+    _layers.push_back( &layer );
+
+    // The new layer may hide or add to anything resolved so far. Merged objects already handed out
+    // are kept in _merged
+    _resolved.clear();
+  }
+
+
+  Overlay::Entry& Overlay::_resolve( const Path& path ) const
+  {
+    std::map< Path, Entry >::iterator found = _resolved.find( path );
+    if ( found != _resolved.end() ) return found->second;
+
+    Entry entry;
+    if ( path.empty() )
+    {
+      for ( std::vector<const Object*>::const_reverse_iterator it = _layers.rbegin(); it != _layers.rend(); ++it )
+      {
+        if ( ! entry.nodes.empty() && (*it)->getType() != Type::Object ) break;
+        entry.nodes.push_back( *it );
+        if ( (*it)->getType() != Type::Object ) break;
+      }
+    }
+    else
+    {
+      const Entry& parent = _resolve( Path( path.begin(), path.end() - 1 ) );
+      const std::string& key = path.back();
+
+      for ( std::vector<const Object*>::const_iterator it = parent.nodes.begin(); it != parent.nodes.end(); ++it )
+      {
+        const Object* child = nullptr;
+        if ( (*it)->getType() == Type::Object )
+        {
+          child = (*it)->find( key );
+        }
+        else if ( ! key.empty() && key.find_first_not_of( "0123456789" ) == std::string::npos )
+        {
+          child = (*it)->find( static_cast<size_t>( std::strtoull( key.c_str(), nullptr, 10 ) ) );
+        }
+
+        if ( child == nullptr ) continue;
+
+        // Anything but an object under an object from a higher layer is hidden by it
+        if ( ! entry.nodes.empty() && child->getType() != Type::Object ) break;
+        entry.nodes.push_back( child );
+        if ( child->getType() != Type::Object ) break;
+      }
+    }
+
+    return _resolved.emplace( path, std::move( entry ) ).first->second;
+  }
+
+
+  Overlay::Entry& Overlay::_require( const Path& path ) const
+  {
+    Entry& entry = _resolve( path );
+    if ( entry.nodes.empty() )
+    {
+      std::string string = "Could not find path \"";
+      for ( Path::const_iterator it = path.begin(); it != path.end(); ++it )
+      {
+        if ( it != path.begin() ) string += '/';
+        string += *it;
+      }
+      string += "\" in any layer";
+      throw Exception( string );
+    }
+    return entry;
+  }
+
+
+  bool Overlay::has( const Path& path ) const
+  {
+    return ! _resolve( path ).nodes.empty();
+  }
+
+
+  const Object& Overlay::get( const Path& path ) const
+  {
+    Entry& entry = _require( path );
+    if ( entry.nodes.size() == 1 ) return *entry.nodes.front();
+
+    return *_build( path, entry );
+  }
+
+
+  size_t Overlay::getSize( const Path& path ) const
+  {
+    Entry& entry = _require( path );
+    if ( entry.nodes.size() == 1 ) return entry.nodes.front()->getSize();
+
+    if ( ! entry.counted )
+    {
+      // Count each key in the highest layer that has it
+      entry.size = 0;
+      for ( size_t i = 0; i < entry.nodes.size(); ++i )
+      {
+        const Object::ObjectMap& children = entry.nodes[i]->_children;
+        for ( Object::ObjectMap::const_iterator it = children.begin(); it != children.end(); ++it )
+        {
+          size_t higher = 0;
+          while ( higher < i && entry.nodes[higher]->find( it->first ) == nullptr ) ++higher;
+          if ( higher == i ) ++entry.size;
+        }
+      }
+      entry.counted = true;
+    }
+    return entry.size;
+  }
+
+
+  Object Overlay::flatten() const
+  {
+    Entry& entry = _resolve( Path() );
+    if ( entry.nodes.empty() ) return Object();
+
+    const Object* root = ( entry.nodes.size() == 1 ) ? entry.nodes.front() : _build( Path(), entry );
+    Object flat( root->_type );
+    flat._value = root->_value;
+    flat._shareChildren( *root );
+    return flat;
+  }
+
+
+  Object* Overlay::_build( const Path& path, Entry& entry ) const
+  {
+    if ( entry.merged != nullptr ) return entry.merged;
+
+    // Children at each key, in the same order as the layers they come from, as _resolve finds them
+    struct Layers
+    {
+      std::vector<const Object*> nodes;
+      bool ended = false;
+    };
+
+    std::map< std::string, Layers > children;
+    for ( std::vector<const Object*>::const_iterator node = entry.nodes.begin(); node != entry.nodes.end(); ++node )
+    {
+      for ( Object::ObjectMap::const_iterator it = (*node)->_children.begin(); it != (*node)->_children.end(); ++it )
+      {
+        Layers& layers = children[it->first];
+        if ( layers.ended ) continue;
+
+        if ( layers.nodes.empty() || it->second->getType() == Type::Object ) layers.nodes.push_back( it->second );
+        if ( it->second->getType() != Type::Object ) layers.ended = true;
+      }
+    }
+
+    Object* merged = new Object( Type::Object );
+    _merged.push_back( merged );
+    entry.merged = merged;
+
+    Path child_path( path );
+    child_path.push_back( std::string() );
+    merged->_children.reserve( children.size() );
+    for ( std::map< std::string, Layers >::const_iterator it = children.begin(); it != children.end(); ++it )
+    {
+      // The layers are never changed through the overlay, so their nodes can be shared as they are
+      Object* child = const_cast<Object*>( it->second.nodes.front() );
+      if ( it->second.nodes.size() > 1 )
+      {
+        child_path.back() = it->first;
+        child = _build( child_path, _resolve( child_path ) );
+      }
+
+      child->_shares.fetch_add( 1, std::memory_order_relaxed );
+      merged->_children.append( it->first, child );
+    }
+    return merged;
+  }
+
+}
+
@@ -0,0 +1,342 @@
+
+#include "CON.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Query expressions
+
+  bool isQueryIndex( const std::string& text )
+  {
+    return ! text.empty() && std::all_of( text.begin(), text.end(), ::isdigit );
+  }
+
+
+  // An array index in a query or projection path. The largest size_t is kept free to mean no bound
+  size_t parsePathIndex( const std::string& digits, const std::string& text )
+  {
+    errno = 0;
+    unsigned long long value = std::strtoull( digits.c_str(), nullptr, 10 );
+    if ( errno == ERANGE || value >= static_cast<unsigned long long>( std::string::npos ) )
+    {
+      throw Exception( std::string( "Index out of range in path: " ) + text );
+    }
+    return static_cast<size_t>( value );
+  }
+
+
+  Query::Step compileStep( const std::string& text )
+  {
+    Query::Step step{ Query::Step::Key, text, std::string::npos, std::string::npos };
+
+    if ( text == "*" )
+    {
+      step.kind = Query::Step::Any;
+    }
+    else if ( text == "**" )
+    {
+      step.kind = Query::Step::Descend;
+    }
+    else if ( isQueryIndex( text ) )
+    {
+      // Matches the key in objects and the index in arrays
+      step.begin = parsePathIndex( text, text );
+      step.end = step.begin + 1;
+    }
+    else if ( text.find( ':' ) != std::string::npos )
+    {
+      size_t colon = text.find( ':' );
+      std::string first = text.substr( 0, colon );
+      std::string last = text.substr( colon + 1 );
+
+      if ( ( ! first.empty() && ! isQueryIndex( first ) ) || ( ! last.empty() && ! isQueryIndex( last ) ) )
+      {
+        throw Exception( std::string( "Invalid slice in query: " ) + text );
+      }
+
+      step.kind = Query::Step::Slice;
+      step.begin = first.empty() ? 0 : parsePathIndex( first, text );
+      step.end = last.empty() ? std::string::npos : parsePathIndex( last, text );
+    }
+
+    return step;
+  }
+
+
+  Query::Query( std::initializer_list<std::string> expressions )
+  {
+    for ( std::initializer_list<std::string>::const_iterator it = expressions.begin(); it != expressions.end(); ++it )
+    {
+      add( *it );
+    }
+  }
+
+
+  Query::Query( const std::vector<std::string>& expressions )
+  {
+    for ( std::vector<std::string>::const_iterator it = expressions.begin(); it != expressions.end(); ++it )
+    {
+      add( *it );
+    }
+  }
+
+
+  void Query::add( const std::string& text )
+  {
+    Expression expression;
+    size_t start = ( ! text.empty() && text[0] == '/' ) ? 1 : 0;
+
+    while ( start < text.size() )
+    {
+      size_t end = text.find( '/', start );
+      if ( end == std::string::npos ) end = text.size();
+
+      expression.push_back( compileStep( text.substr( start, end - start ) ) );
+      start = end + 1;
+    }
+
+    _expressions.push_back( expression );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Matching
+
+  void Query::_addState( size_t expression, size_t step, States& states ) const
+  {
+    std::pair<size_t, size_t> state( expression, step );
+    if ( std::find( states.begin(), states.end(), state ) != states.end() ) return;
+
+    states.push_back( state );
+
+    // A descent may also match no levels at all
+    const Expression& steps = _expressions[expression];
+    if ( step < steps.size() && steps[step].kind == Step::Descend )
+    {
+      _addState( expression, step + 1, states );
+    }
+  }
+
+
+  void Query::_advance( const States& states, const std::string* key, size_t index, States& result ) const
+  {
+    result.clear();
+
+    for ( States::const_iterator it = states.begin(); it != states.end(); ++it )
+    {
+      const Expression& steps = _expressions[it->first];
+      if ( it->second == steps.size() ) continue;
+
+      const Step& step = steps[it->second];
+      switch ( step.kind )
+      {
+        case Step::Key :
+          if ( key ? ( *key == step.key ) : ( index == step.begin ) ) _addState( it->first, it->second + 1, result );
+          break;
+
+        case Step::Any :
+          _addState( it->first, it->second + 1, result );
+          break;
+
+        case Step::Slice :
+          if ( ! key && index >= step.begin && index < step.end ) _addState( it->first, it->second + 1, result );
+          break;
+
+        case Step::Descend :
+          _addState( it->first, it->second, result );
+          break;
+      }
+    }
+  }
+
+
+  bool Query::_continues( const States& states, size_t index ) const
+  {
+    for ( States::const_iterator it = states.begin(); it != states.end(); ++it )
+    {
+      const Expression& steps = _expressions[it->first];
+      if ( it->second == steps.size() ) continue;
+
+      const Step& step = steps[it->second];
+      if ( step.kind == Step::Any || step.kind == Step::Descend ) return true;
+      if ( step.end != std::string::npos ? index < step.end : step.kind == Step::Slice ) return true;
+    }
+    return false;
+  }
+
+
+  void appendQueryPath( std::string& path, const std::string& key )
+  {
+    if ( ! path.empty() ) path.push_back( '/' );
+    path.append( key );
+  }
+
+
+  bool Query::_run( Reader& reader, const States& states, std::string& path, const Callback& callback ) const
+  {
+    // Read a matched value whole, then look for further matches inside it
+    for ( States::const_iterator it = states.begin(); it != states.end(); ++it )
+    {
+      if ( it->second == _expressions[it->first].size() )
+      {
+        Object value;
+        if ( ! readValue( reader, value ) ) return false;
+        _run( value, states, path, callback );
+        return true;
+      }
+    }
+
+    size_t length = path.size();
+    States child;
+
+    switch ( reader.event() )
+    {
+      case Reader::Value :
+        return true;
+
+      case Reader::BeginObject :
+        while ( reader.next() == Reader::Key )
+        {
+          _advance( states, &reader.text(), 0, child );
+          if ( child.empty() )
+          {
+            reader.skip();
+            continue;
+          }
+
+          appendQueryPath( path, reader.text() );
+          reader.next();
+          if ( ! _run( reader, child, path, callback ) ) return false;
+          path.resize( length );
+        }
+        return reader.event() == Reader::EndObject;
+
+      case Reader::BeginArray :
+        for ( size_t index = 0; ; ++index )
+        {
+          if ( ! _continues( states, index ) )
+          {
+            while ( reader.skipItem() ) {}
+            break;
+          }
+
+          _advance( states, nullptr, index, child );
+          if ( child.empty() )
+          {
+            if ( ! reader.skipItem() ) break;
+            continue;
+          }
+
+          if ( reader.next() == Reader::EndArray ) break;
+
+          appendQueryPath( path, std::to_string( index ) );
+          if ( ! _run( reader, child, path, callback ) ) return false;
+          path.resize( length );
+        }
+        return reader.event() == Reader::EndArray;
+
+      default :
+        return false;
+    }
+  }
+
+
+  void Query::_run( const Object& object, const States& states, std::string& path, const Callback& callback ) const
+  {
+    for ( States::const_iterator it = states.begin(); it != states.end(); ++it )
+    {
+      if ( it->second == _expressions[it->first].size() )
+      {
+        callback( it->first, path, object );
+      }
+    }
+
+    size_t length = path.size();
+    States child;
+
+    if ( object._type == Type::Object )
+    {
+      for ( Object::ObjectMap::const_iterator it = object._children.begin(); it != object._children.end(); ++it )
+      {
+        _advance( states, &it->first, 0, child );
+        if ( child.empty() ) continue;
+
+        appendQueryPath( path, it->first );
+        _run( *it->second, child, path, callback );
+        path.resize( length );
+      }
+    }
+    else if ( object._type == Type::Array )
+    {
+      for ( size_t index = 0; index < object._array.size() && _continues( states, index ); ++index )
+      {
+        _advance( states, nullptr, index, child );
+        if ( child.empty() ) continue;
+
+        appendQueryPath( path, std::to_string( index ) );
+        _run( *object._array[index], child, path, callback );
+        path.resize( length );
+      }
+    }
+  }
+
+
+  bool Query::run( Reader& reader, const Callback& callback ) const
+  {
+    States states;
+    for ( size_t i = 0; i < _expressions.size(); ++i )
+    {
+      _addState( i, 0, states );
+    }
+
+    std::string path;
+    return _run( reader, states, path, callback );
+  }
+
+
+  void Query::run( const Object& object, const Callback& callback ) const
+  {
+    States states;
+    for ( size_t i = 0; i < _expressions.size(); ++i )
+    {
+      _addState( i, 0, states );
+    }
+
+    std::string path;
+    _run( object, states, path, callback );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Streaming search
+
+  void queryStream( std::istream& input, const Query& query, const Query::Callback& callback )
+  {
+    queryStream( input, query, callback, ParseOptions() );
+  }
+
+
+  void queryStream( std::istream& input, const Query& query, const Query::Callback& callback, const ParseOptions& options )
+  {
+    Reader reader( input, options );
+
+    if ( reader.next() != Reader::Error )
+    {
+      query.run( reader, callback );
+    }
+
+    if ( ! reader.errors().empty() )
+    {
+      ErrorList errors( reader.errors() );
+      throw Exception( std::move( errors ) );
+    }
+  }
+
+}
+
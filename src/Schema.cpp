@@ -0,0 +1,131 @@
+
+#include "CON.h"
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Schema compilation
+
+  unsigned compileType( const std::string& name, bool& integer )
+  {
+    if ( name == "null" ) return 1u << static_cast<unsigned>( Type::Null );
+    if ( name == "string" ) return 1u << static_cast<unsigned>( Type::String );
+    if ( name == "number" ) return 1u << static_cast<unsigned>( Type::Numeric );
+    if ( name == "boolean" ) return 1u << static_cast<unsigned>( Type::Boolean );
+    if ( name == "array" ) return 1u << static_cast<unsigned>( Type::Array );
+    if ( name == "object" ) return 1u << static_cast<unsigned>( Type::Object );
+    if ( name == "any" ) return ~0u;
+    if ( name == "integer" )
+    {
+      integer = true;
+      return 1u << static_cast<unsigned>( Type::Numeric );
+    }
+
+    throw Exception( std::string( "Unknown schema type \"" ) + name + "\"" );
+  }
+
+
+  size_t compileSize( const Object& object, const std::string& name )
+  {
+    long size;
+    if ( ! object.tryAsLong( size ) || size < 0 )
+    {
+      throw Exception( std::string( "Schema " ) + name + " must be a non-negative integer" );
+    }
+    return static_cast<size_t>( size );
+  }
+
+
+  void Schema::_compile( const Object& object, Node& node )
+  {
+    if ( object.getType() != Type::Object )
+    {
+      throw Exception( "Schema rules must be objects" );
+    }
+
+    if ( const Object* type = object.find( "type" ) )
+    {
+      node.types = 0;
+      if ( type->getType() == Type::Array )
+      {
+        for ( size_t i = 0; i < type->getSize(); ++i )
+        {
+          node.types |= compileType( type->get( i ).asString(), node.integer );
+        }
+      }
+      else
+      {
+        node.types = compileType( type->asString(), node.integer );
+      }
+    }
+
+    if ( const Object* minimum = object.find( "minimum" ) )
+    {
+      if ( ! minimum->tryAsDouble( node.minimum ) ) throw Exception( "Schema minimum must be a number" );
+      node.hasMinimum = true;
+    }
+
+    if ( const Object* maximum = object.find( "maximum" ) )
+    {
+      if ( ! maximum->tryAsDouble( node.maximum ) ) throw Exception( "Schema maximum must be a number" );
+      node.hasMaximum = true;
+    }
+
+    if ( const Object* minItems = object.find( "minItems" ) )
+    {
+      node.minItems = compileSize( *minItems, "minItems" );
+    }
+
+    if ( const Object* maxItems = object.find( "maxItems" ) )
+    {
+      node.maxItems = compileSize( *maxItems, "maxItems" );
+    }
+
+    if ( const Object* required = object.find( "required" ) )
+    {
+      if ( required->getType() != Type::Array )
+      {
+        throw Exception( "Schema required must be an array of keys" );
+      }
+      for ( size_t i = 0; i < required->getSize(); ++i )
+      {
+        node.required.push_back( required->get( i ).asString() );
+      }
+    }
+
+    if ( const Object* additional = object.find( "additional" ) )
+    {
+      if ( ! additional->tryAsBool( node.additional ) ) throw Exception( "Schema additional must be a boolean" );
+    }
+
+    if ( const Object* properties = object.find( "properties" ) )
+    {
+      if ( properties->getType() != Type::Object )
+      {
+        throw Exception( "Schema properties must be an object" );
+      }
+      for ( Object::ObjectMap::const_iterator it = properties->_children.begin(); it != properties->_children.end(); ++it )
+      {
+        _compile( *it->second, node.properties[ it->first ] );
+      }
+    }
+
+    if ( const Object* items = object.find( "items" ) )
+    {
+      std::shared_ptr<Node> child = std::make_shared<Node>();
+      _compile( *items, *child );
+      node.items = child;
+    }
+  }
+
+
+  Schema::Schema( const Object& object )
+  {
+    std::shared_ptr<Node> root = std::make_shared<Node>();
+    _compile( object, *root );
+    _root = root;
+  }
+
+}
+
@@ -0,0 +1,145 @@
+
+#include "CON.h"
+
+#include <thread>
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Snapshot publication
+  //
+  // A reader announces itself in one of two groups before reading the node pointer, and leaves
+  // once it has taken a reference on the node. A publisher swaps the pointer and then waits for
+  // both groups to empty, one after the other, before dropping the holder's reference. Anyone who
+  // could have seen the old pointer has a reference by then. New readers join the group that is not
+  // being waited on, so a steady stream of them can never hold a publisher up.
+
+  struct Snapshot::Node
+  {
+    explicit Node( Object&& t ) : tree( std::move( t ) ), references( 1 ) {}
+
+    const Object tree;
+    std::atomic< long > references;
+  };
+
+
+  void Snapshot::_release( Node* node )
+  {
+    if ( node->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+    {
+      delete node;
+    }
+  }
+
+
+  void Snapshot::_drain( unsigned group ) const
+  {
+    while ( _readers[group].count.load( std::memory_order_acquire ) != 0 )
+    {
+      std::this_thread::yield();
+    }
+  }
+
+
+  Snapshot::Snapshot() :
+    _current( new Node( Object() ) ),
+    _group( 0 ),
+    _readers(),
+    _publishing()
+  {
+  }
+
+
+  Snapshot::Snapshot( Object tree ) :
+    _current( new Node( std::move( tree ) ) ),
+    _group( 0 ),
+    _readers(),
+    _publishing()
+  {
+  }
+
+
+  Snapshot::~Snapshot()
+  {
+    _release( _current.load( std::memory_order_acquire ) );
+  }
+
+
+  Snapshot::Handle Snapshot::load() const
+  {
+    unsigned group = _group.load( std::memory_order_seq_cst );
+    _readers[group].count.fetch_add( 1, std::memory_order_seq_cst );
+
+    // Safe, the publisher waits for this group before letting go of the node
+    Node* node = _current.load( std::memory_order_seq_cst );
+    node->references.fetch_add( 1, std::memory_order_relaxed );
+
+    _readers[group].count.fetch_sub( 1, std::memory_order_release );
+    return Handle( node );
+  }
+
+
+  void Snapshot::publish( Object tree )
+  {
+    Node* node = new Node( std::move( tree ) );
+    Node* previous;
+    {
+      std::lock_guard< std::mutex > lock( _publishing );
+      previous = _current.exchange( node, std::memory_order_seq_cst );
+
+      // Readers still in the other group are left from before the last switch. Once they are gone,
+      // new readers are sent there while the current group drains
+      unsigned group = _group.load( std::memory_order_relaxed );
+      _drain( group ^ 1 );
+      _group.store( group ^ 1, std::memory_order_seq_cst );
+      _drain( group );
+    }
+
+    _release( previous );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Snapshot handle
+
+  Snapshot::Handle::Handle( const Handle& other ) :
+    _node( other._node )
+  {
+    if ( _node != nullptr )
+    {
+      _node->references.fetch_add( 1, std::memory_order_relaxed );
+    }
+  }
+
+
+  Snapshot::Handle::Handle( Handle&& other ) :
+    _node( other._node )
+  {
+    other._node = nullptr;
+  }
+
+
+  Snapshot::Handle& Snapshot::Handle::operator=( Handle other )
+  {
+    std::swap( _node, other._node );
+    return *this;
+  }
+
+
+  Snapshot::Handle::~Handle()
+  {
+    if ( _node != nullptr )
+    {
+      Snapshot::_release( _node );
+    }
+  }
+
+
+  const Object* Snapshot::Handle::get() const
+  {
+    return ( _node != nullptr ) ? &_node->tree : nullptr;
+  }
+
+}
+
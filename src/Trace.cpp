@@ -0,0 +1,140 @@
+
+#include "CON.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Trace recording
+
+  Trace::Trace() :
+    _origin( std::chrono::steady_clock::now() )
+  {
+  }
+
+
+  size_t Trace::begin( const std::string& name, const std::string& category, const std::string& detail )
+  {
+    double now = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - _origin ).count();
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    std::vector<size_t>& open = _open[ std::this_thread::get_id() ];
+
+    size_t depth = 0;
+    for ( std::vector<size_t>::const_iterator it = open.begin(); it != open.end(); ++it )
+    {
+      if ( _events[*it].category == category ) ++depth;
+    }
+
+    size_t index = _events.size();
+    _events.push_back( Event{ name, category, detail, now, 0.0, depth, std::this_thread::get_id() } );
+    open.push_back( index );
+    return index;
+  }
+
+
+  void Trace::end( size_t index )
+  {
+    double now = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - _origin ).count();
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    if ( index >= _events.size() ) return;
+
+    Event& event = _events[index];
+    event.duration = now - event.begin;
+
+    std::vector<size_t>& open = _open[ event.thread ];
+    std::vector<size_t>::iterator found = std::find( open.begin(), open.end(), index );
+    if ( found != open.end() ) open.erase( found );
+  }
+
+
+  std::vector<Trace::Event> Trace::events() const
+  {
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _events;
+  }
+
+
+  void Trace::clear()
+  {
+    std::lock_guard<std::mutex> lock( _mutex );
+    _events.clear();
+    _open.clear();
+    _origin = std::chrono::steady_clock::now();
+  }
+
+
+  Trace::Span::Span( Trace* trace, const char* name, const char* category, const std::string& detail ) :
+    _trace( trace ),
+    _index( 0 )
+  {
+    if ( _trace ) _index = _trace->begin( name, category, detail );
+  }
+
+
+  Trace::Span::~Span()
+  {
+    if ( _trace ) _trace->end( _index );
+  }
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Trace event JSON
+
+  void writeTraceString( std::ostream& output, const std::string& text )
+  {
+    output << '"';
+    for ( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
+    {
+      unsigned char c = static_cast<unsigned char>( *it );
+      if ( c == '"' || c == '\\' )
+      {
+        output << '\\' << *it;
+      }
+      else if ( c < 0x20 )
+      {
+        output << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << static_cast<unsigned>( c ) << std::dec;
+      }
+      else
+      {
+        output << *it;
+      }
+    }
+    output << '"';
+  }
+
+
+  void Trace::write( std::ostream& output ) const
+  {
+    std::lock_guard<std::mutex> lock( _mutex );
+
+    // Threads are numbered in the order they first appear
+    std::map<std::thread::id, size_t> threads;
+
+    output << "{\"traceEvents\":[";
+    for ( std::vector<Event>::const_iterator it = _events.begin(); it != _events.end(); ++it )
+    {
+      size_t thread = threads.insert( std::make_pair( it->thread, threads.size() + 1 ) ).first->second;
+
+      output << ( it == _events.begin() ? "\n" : ",\n" ) << "{\"name\":";
+      writeTraceString( output, it->detail.empty() ? it->name : it->name + " " + it->detail );
+      output << ",\"cat\":";
+      writeTraceString( output, it->category );
+      output << ",\"ph\":\"X\",\"ts\":" << std::fixed << std::setprecision( 3 ) << it->begin << ",\"dur\":" << it->duration
+             << std::defaultfloat << ",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"depth\":" << it->depth;
+      if ( ! it->detail.empty() )
+      {
+        output << ",\"file\":";
+        writeTraceString( output, it->detail );
+      }
+      output << "}}";
+    }
+    output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  }
+
+}
+
@@ -0,0 +1,380 @@
+
+#include "CON.h"
+
+#include <algorithm>
+#include <exception>
+#include <set>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace CON
+{
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Watcher member function definitions
+
+  Watcher::Watcher( std::string root ) :
+    _root( root ),
+    _files(),
+    _inotify( inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ),
+    _watches(),
+    _snapshot(),
+    _callbackMutex(),
+    _callbacks(),
+    _errorCallback(),
+    _thread(),
+    _running( false )
+  {
+    if ( _inotify < 0 )
+    {
+      throw Exception( "Failed to initialise inotify" );
+    }
+
+    try
+    {
+      _load( _root );
+    }
+    catch( ... )
+    {
+      close( _inotify );
+      throw;
+    }
+
+    _publish();
+  }
+
+
+  Watcher::~Watcher()
+  {
+    stop();
+    close( _inotify );
+  }
+
+
+  Object Watcher::_load( const std::string& name )
+  {
+    bool created = ( _files.find( name ) == _files.end() );
+    Fragment& fragment = _files[name];
+
+    if ( fragment.loading )
+    {
+      throw Exception( std::string( "Circular include of file \"" ) + name + "\"" );
+    }
+    fragment.loading = true;
+
+    // Includes are resolved from the cache, only unknown files are read from disk
+    std::vector<Include> includes;
+    ParseOptions options;
+    options.include = [ this, &includes ]( const std::string& file, const Path& path ) -> Object
+    {
+      includes.push_back( Include{ path, file } );
+
+      FragmentMap::iterator found = _files.find( file );
+      if ( found == _files.end() || found->second.loading )
+      {
+        _load( file );
+        found = _files.find( file );
+      }
+      return _share( found->second.tree );
+    };
+
+    Object tree;
+    try
+    {
+      tree = buildFromFile( name, options );
+      _watch( name );
+    }
+    catch( ... )
+    {
+      if ( created )
+        _files.erase( name );
+      else
+        fragment.loading = false;
+      throw;
+    }
+
+    std::swap( fragment.tree, tree );
+    fragment.includes.swap( includes );
+    fragment.loading = false;
+
+    // Return the replaced version
+    return tree;
+  }
+
+
+  void Watcher::_watch( const std::string& name )
+  {
+    // Watch the directory so that files replaced by a rename are still seen
+    std::string directory;
+    std::string::size_type slash = name.rfind( '/' );
+    if ( slash == std::string::npos )
+      directory = ".";
+    else if ( slash == 0 )
+      directory = "/";
+    else
+      directory = name.substr( 0, slash );
+
+    int descriptor = inotify_add_watch( _inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+    if ( descriptor < 0 )
+    {
+      throw Exception( std::string( "Failed to watch directory \"" ) + directory + "\"" );
+    }
+
+    std::vector< std::string >& files = _watches[descriptor];
+    if ( std::find( files.begin(), files.end(), name ) == files.end() )
+    {
+      files.push_back( name );
+    }
+  }
+
+
+  void Watcher::_propagate( const std::string& file, const Patch& patch, Patch& root_patch )
+  {
+    if ( file == _root )
+    {
+      root_patch.insert( root_patch.end(), patch.begin(), patch.end() );
+    }
+
+    for ( FragmentMap::iterator it = _files.begin(); it != _files.end(); ++it )
+    {
+      for ( std::vector<Include>::const_iterator inc = it->second.includes.begin(); inc != it->second.includes.end(); ++inc )
+      {
+        if ( inc->file != file ) continue;
+
+        // Splice only the changes in at the point the file is included
+        Patch prefixed( patch );
+        for ( Patch::iterator op = prefixed.begin(); op != prefixed.end(); ++op )
+        {
+          op->path.insert( op->path.begin(), inc->path.begin(), inc->path.end() );
+        }
+
+        CON::apply( it->second.tree, prefixed );
+        _propagate( it->first, prefixed, root_patch );
+      }
+    }
+  }
+
+
+  void Watcher::_collect()
+  {
+    std::set< std::string > reachable;
+    std::vector< std::string > pending( 1, _root );
+
+    while ( ! pending.empty() )
+    {
+      std::string file = pending.back();
+      pending.pop_back();
+      if ( ! reachable.insert( file ).second ) continue;
+
+      const Fragment& fragment = _files[file];
+      for ( std::vector<Include>::const_iterator inc = fragment.includes.begin(); inc != fragment.includes.end(); ++inc )
+      {
+        pending.push_back( inc->file );
+      }
+    }
+
+    for ( FragmentMap::iterator it = _files.begin(); it != _files.end(); )
+    {
+      if ( reachable.find( it->first ) == reachable.end() )
+        it = _files.erase( it );
+      else
+        ++it;
+    }
+
+    // Directories are watched for as long as any file still in use lives in them
+    for ( std::map< int, std::vector< std::string > >::iterator it = _watches.begin(); it != _watches.end(); )
+    {
+      std::vector< std::string >& files = it->second;
+      files.erase( std::remove_if( files.begin(), files.end(), [ &reachable ]( const std::string& file ) { return reachable.find( file ) == reachable.end(); } ), files.end() );
+
+      if ( files.empty() )
+      {
+        inotify_rm_watch( _inotify, it->first );
+        it = _watches.erase( it );
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+
+  Object Watcher::_share( const Object& tree )
+  {
+    Object shared( tree._type );
+    shared._value = tree._value;
+    shared._shareChildren( tree );
+    return shared;
+  }
+
+
+  void Watcher::_publish()
+  {
+    // Reloads change the root tree through its non-const accessors, which copy shared nodes first
+    _snapshot.publish( _share( _files[_root].tree ) );
+  }
+
+
+  void Watcher::addCallback( Callback callback )
+  {
+    std::lock_guard< std::mutex > lock( _callbackMutex );
+    _callbacks.push_back( callback );
+  }
+
+
+  void Watcher::setErrorCallback( ErrorCallback callback )
+  {
+    std::lock_guard< std::mutex > lock( _callbackMutex );
+    _errorCallback = callback;
+  }
+
+
+  bool Watcher::poll( int timeout )
+  {
+    struct pollfd descriptor;
+    descriptor.fd = _inotify;
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+
+    if ( ::poll( &descriptor, 1, timeout ) <= 0 )
+    {
+      return false;
+    }
+
+    // Collect the set of changed files from every pending event
+    std::set< std::string > changed;
+    alignas( struct inotify_event ) char buffer[4096];
+    ssize_t length;
+    while ( ( length = read( _inotify, buffer, sizeof( buffer ) ) ) > 0 )
+    {
+      for ( char* pointer = buffer; pointer < buffer + length; )
+      {
+        const struct inotify_event* event = reinterpret_cast< const struct inotify_event* >( pointer );
+        pointer += sizeof( struct inotify_event ) + event->len;
+
+        if ( event->len == 0 ) continue;
+        std::map< int, std::vector< std::string > >::const_iterator found = _watches.find( event->wd );
+        if ( found == _watches.end() ) continue;
+
+        std::string name( event->name );
+        for ( std::vector< std::string >::const_iterator it = found->second.begin(); it != found->second.end(); ++it )
+        {
+          std::string::size_type slash = it->rfind( '/' );
+          if ( it->compare( slash == std::string::npos ? 0 : slash + 1, std::string::npos, name ) == 0 )
+          {
+            changed.insert( *it );
+          }
+        }
+      }
+    }
+
+    // Re-parse only the changed files and splice the differences into everything above them
+    Patch root_patch;
+    std::exception_ptr failure;
+
+    // Failures go to the error callback, called without the lock so that it may register others.
+    // Without one the first is rethrown once the other files are done
+    auto report = [ this, &failure ]( const Exception& ex )
+    {
+      ErrorCallback callback;
+      {
+        std::lock_guard< std::mutex > lock( _callbackMutex );
+        callback = _errorCallback;
+      }
+
+      if ( callback )
+        callback( ex );
+      else if ( ! failure )
+        failure = std::current_exception();
+    };
+    for ( std::set< std::string >::const_iterator it = changed.begin(); it != changed.end(); ++it )
+    {
+      if ( _files.find( *it ) == _files.end() ) continue;
+
+      try
+      {
+        Object previous = _load( *it );
+        Patch patch = diff( previous, _files[*it].tree );
+        _propagate( *it, patch, root_patch );
+      }
+      catch( Exception& ex )
+      {
+        report( ex );
+      }
+      catch( std::exception& ex )
+      {
+        // Anything else, such as running out of memory, is passed on in the same way
+        report( Exception( std::string( "Failed to reload \"" ) + *it + "\": " + ex.what() ) );
+      }
+    }
+    _collect();
+
+    bool published = false;
+    if ( ! root_patch.empty() )
+    {
+      _publish();
+      published = true;
+
+      std::vector< Path > paths;
+      for ( Patch::const_iterator op = root_patch.begin(); op != root_patch.end(); ++op )
+      {
+        paths.push_back( op->path );
+      }
+
+      std::vector< Callback > callbacks;
+      {
+        std::lock_guard< std::mutex > lock( _callbackMutex );
+        callbacks = _callbacks;
+      }
+
+      for ( std::vector< Callback >::iterator it = callbacks.begin(); it != callbacks.end(); ++it )
+      {
+        (*it)( paths );
+      }
+    }
+
+    if ( failure )
+    {
+      std::rethrow_exception( failure );
+    }
+
+    return published;
+  }
+
+
+  void Watcher::start()
+  {
+    if ( _running ) return;
+
+    _running = true;
+    _thread = std::thread( [ this ]()
+    {
+      while ( _running )
+      {
+        try
+        {
+          poll( 100 );
+        }
+        catch( ... )
+        {
+          // Reported through the error callback if one is set
+        }
+      }
+    } );
+  }
+
+
+  void Watcher::stop()
+  {
+    _running = false;
+    if ( _thread.joinable() )
+    {
+      _thread.join();
+    }
+  }
+
+}
+